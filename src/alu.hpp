@@ -0,0 +1,171 @@
+#ifndef RISC_V_ALU_HPP
+#define RISC_V_ALU_HPP
+
+#include <bit>
+#include <limits>
+#include "instructions.hpp"
+
+using namespace instructions;
+
+// Compute the result of an instruction that is not a load or store.
+// For branch, result stores whether to jump. For jal and jalr, result is the return address.
+unsigned int execute_alu(Op op, int rs1, int rs2, int imm, unsigned int pc, bool compressed) {
+  switch (op) {
+    case LUI:
+      return imm;
+    case AUIPC:
+      return pc + imm;
+    case JAL:
+    case JALR:
+      return pc + (compressed ? 2 : 4);
+    case LUI_ADDI:
+      return imm;
+    case AUIPC_JALR:
+      return pc + 4 + (compressed ? 2 : 4); // the jalr follows the 4-byte auipc
+    case SLLI_ADD:
+      return (static_cast<unsigned int>(rs1) << imm) + rs2;
+    case SLLI_SRLI:
+      return static_cast<unsigned int>(rs1) << (imm & 0b11111) >> (imm >> 5);
+    case BEQ:
+      return rs1 == rs2;
+    case BNE:
+      return rs1 != rs2;
+    case BLT:
+      return rs1 < rs2;
+    case BGE:
+      return rs1 >= rs2;
+    case BLTU:
+      return static_cast<unsigned int>(rs1) < static_cast<unsigned int>(rs2);
+    case BGEU:
+      return static_cast<unsigned int>(rs1) >= static_cast<unsigned int>(rs2);
+    case ADDI:
+      return static_cast<unsigned int>(rs1) + imm;
+    case SLTI:
+      return rs1 < imm ? 1 : 0;
+    case SLTIU:
+      return static_cast<unsigned int>(rs1) < static_cast<unsigned int>(imm) ? 1 : 0;
+    case XORI:
+      return rs1 ^ imm;
+    case ORI:
+      return rs1 | imm;
+    case ANDI:
+      return rs1 & imm;
+    case SLLI:
+      return static_cast<unsigned int>(rs1) << imm;
+    case SRLI:
+      return static_cast<unsigned int>(rs1) >> imm;
+    case SRAI:
+      return rs1 >> imm;
+    case ADD:
+      return static_cast<unsigned int>(rs1) + rs2;
+    case SUB:
+      return static_cast<unsigned int>(rs1) - rs2;
+    case SLL:
+      return static_cast<unsigned int>(rs1) << (rs2 & 0b11111);
+    case SLT:
+      return rs1 < rs2 ? 1 : 0;
+    case SLTU:
+      return static_cast<unsigned int>(rs1) < static_cast<unsigned int>(rs2) ? 1 : 0;
+    case XOR:
+      return rs1 ^ rs2;
+    case SRL:
+      return static_cast<unsigned int>(rs1) >> (rs2 & 0b11111);
+    case SRA:
+      return rs1 >> (rs2 & 0b11111);
+    case OR:
+      return rs1 | rs2;
+    case AND:
+      return rs1 & rs2;
+    case SH1ADD:
+      return (static_cast<unsigned int>(rs1) << 1) + rs2;
+    case SH2ADD:
+      return (static_cast<unsigned int>(rs1) << 2) + rs2;
+    case SH3ADD:
+      return (static_cast<unsigned int>(rs1) << 3) + rs2;
+    case ANDN:
+      return rs1 & ~rs2;
+    case ORN:
+      return rs1 | ~rs2;
+    case XNOR:
+      return ~(rs1 ^ rs2);
+    case CLZ:
+      return std::countl_zero(static_cast<unsigned int>(rs1));
+    case CTZ:
+      return std::countr_zero(static_cast<unsigned int>(rs1));
+    case CPOP:
+      return std::popcount(static_cast<unsigned int>(rs1));
+    case MAX:
+      return std::max(rs1, rs2);
+    case MAXU:
+      return std::max(static_cast<unsigned int>(rs1), static_cast<unsigned int>(rs2));
+    case MIN:
+      return std::min(rs1, rs2);
+    case MINU:
+      return std::min(static_cast<unsigned int>(rs1), static_cast<unsigned int>(rs2));
+    case SEXTB:
+      return static_cast<signed char>(rs1);
+    case SEXTH:
+      return static_cast<short>(rs1);
+    case ZEXTH:
+      return rs1 & 0xffff;
+    case ROL:
+      return std::rotl(static_cast<unsigned int>(rs1), rs2 & 0b11111);
+    case ROR:
+      return std::rotr(static_cast<unsigned int>(rs1), rs2 & 0b11111);
+    case RORI:
+      return std::rotr(static_cast<unsigned int>(rs1), imm);
+    case ORCB: {
+      unsigned int result = 0;
+      for (unsigned int i = 0; i < 32; i += 8) {
+        result |= (static_cast<unsigned int>(rs1) >> i & 0xff ? 0xffu : 0) << i;
+      }
+      return result;
+    }
+    case REV8: {
+      auto value = static_cast<unsigned int>(rs1);
+      return value << 24 | (value & 0xff00) << 8 | (value >> 8 & 0xff00) | value >> 24;
+    }
+    default:
+      throw std::invalid_argument("Invalid ALU instruction.");
+  }
+}
+
+// Compute the result of a multiply or divide instruction.
+// Division by zero and overflow give the results the RISC-V spec defines rather than trapping.
+unsigned int execute_multiply_divide(Op op, int rs1, int rs2) {
+  auto u1 = static_cast<unsigned int>(rs1), u2 = static_cast<unsigned int>(rs2);
+  switch (op) {
+    case MUL:
+      return u1 * u2;
+    case MULH:
+      return static_cast<unsigned long long>(static_cast<long long>(rs1) * rs2) >> 32;
+    case MULHSU:
+      return static_cast<unsigned long long>(static_cast<long long>(rs1) * static_cast<long long>(u2)) >> 32;
+    case MULHU:
+      return static_cast<unsigned long long>(u1) * u2 >> 32;
+    case DIV:
+      if (rs2 == 0) {
+        return -1;
+      }
+      if (rs1 == std::numeric_limits<int>::min() && rs2 == -1) {
+        return rs1;
+      }
+      return rs1 / rs2;
+    case DIVU:
+      return u2 == 0 ? -1 : u1 / u2;
+    case REM:
+      if (rs2 == 0) {
+        return rs1;
+      }
+      if (rs1 == std::numeric_limits<int>::min() && rs2 == -1) {
+        return 0;
+      }
+      return rs1 % rs2;
+    case REMU:
+      return u2 == 0 ? u1 : u1 % u2;
+    default:
+      throw std::invalid_argument("Invalid multiply or divide instruction.");
+  }
+}
+
+#endif //RISC_V_ALU_HPP
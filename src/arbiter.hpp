@@ -0,0 +1,276 @@
+#ifndef RISC_V_ARBITER_HPP
+#define RISC_V_ARBITER_HPP
+
+#include "config.hpp"
+#include "memory.hpp"
+
+// The ports of each core: the data port, then a fetch port for each hardware thread.
+// A port is numbered core * ports_per_core() + ArbiterPort + thread + 1, and 0 is no port.
+enum ArbiterPort {
+  DATA_PORT,
+  FETCH_PORT
+};
+
+constexpr unsigned int NO_PORT = 0;
+
+unsigned int ports_per_core() {
+  return 1 + config.smt;
+}
+
+unsigned int port_index(unsigned int core, ArbiterPort port, unsigned int thread = 0) {
+  return core * ports_per_core() + port + thread + 1;
+}
+
+struct CorePortsWire {
+  std::array<FlagWire, MAX_THREADS> fetch_request; // of each thread
+  std::array<DataWire, MAX_THREADS> fetch_addr;
+  FlagWire load;
+  FlagWire store;
+  FlagWire fill; // the data port reads a whole block, like instruction fetch
+  DataWire addr;
+  MemoryAccessModeWire mode;
+  AtomicCodeWire atomic; // the load is a memory::AtomicOperation
+  DataWire store_data;
+  ThreadIndexWire thread; // of the data access
+  std::array<FlagWire, MAX_THREADS> flushing; // a flush of a thread cancels its instruction fetch
+};
+
+struct ArbiterInput {
+  std::array<CorePortsWire, MAX_CORES> cores;
+  FlagWire memory_busy;
+};
+
+struct ArbiterOutput {
+  PortIndex owner; // the port memory is serving while it is busy
+  Data access_addr; // ... and the address it asked for, which a fetch port may change before memory is done
+  Flag reservation_lost; // the sc memory is serving fails
+  Flag snoop; // memory started to write snoop_addr in last cycle, for snoop_core
+  Data snoop_addr;
+  CoreIndex snoop_core;
+};
+
+struct ArbiterData {
+  PortIndex last; // the port granted last, for round robin
+  std::array<Flag, MAX_CORES * MAX_THREADS> reserved; // each hart has a reservation made by lr
+  std::array<Data, MAX_CORES * MAX_THREADS> reservation; // ... for this address
+};
+
+// Sits between the ports of all cores and Memory, and is the bus they share.
+// While memory is idle the grant is decided combinationally, so winning costs no extra cycle.
+// Once memory accepts the access, owner keeps forwarding that port until memory is idle again.
+// The arbiter and memory may run on a slower clock than the cores; wait_cycles then count memory cycles.
+// The data caches are write-through, so a line is only valid or invalid in them: each write that starts
+// is snooped by the other cores, which drop their copy of the line. It also ends the lr reservations
+// of the other harts on the line, threads of the same core included; an sc whose reservation is gone
+// is served as a load that does not write.
+struct MemoryArbiter : dark::Module<ArbiterInput, ArbiterOutput, ArbiterData> {
+  std::array<Statistics *, MAX_CORES> statistics{}; // of each core
+
+  static unsigned int core_of(unsigned int index) {
+    return (index - 1) / ports_per_core();
+  }
+
+  static bool is_fetch(unsigned int index) {
+    return (index - 1) % ports_per_core() != DATA_PORT;
+  }
+
+  // The thread of a fetch port.
+  static unsigned int thread_of(unsigned int index) {
+    return (index - 1) % ports_per_core() - FETCH_PORT;
+  }
+
+  bool wants(unsigned int index) const {
+    const CorePortsWire &ports = cores[core_of(index)];
+    if (is_fetch(index)) {
+      auto thread = thread_of(index);
+      return ports.fetch_request[thread] == true && ports.flushing[thread] == false;
+    }
+    return ports.load == true || ports.store == true;
+  }
+
+  // Whether the policy serves the port before ports of the other kind.
+  bool preferred(unsigned int index) const {
+    switch (config.arbiter_policy) {
+      case FETCH_FIRST:
+        return is_fetch(index);
+      case DATA_FIRST:
+        return !is_fetch(index);
+      default:
+        return true;
+    }
+  }
+
+  // Ports are looked at in turn, from the one after the last granted.
+  unsigned int grant() const {
+    if (memory_busy) {
+      return to_unsigned(owner);
+    }
+    auto ports = config.cores * ports_per_core();
+    unsigned int other = NO_PORT;
+    for (unsigned int i = 1; i <= ports; i++) {
+      auto index = (to_unsigned(last) + i - 1) % ports + 1;
+      if (!wants(index)) {
+        continue;
+      }
+      if (preferred(index)) {
+        return index;
+      }
+      if (other == NO_PORT) {
+        other = index;
+      }
+    }
+    return other;
+  }
+
+  const CorePortsWire &granted() const {
+    auto index = grant();
+    return cores[index == NO_PORT ? 0 : core_of(index)];
+  }
+
+  // Values forwarded to memory.
+  bool forward_load() const {
+    auto index = grant();
+    return index != NO_PORT && (is_fetch(index) || granted().load == true);
+  }
+
+  bool forward_store() const {
+    auto index = grant();
+    return index != NO_PORT && !is_fetch(index) && granted().store == true;
+  }
+
+  bool forward_fetch() const {
+    auto index = grant();
+    return index != NO_PORT && (is_fetch(index) || granted().fill == true);
+  }
+
+  // The address the granted port asks for.
+  max_size_t requested_addr(unsigned int index) const {
+    return to_unsigned(index != NO_PORT && is_fetch(index) ? granted().fetch_addr[thread_of(index)] : granted().addr);
+  }
+
+  max_size_t forward_addr() const {
+    return memory_busy ? to_unsigned(access_addr) : requested_addr(grant());
+  }
+
+  max_size_t forward_mode() const {
+    auto index = grant();
+    return index != NO_PORT && is_fetch(index) ? static_cast<max_size_t>(memory::WORD) : to_unsigned(granted().mode);
+  }
+
+  max_size_t forward_atomic() const {
+    auto index = grant();
+    return index != NO_PORT && !is_fetch(index) && granted().load == true
+           ? to_unsigned(granted().atomic)
+           : static_cast<max_size_t>(memory::NOT_ATOMIC);
+  }
+
+  max_size_t forward_store_data() const {
+    return to_unsigned(granted().store_data);
+  }
+
+  // Whether the access memory is finishing this cycle belongs to the given port.
+  bool serving(unsigned int core, ArbiterPort port, unsigned int thread = 0) const {
+    return owner == port_index(core, port, thread);
+  }
+
+  // Whether the block memory is finishing is the one the fetch port of thread waits for. With a slower
+  // memory clock, a flush may come and go between two memory cycles without cancelling the access,
+  // and the fetch unit asks for another block meanwhile.
+  bool fetch_served(unsigned int core, unsigned int thread) const {
+    const CorePortsWire &ports = cores[core];
+    return serving(core, FETCH_PORT, thread) && ports.fetch_request[thread] == true &&
+           ports.fetch_addr[thread] == access_addr;
+  }
+
+  // Whether memory drops its access, an instruction fetch of a thread that is flushing.
+  bool cancelled() const {
+    auto index = to_unsigned(owner);
+    return memory_busy == true && index != NO_PORT && is_fetch(index) &&
+           cores[core_of(index)].flushing[thread_of(index)] == true;
+  }
+
+  // Whether a write at addr may touch the line of target. The lines of both ends of a word are snooped,
+  // so that a write that crosses a line is seen in both.
+  static bool snooped(unsigned int target, unsigned int addr) {
+    auto line = target & ~(FETCH_BLOCK_SIZE - 1);
+    return (addr & ~(FETCH_BLOCK_SIZE - 1)) == line || ((addr + 3) & ~(FETCH_BLOCK_SIZE - 1)) == line;
+  }
+
+  // Keep the reservations up to date with the data access granted to core, and return whether it writes.
+  bool reserve(unsigned int core) {
+    const CorePortsWire &ports = cores[core];
+    auto atomic = static_cast<memory::AtomicOperation>(to_unsigned(ports.atomic));
+    auto addr = to_unsigned(ports.addr);
+    auto hart = core * config.smt + to_unsigned(ports.thread);
+    if (ports.load == true && atomic == memory::LOAD_RESERVED) {
+      reserved[hart].assign(true);
+      reservation[hart].assign(addr);
+      return false;
+    }
+    if (ports.load == true && atomic == memory::STORE_CONDITIONAL) {
+      bool lost = reserved[hart] == false || reservation[hart] != addr;
+      reserved[hart].assign(false);
+      reservation_lost.assign(lost);
+      if (lost) {
+        statistics[core]->failed_store_conditionals++;
+        return false;
+      }
+    } else if (ports.load == true && atomic == memory::NOT_ATOMIC) {
+      return false;
+    }
+    for (unsigned int other = 0; other < config.cores * config.smt; other++) {
+      if (other != hart && reserved[other] == true && snooped(to_unsigned(reservation[other]), addr)) {
+        reserved[other].assign(false);
+      }
+    }
+    return true;
+  }
+
+  void work() override {
+    if (cancelled()) {
+      owner.assign(NO_PORT);
+      snoop.assign(false);
+      return;
+    }
+    auto index = grant();
+    unsigned int wanting = 0;
+    for (unsigned int core = 0; core < config.cores; core++) {
+      for (unsigned int port = 0; port < ports_per_core(); port++) {
+        auto port_wanting = port_index(core, DATA_PORT) + port;
+        if (!wants(port_wanting)) {
+          continue;
+        }
+        wanting++;
+        if (index != port_wanting) {
+          (port == DATA_PORT ? statistics[core]->data_wait_cycles : statistics[core]->fetch_wait_cycles)++;
+        }
+      }
+    }
+    if (memory_busy == true || index == NO_PORT) {
+      if (memory_busy == false) {
+        owner.assign(NO_PORT);
+      }
+      snoop.assign(false);
+      return;
+    }
+    if (wanting > 1) {
+      arbiter_conflicts++;
+    }
+    owner.assign(index);
+    access_addr.assign(requested_addr(index));
+    last.assign(index);
+    auto core = core_of(index);
+    if (is_fetch(index)) {
+      statistics[core]->fetch_grants++;
+      snoop.assign(false);
+      return;
+    }
+    statistics[core]->data_grants++;
+    bool writes = reserve(core);
+    snoop.assign(writes);
+    snoop_addr.assign(cores[core].addr);
+    snoop_core.assign(core);
+  }
+};
+
+#endif //RISC_V_ARBITER_HPP
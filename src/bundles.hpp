@@ -0,0 +1,218 @@
+#ifndef RISC_V_BUNDLES_HPP
+#define RISC_V_BUNDLES_HPP
+
+#include "fetch.hpp"
+
+// Values passed between the back-end modules. Each bundle is a group of registers owned by the module
+// that produces it, and a matching group of wires for the modules that read it.
+
+// An operand of an instruction.
+struct PendingData {
+  Data data;
+  Flag pending; // when pending is true, data stores the position of the pending instruction
+  Flag poisoned; // in runahead, the value depends on a load that missed and is not real
+};
+
+struct PendingDataWire {
+  DataWire data;
+  FlagWire pending;
+  FlagWire poisoned;
+};
+
+// A result a functional unit broadcasts. Waiting operands and the reorder buffer listen to every bus.
+struct ResultBus {
+  Flag valid;
+  InstPos tag; // position of the instruction in reorder buffer
+  Data value;
+  Data target; // for jalr, where to jump
+  FloatFlags flags; // for floating-point instructions, the exceptions raised
+  Flag poisoned; // in runahead, see PendingData
+};
+
+struct ResultBusWire {
+  FlagWire valid;
+  InstPosWire tag;
+  DataWire value;
+  DataWire target;
+  FloatFlagsWire flags;
+  FlagWire poisoned;
+};
+
+void connect(ResultBusWire &wire, ResultBus &bus) {
+  wire.valid.follow(bus.valid);
+  wire.tag.follow(bus.tag);
+  wire.value.follow(bus.value);
+  wire.target.follow(bus.target);
+  wire.flags.follow(bus.flags);
+  wire.poisoned.follow(bus.poisoned);
+}
+
+using ResultBuses = std::array<ResultBusWire, RESULT_BUS_COUNT>;
+
+// Look for the result of instruction tag on the buses.
+bool read_buses(const ResultBuses &buses, unsigned int tag, unsigned int &value, bool &poisoned) {
+  for (auto &bus: buses) {
+    if (bus.valid == true && bus.tag == tag) {
+      value = to_unsigned(bus.value);
+      poisoned = static_cast<bool>(bus.poisoned);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Catch the value of a waiting operand if it is broadcast in this cycle.
+void listen(PendingData &operand, const ResultBuses &buses) {
+  unsigned int value;
+  bool poisoned;
+  if (operand.pending == true && read_buses(buses, to_unsigned(operand.data), value, poisoned)) {
+    operand.pending.assign(false);
+    operand.data.assign(value);
+    operand.poisoned.assign(poisoned);
+  }
+}
+
+// The same, for an operand being written into a new entry in this cycle.
+void listen(PendingData &operand, const PendingDataWire &source, const ResultBuses &buses) {
+  unsigned int value;
+  bool poisoned;
+  if (source.pending == true && read_buses(buses, to_unsigned(source.data), value, poisoned)) {
+    operand.pending.assign(false);
+    operand.data.assign(value);
+    operand.poisoned.assign(poisoned);
+  } else {
+    operand.pending.assign(source.pending);
+    operand.data.assign(source.data);
+    operand.poisoned.assign(source.poisoned);
+  }
+}
+
+// Clear the slots of a bundle from first on. Only those set are assigned: past the width in use that is none,
+// unless a sweep variant narrowed it.
+template<typename _Slots>
+void clear_slots(_Slots &slots, unsigned int first) {
+  for (auto k = first; k < slots.size(); k++) {
+    if (slots[k].valid == true) {
+      slots[k].valid.assign(false);
+    }
+  }
+}
+
+// Whether thread is among those flushing. With several hardware threads, a flush drops only the work of its thread.
+// flushing is a ThreadMask, or a wire of one.
+template<typename _Mask>
+bool flushes(const _Mask &flushing, unsigned int thread) {
+  return to_unsigned(flushing) >> thread & 1;
+}
+
+// An instruction renamed by the reorder buffer, on its way to the reservation station or the load/store buffer.
+// The instructions renamed in one cycle belong to one thread.
+struct IssueSlot {
+  Flag valid;
+  InstPos tag;
+  ThreadIndex thread;
+  OpCode opcode;
+  RegPos destination;
+  std::array<PendingData, 3> operands; // the third is only used by fused multiply-add
+  Data immediate;
+  Data pc;
+  Flag compressed;
+  Flag eliminated; // resolved by the reorder buffer at rename; no unit executes it
+};
+
+struct IssueSlotWire {
+  FlagWire valid;
+  InstPosWire tag;
+  ThreadIndexWire thread;
+  Wire<7> opcode;
+  RegPosWire destination;
+  std::array<PendingDataWire, 3> operands;
+  DataWire immediate;
+  DataWire pc;
+  FlagWire compressed;
+  FlagWire eliminated;
+};
+
+void connect(IssueSlotWire &wire, IssueSlot &slot) {
+  wire.valid.follow(slot.valid);
+  wire.tag.follow(slot.tag);
+  wire.thread.follow(slot.thread);
+  wire.opcode.follow(slot.opcode);
+  wire.destination.follow(slot.destination);
+  for (unsigned int i = 0; i < 3; i++) {
+    wire.operands[i].data.follow(slot.operands[i].data);
+    wire.operands[i].pending.follow(slot.operands[i].pending);
+    wire.operands[i].poisoned.follow(slot.operands[i].poisoned);
+  }
+  wire.immediate.follow(slot.immediate);
+  wire.pc.follow(slot.pc);
+  wire.compressed.follow(slot.compressed);
+  wire.eliminated.follow(slot.eliminated);
+}
+
+using IssueSlots = std::array<IssueSlotWire, MAX_ISSUE_WIDTH>;
+
+// An instruction sent from reservation station to the multiplier, the divider or a floating-point unit,
+// with its operands ready.
+struct UnitRequest {
+  Flag valid;
+  InstPos tag;
+  ThreadIndex thread;
+  OpCode opcode;
+  Data rs1;
+  Data rs2;
+  Data rs3;
+  RoundingMode rounding_mode; // as encoded in the instruction, for floating-point units
+};
+
+struct UnitRequestWire {
+  FlagWire valid;
+  InstPosWire tag;
+  ThreadIndexWire thread;
+  Wire<7> opcode;
+  DataWire rs1;
+  DataWire rs2;
+  DataWire rs3;
+  RoundingModeWire rounding_mode;
+};
+
+void connect(UnitRequestWire &wire, UnitRequest &request) {
+  wire.valid.follow(request.valid);
+  wire.tag.follow(request.tag);
+  wire.thread.follow(request.thread);
+  wire.opcode.follow(request.opcode);
+  wire.rs1.follow(request.rs1);
+  wire.rs2.follow(request.rs2);
+  wire.rs3.follow(request.rs3);
+  wire.rounding_mode.follow(request.rounding_mode);
+}
+
+// An instruction retired by the reorder buffer, whose result goes to the register file.
+struct CommitSlot {
+  Flag valid;
+  InstPos tag;
+  ThreadIndex thread;
+  RegPos destination;
+  Data value;
+  Flag poisoned; // retired in runahead, see PendingData
+};
+
+struct CommitSlotWire {
+  FlagWire valid;
+  InstPosWire tag;
+  ThreadIndexWire thread;
+  RegPosWire destination;
+  DataWire value;
+  FlagWire poisoned;
+};
+
+void connect(CommitSlotWire &wire, CommitSlot &slot) {
+  wire.valid.follow(slot.valid);
+  wire.tag.follow(slot.tag);
+  wire.thread.follow(slot.thread);
+  wire.destination.follow(slot.destination);
+  wire.value.follow(slot.value);
+  wire.poisoned.follow(slot.poisoned);
+}
+
+#endif //RISC_V_BUNDLES_HPP
@@ -0,0 +1,314 @@
+#ifndef RISC_V_CHECKPOINT_HPP
+#define RISC_V_CHECKPOINT_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "system.hpp"
+
+// Checkpoints of a whole System between two cycles: the registers of every module, the clocks, guest memory and
+// the counters. A file is a header followed by sections at offsets aligned for mapping it:
+//   registers  the words of dark::Archive, in the order CPU::transfer visits them
+//   counters   total_tick, arbiter_conflicts, the csr counters and the statistics of each core
+//   pages      the numbers of the memory pages saved, then their contents, PAGE_SIZE bytes each
+// A full checkpoint has every page that is not all zero. An incremental one has only the pages that changed since
+// its parent, the checkpoint written before it; loading it loads the parent first. A checkpoint is only loaded with
+// the MACHINE_OPTIONS it was saved with.
+// Files are read by mapping them, and are only valid on a host with the same byte order.
+namespace checkpoint {
+  constexpr char MAGIC[8] = {'R', 'V', 'C', 'K', 'P', 'T', 0, 0};
+  constexpr unsigned int VERSION = 3;
+  constexpr unsigned int PAGE_SIZE = 1 << 12;
+  constexpr unsigned int PAGE_SHIFT = 12;
+  constexpr unsigned int MAX_PATH = 256;
+  constexpr unsigned int MAX_MACHINE_OPTIONS = 16;
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t incremental;
+    std::uint64_t id; // of this checkpoint
+    std::uint64_t parent_id; // of the checkpoint parent names, for an incremental one
+    char parent[MAX_PATH];
+    std::uint32_t machine[MAX_MACHINE_OPTIONS]; // the values of MACHINE_OPTIONS, in order; the rest 0
+    std::uint64_t register_count, register_offset;
+    std::uint64_t counters_size, counters_offset;
+    std::uint64_t page_count, page_numbers_offset, pages_offset;
+  };
+
+  struct Counters {
+    int total_tick;
+    int arbiter_conflicts;
+    decltype(csr::hart_counters) hart_counters;
+    std::array<Statistics, MAX_CORES> statistics;
+  };
+
+  static_assert(std::is_trivially_copyable_v<Counters>);
+
+  using Page = std::array<unsigned char, PAGE_SIZE>;
+
+  // Pages of guest memory that hold a byte other than 0, by page number.
+  std::unordered_map<unsigned int, Page> collect_pages() {
+    std::unordered_map<unsigned int, Page> pages;
+    for (auto [addr, byte]: memory::memory) {
+      if (byte != 0) {
+        auto [page, inserted] = pages.try_emplace(addr >> PAGE_SHIFT);
+        if (inserted) {
+          page->second.fill(0);
+        }
+        page->second[addr & (PAGE_SIZE - 1)] = byte;
+      }
+    }
+    return pages;
+  }
+
+  std::uint64_t hash_page(const Page &page) {
+    std::uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+    for (auto byte: page) {
+      hash = (hash ^ byte) * 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  std::uint64_t align(std::uint64_t offset, std::uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+
+  std::uint32_t clock_ratio() {
+    return config.memory_clock_numerator << 16 | config.memory_clock_denominator;
+  }
+
+  // An option that shapes the machine, with its value in config.
+  struct MachineOption {
+    const char *name;
+    std::uint32_t (*value)();
+  };
+
+  // The options that shape the machine other than VARIANT_OPTIONS. A checkpoint records them, and is loaded into
+  // a System built with the same ones; the options a sweep variant may set can differ, as they can between cycles.
+  constexpr MachineOption MACHINE_OPTIONS[] = {
+    {"--core", []() -> std::uint32_t { return config.core_model; }},
+    {"--branch-prediction", []() -> std::uint32_t { return config.branch_prediction; }},
+    {"--cores", []() -> std::uint32_t { return config.cores; }},
+    {"--smt", []() -> std::uint32_t { return config.smt; }},
+    {"--rob", []() -> std::uint32_t { return config.shared_rob; }},
+    {"--mul-latency", []() -> std::uint32_t { return config.multiply_latency; }},
+    {"--fp-latency", []() -> std::uint32_t { return config.float_latency; }},
+    {"--fdiv-latency", []() -> std::uint32_t { return config.float_divide_latency; }},
+    {"--memory-clock", clock_ratio},
+    {"--runahead", []() -> std::uint32_t { return config.runahead; }},
+    {"--no-trace-cache", []() -> std::uint32_t { return !config.trace_cache; }},
+    {"--rob-entries", []() -> std::uint32_t { return config.rob_entries; }},
+    {"--rs-entries", []() -> std::uint32_t { return config.rs_entries; }},
+    {"--lsb-entries", []() -> std::uint32_t { return config.lsb_entries; }},
+  };
+
+  static_assert(std::size(MACHINE_OPTIONS) <= MAX_MACHINE_OPTIONS);
+
+  // A checkpoint file mapped read-only.
+  class MappedFile {
+    void *data = MAP_FAILED;
+    size_t size = 0;
+
+  public:
+    explicit MappedFile(const std::string &path) {
+      int fd = open(path.c_str(), O_RDONLY);
+      struct stat status{};
+      if (fd < 0 || fstat(fd, &status) != 0) {
+        if (fd >= 0) {
+          close(fd);
+        }
+        throw std::runtime_error("Cannot open checkpoint " + path);
+      }
+      size = status.st_size;
+      if (size >= sizeof(Header)) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      }
+      close(fd);
+      if (data == MAP_FAILED || std::memcmp(header().magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a checkpoint: " + path);
+      }
+      if (header().version != VERSION) {
+        throw std::runtime_error("Checkpoint " + path + " has version " + std::to_string(header().version) +
+                                 ", expected " + std::to_string(VERSION));
+      }
+      auto &h = header();
+      if (h.register_offset + h.register_count * sizeof(dark::max_size_t) > size ||
+          h.counters_offset + h.counters_size > size || h.pages_offset + h.page_count * PAGE_SIZE > size) {
+        throw std::runtime_error("Checkpoint " + path + " is truncated");
+      }
+    }
+    MappedFile(const MappedFile &) = delete;
+    ~MappedFile() {
+      if (data != MAP_FAILED) {
+        munmap(data, size);
+      }
+    }
+
+    const Header &header() const {
+      return *static_cast<const Header *>(data);
+    }
+
+    template<typename T>
+    const T *at(std::uint64_t offset) const {
+      return reinterpret_cast<const T *>(static_cast<const char *>(data) + offset);
+    }
+  };
+
+  // Writes checkpoints of one System, each after the first incremental to the one before.
+  class Series {
+    std::string last_path; // of the last checkpoint written or loaded
+    std::uint64_t last_id = 0;
+    std::unordered_map<unsigned int, std::uint64_t> page_hashes; // of memory at the last checkpoint
+
+    // Apply the pages of the checkpoint at path, and those of its parents before them.
+    void load_pages(const std::string &path, std::uint64_t id) {
+      MappedFile file(path);
+      auto &header = file.header();
+      if (header.id != id) {
+        throw std::runtime_error("Checkpoint " + path + " is not the parent it should be");
+      }
+      if (header.incremental) {
+        load_pages(std::string(header.parent, strnlen(header.parent, MAX_PATH)), header.parent_id);
+      }
+      auto numbers = file.at<std::uint32_t>(header.page_numbers_offset);
+      auto contents = file.at<unsigned char>(header.pages_offset);
+      for (std::uint64_t i = 0; i < header.page_count; i++) {
+        auto base = numbers[i] << PAGE_SHIFT;
+        for (unsigned int j = 0; j < PAGE_SIZE; j++) {
+          auto byte = contents[i * PAGE_SIZE + j];
+          if (byte != 0) {
+            memory::memory[base + j] = byte;
+          } else {
+            memory::memory.erase(base + j);
+          }
+        }
+      }
+    }
+
+  public:
+    // Save system to path: fully if it is the first checkpoint, otherwise the pages changed since the last one.
+    void save(System &system, const std::string &path) {
+      if (path.size() >= MAX_PATH) {
+        throw std::runtime_error("Checkpoint path too long: " + path);
+      }
+      dark::Archive archive;
+      system.cpu.transfer(archive);
+      auto &words = archive.words();
+      Counters counters{total_tick, arbiter_conflicts, csr::hart_counters, {}};
+      for (unsigned int core = 0; core < config.cores; core++) {
+        counters.statistics[core] = system.cores[core]->statistics;
+      }
+      auto pages = collect_pages();
+      std::vector<std::uint32_t> numbers;
+      std::unordered_map<unsigned int, std::uint64_t> hashes;
+      for (auto &[number, page]: pages) {
+        auto hash = hash_page(page);
+        hashes[number] = hash;
+        auto old = page_hashes.find(number);
+        if (last_path.empty() || old == page_hashes.end() || old->second != hash) {
+          numbers.push_back(number);
+        }
+      }
+      if (!last_path.empty()) { // pages that became all zero
+        for (auto [number, hash]: page_hashes) {
+          if (!pages.contains(number)) {
+            pages[number].fill(0);
+            numbers.push_back(number);
+          }
+        }
+      }
+      std::sort(numbers.begin(), numbers.end());
+
+      Header header{};
+      std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+      header.version = VERSION;
+      header.incremental = !last_path.empty();
+      header.id = last_id * 0x9e3779b97f4a7c15ull + static_cast<std::uint64_t>(total_tick) + 1;
+      header.parent_id = last_id;
+      std::strncpy(header.parent, last_path.c_str(), MAX_PATH - 1);
+      for (size_t i = 0; i < std::size(MACHINE_OPTIONS); i++) {
+        header.machine[i] = MACHINE_OPTIONS[i].value();
+      }
+      header.register_count = words.size();
+      header.register_offset = align(sizeof(Header), 64);
+      header.counters_size = sizeof(Counters);
+      header.counters_offset = align(header.register_offset + words.size() * sizeof(dark::max_size_t), 64);
+      header.page_count = numbers.size();
+      header.page_numbers_offset = align(header.counters_offset + sizeof(Counters), 64);
+      header.pages_offset = align(header.page_numbers_offset + numbers.size() * sizeof(std::uint32_t), PAGE_SIZE);
+
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      auto write_at = [&](std::uint64_t offset, const void *data, size_t size) {
+        static const char zeros[PAGE_SIZE]{};
+        for (auto pos = static_cast<std::uint64_t>(out.tellp()); pos < offset;) {
+          auto gap = std::min<std::uint64_t>(offset - pos, PAGE_SIZE);
+          out.write(zeros, static_cast<std::streamsize>(gap));
+          pos += gap;
+        }
+        out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+      };
+      write_at(0, &header, sizeof(header));
+      write_at(header.register_offset, words.data(), words.size() * sizeof(dark::max_size_t));
+      write_at(header.counters_offset, &counters, sizeof(counters));
+      write_at(header.page_numbers_offset, numbers.data(), numbers.size() * sizeof(std::uint32_t));
+      for (size_t i = 0; i < numbers.size(); i++) {
+        write_at(header.pages_offset + i * PAGE_SIZE, pages[numbers[i]].data(), PAGE_SIZE);
+      }
+      out.close();
+      if (!out) {
+        throw std::runtime_error("Cannot write checkpoint " + path);
+      }
+      last_path = path;
+      last_id = header.id;
+      page_hashes = std::move(hashes);
+    }
+
+    // Load system, freshly built, from the checkpoint at path. Checkpoints saved after it are incremental to it.
+    void load(System &system, const std::string &path) {
+      MappedFile file(path);
+      auto &header = file.header();
+      std::string differing;
+      for (size_t i = 0; i < std::size(MACHINE_OPTIONS); i++) {
+        if (header.machine[i] != MACHINE_OPTIONS[i].value()) {
+          differing += (differing.empty() ? "" : ", ") + std::string(MACHINE_OPTIONS[i].name);
+        }
+      }
+      if (!differing.empty()) {
+        throw std::runtime_error("Checkpoint " + path + " was saved with other " + differing + " options");
+      }
+      dark::Archive archive(file.at<dark::max_size_t>(header.register_offset), header.register_count);
+      system.cpu.transfer(archive);
+      if (!archive.exhausted() || header.counters_size != sizeof(Counters)) {
+        throw std::runtime_error("Checkpoint " + path + " was saved by a different build");
+      }
+      Counters counters;
+      std::memcpy(&counters, file.at<char>(header.counters_offset), sizeof(Counters));
+      total_tick = counters.total_tick;
+      arbiter_conflicts = counters.arbiter_conflicts;
+      csr::hart_counters = counters.hart_counters;
+      for (unsigned int core = 0; core < config.cores; core++) {
+        system.cores[core]->statistics = counters.statistics[core];
+      }
+      memory::memory.clear();
+      load_pages(path, header.id);
+      page_hashes.clear();
+      for (auto &[number, page]: collect_pages()) {
+        page_hashes[number] = hash_page(page);
+      }
+      last_path = path;
+      last_id = header.id;
+    }
+  };
+}
+
+#endif //RISC_V_CHECKPOINT_HPP
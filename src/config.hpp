@@ -0,0 +1,351 @@
+#ifndef RISC_V_CONFIG_HPP
+#define RISC_V_CONFIG_HPP
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "constants.hpp"
+
+// Which port wins when instruction fetch and load/store ask for memory in the same cycle.
+enum ArbiterPolicy {
+  FETCH_FIRST,
+  DATA_FIRST,
+  ROUND_ROBIN
+};
+
+// Which thread of a core renames in a cycle, when several have instructions waiting.
+enum FetchPolicy {
+  FETCH_ROUND_ROBIN,
+  FETCH_ICOUNT // the thread with the fewest instructions waiting to execute
+};
+
+// The pipeline of every core.
+enum CoreModel {
+  OUT_OF_ORDER_CORE, // see Processor
+  IN_ORDER_CORE // see InOrderPipeline
+};
+
+// How the in-order core guesses the next pc before a branch executes. The out-of-order core is always dynamic.
+enum BranchPrediction {
+  STATIC_PREDICTION, // at decode: backward branches and jal are taken
+  DYNAMIC_PREDICTION // at fetch, with BranchPredictor
+};
+
+// How explore::run prints its table.
+enum TableFormat {
+  CSV_TABLE,
+  JSON_TABLE
+};
+
+// Runtime parameters. Sizes of hardware structures are at most the maximums in constants.hpp they are built with.
+struct Config {
+  CoreModel core_model = OUT_OF_ORDER_CORE;
+  BranchPrediction branch_prediction = DYNAMIC_PREDICTION;
+  ArbiterPolicy arbiter_policy = ROUND_ROBIN;
+  bool print_statistics = false;
+  bool fusion = true; // merge common instruction pairs at decode, see instructions::fuse
+  bool trace_cache = true; // decoded traces in the front end, see TraceCache
+  bool elimination = true; // resolve moves and constants at rename, see instructions::eliminate
+  bool value_prediction = false; // let consumers of a load use its predicted value, see ValuePredictor
+  bool runahead = false; // keep executing past a load that missed in data cache, see ReorderBuffer
+  unsigned int threads = 0; // threads evaluating modules; 0 decides from the host, and falls back to one
+  unsigned int cores = 1; // cores sharing memory, each running the program from address 0
+  unsigned int smt = 1; // hardware threads of each core, each running the program from address 0
+  FetchPolicy fetch_policy = FETCH_ROUND_ROBIN;
+  bool shared_rob = false; // threads take entries of instruction buffer from one pool, instead of equal shares
+  unsigned int rob_entries = 16; // of instruction buffer, shared by the threads of a core, see ReorderBuffer
+  unsigned int rs_entries = 8; // of reservation station
+  unsigned int lsb_entries = 8; // of load/store buffer
+  unsigned int predictor_entries = 16; // direction counters of each branch predictor, a power of two
+  unsigned int btb_entries = 16; // of each branch target buffer, a power of two
+  unsigned int alus = 2; // of reservation station
+  unsigned int issue_width = 2; // instructions renamed per cycle
+  unsigned int commit_width = 2; // instructions retired per cycle
+  unsigned int multiply_latency = 3; // cycles from dispatch to result, pipelined
+  unsigned int divide_latency = 16; // cycles from dispatch to result, one at a time
+  unsigned int float_latency = 4; // floating-point instructions other than divide and square root, pipelined
+  unsigned int float_divide_latency = 12; // floating-point divide and square root, pipelined
+  unsigned int itlb_entries = 8; // of each thread, see InstructionTlb
+  unsigned int dtlb_entries = 16; // of each core, see DataTlb
+  unsigned int memory_latency = 5; // cycles of one memory access, one at a time
+  // the arbiter and memory run at memory_clock_numerator / memory_clock_denominator of the core clock,
+  // and memory_latency counts their cycles
+  unsigned int memory_clock_numerator = 1;
+  unsigned int memory_clock_denominator = 1;
+  bool sample = false; // estimate cycles from simulation points, see sampling::run
+  unsigned int sample_interval = 10000; // instructions in one interval
+  unsigned int simpoints = 10; // clusters of intervals
+  unsigned int samples_per_cluster = 2; // intervals simulated in each cluster, at least two to measure its variance
+  unsigned int warmup = 10000; // instructions simulated in detail before an interval is measured
+  unsigned int jobs = 0; // children of --sample or a sweep run at once; 0 for one per host thread
+  std::string checkpoint_path; // checkpoints are written to checkpoint_path.<cycle>, see checkpoint::Series
+  unsigned int checkpoint_every = 0; // cycles between checkpoints; 0 for none
+  std::string restore_path; // checkpoint to resume from
+  // sweep: run fork_at cycles once, then each variant from there in a child, see sweep::run
+  unsigned int fork_at = 0;
+  std::vector<std::string> variants; // comma-separated options each, without their leading dashes
+  // design-space exploration: every workload at every point of the grid, see explore::run
+  std::vector<std::string> workloads; // paths of .data files
+  std::vector<std::string> grid; // axes, each an option without its leading dashes and its values split by '|'
+  TableFormat table_format = CSV_TABLE;
+  std::string trace_path; // trace of the run to write, see trace::Writer
+  std::string replay_path; // trace to run on instead of a program, see replay::Feed
+};
+
+Config config;
+
+ArbiterPolicy parse_arbiter_policy(const std::string &value) {
+  if (value == "fetch-first") {
+    return FETCH_FIRST;
+  }
+  if (value == "lsu-first") {
+    return DATA_FIRST;
+  }
+  if (value == "round-robin") {
+    return ROUND_ROBIN;
+  }
+  throw std::invalid_argument("Invalid arbiter policy: " + value);
+}
+
+FetchPolicy parse_fetch_policy(const std::string &value) {
+  if (value == "round-robin") {
+    return FETCH_ROUND_ROBIN;
+  }
+  if (value == "icount") {
+    return FETCH_ICOUNT;
+  }
+  throw std::invalid_argument("Invalid fetch policy: " + value);
+}
+
+unsigned int parse_unsigned(const std::string &key, const std::string &value, unsigned int max, unsigned int min = 1) {
+  auto latency = std::stoul(value);
+  if (latency < min || latency > max) {
+    throw std::invalid_argument("Invalid " + key + ": " + value);
+  }
+  return latency;
+}
+
+// Sizes of tables indexed by the low bits of pc.
+unsigned int parse_power_of_two(const std::string &key, const std::string &value, unsigned int max) {
+  auto size = parse_unsigned(key, value, max);
+  if (size & (size - 1)) {
+    throw std::invalid_argument("Invalid " + key + ", not a power of two: " + value);
+  }
+  return size;
+}
+
+// Parse a clock ratio N/D, or N for N/1, which must be positive and at most 1.
+void parse_clock_ratio(const std::string &key, const std::string &value, unsigned int &numerator,
+                       unsigned int &denominator) {
+  auto slash = value.find('/');
+  try {
+    numerator = std::stoul(value.substr(0, slash));
+    denominator = slash == std::string::npos ? 1 : std::stoul(value.substr(slash + 1));
+  } catch (const std::logic_error &) {
+    throw std::invalid_argument("Invalid " + key + ": " + value);
+  }
+  if (numerator == 0 || numerator > denominator) {
+    throw std::invalid_argument("Invalid " + key + ": " + value);
+  }
+}
+
+// Set config from one option of the form --key=value.
+void apply_option(const std::string &arg) {
+  auto eq = arg.find('=');
+  std::string key = arg.substr(0, eq);
+  std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+  if (key == "--core") {
+    if (value != "out-of-order" && value != "in-order") {
+      throw std::invalid_argument("Invalid core: " + value);
+    }
+    config.core_model = value == "in-order" ? IN_ORDER_CORE : OUT_OF_ORDER_CORE;
+  } else if (key == "--branch-prediction") {
+    if (value != "static" && value != "dynamic") {
+      throw std::invalid_argument("Invalid branch prediction: " + value);
+    }
+    config.branch_prediction = value == "static" ? STATIC_PREDICTION : DYNAMIC_PREDICTION;
+  } else if (key == "--arbiter") {
+    config.arbiter_policy = parse_arbiter_policy(value);
+  } else if (key == "--cores") {
+    config.cores = parse_unsigned(key, value, MAX_CORES);
+  } else if (key == "--smt") {
+    config.smt = parse_unsigned(key, value, MAX_THREADS);
+  } else if (key == "--fetch-policy") {
+    config.fetch_policy = parse_fetch_policy(value);
+  } else if (key == "--rob") {
+    if (value != "shared" && value != "partitioned") {
+      throw std::invalid_argument("Invalid instruction buffer sharing: " + value);
+    }
+    config.shared_rob = value == "shared";
+  } else if (key == "--rob-entries") {
+    config.rob_entries = parse_unsigned(key, value, MAX_ROB_ENTRIES);
+  } else if (key == "--rs-entries") {
+    config.rs_entries = parse_unsigned(key, value, MAX_RS_ENTRIES);
+  } else if (key == "--lsb-entries") {
+    config.lsb_entries = parse_unsigned(key, value, MAX_LSB_ENTRIES);
+  } else if (key == "--predictor-entries") {
+    config.predictor_entries = parse_power_of_two(key, value, MAX_PREDICTOR_ENTRIES);
+  } else if (key == "--btb-entries") {
+    config.btb_entries = parse_power_of_two(key, value, MAX_BTB_ENTRIES);
+  } else if (key == "--alus") {
+    config.alus = parse_unsigned(key, value, MAX_ALUS);
+  } else if (key == "--issue-width") {
+    config.issue_width = parse_unsigned(key, value, MAX_ISSUE_WIDTH);
+  } else if (key == "--commit-width") {
+    config.commit_width = parse_unsigned(key, value, MAX_COMMIT_WIDTH);
+  } else if (key == "--threads") {
+    config.threads = std::stoul(value);
+  } else if (key == "--mul-latency") {
+    config.multiply_latency = parse_unsigned(key, value, MAX_MULTIPLY_LATENCY);
+  } else if (key == "--div-latency") {
+    config.divide_latency = parse_unsigned(key, value, MAX_DIVIDE_LATENCY);
+  } else if (key == "--fp-latency") {
+    config.float_latency = parse_unsigned(key, value, MAX_FLOAT_LATENCY);
+  } else if (key == "--fdiv-latency") {
+    config.float_divide_latency = parse_unsigned(key, value, MAX_FLOAT_LATENCY);
+  } else if (key == "--mem-latency") {
+    config.memory_latency = parse_unsigned(key, value, MAX_MEMORY_LATENCY, 2); // data is read one cycle before the end
+  } else if (key == "--itlb") {
+    config.itlb_entries = parse_unsigned(key, value, MAX_TLB_ENTRIES);
+  } else if (key == "--dtlb") {
+    config.dtlb_entries = parse_unsigned(key, value, MAX_TLB_ENTRIES);
+  } else if (key == "--memory-clock") {
+    parse_clock_ratio(key, value, config.memory_clock_numerator, config.memory_clock_denominator);
+  } else if (key == "--sample") {
+    config.sample = true;
+  } else if (key == "--sample-interval") {
+    config.sample_interval = parse_unsigned(key, value, MAX_SAMPLE_INTERVAL);
+  } else if (key == "--simpoints") {
+    config.simpoints = parse_unsigned(key, value, MAX_SIMPOINTS);
+  } else if (key == "--samples-per-cluster") {
+    config.samples_per_cluster = parse_unsigned(key, value, MAX_SIMPOINTS, 2);
+  } else if (key == "--warmup") {
+    config.warmup = parse_unsigned(key, value, MAX_SAMPLE_INTERVAL, 0);
+  } else if (key == "--jobs") {
+    config.jobs = parse_unsigned(key, value, MAX_SIMPOINTS, 0);
+  } else if (key == "--checkpoint") {
+    config.checkpoint_path = value;
+  } else if (key == "--checkpoint-every") {
+    config.checkpoint_every = parse_unsigned(key, value, MAX_CYCLE_COUNT);
+  } else if (key == "--restore") {
+    config.restore_path = value;
+  } else if (key == "--fork-at") {
+    config.fork_at = parse_unsigned(key, value, MAX_CYCLE_COUNT, 0);
+  } else if (key == "--variant") {
+    config.variants.push_back(value);
+  } else if (key == "--workload") {
+    config.workloads.push_back(value);
+  } else if (key == "--grid") {
+    config.grid.push_back(value);
+  } else if (key == "--format") {
+    if (value != "csv" && value != "json") {
+      throw std::invalid_argument("Invalid table format: " + value);
+    }
+    config.table_format = value == "json" ? JSON_TABLE : CSV_TABLE;
+  } else if (key == "--trace") {
+    config.trace_path = value;
+  } else if (key == "--replay") {
+    config.replay_path = value;
+  } else if (key == "--no-fusion") {
+    config.fusion = false;
+  } else if (key == "--no-trace-cache") {
+    config.trace_cache = false;
+  } else if (key == "--no-elimination") {
+    config.elimination = false;
+  } else if (key == "--value-prediction") {
+    config.value_prediction = true;
+  } else if (key == "--runahead") {
+    config.runahead = true;
+  } else if (key == "--stats") {
+    config.print_statistics = true;
+  } else {
+    throw std::invalid_argument("Unknown option: " + arg);
+  }
+}
+
+// Reject combinations of options the simulator does not support.
+void check_config() {
+  if (!config.shared_rob && config.rob_entries < config.smt) { // each thread needs an entry of its own
+    throw std::invalid_argument("--rob-entries must be at least --smt, unless --rob=shared");
+  }
+  if (config.runahead && config.smt > 1) { // the checkpoint and the prefetch queue serve one thread
+    throw std::invalid_argument("--runahead needs --smt=1");
+  }
+  if (config.core_model == IN_ORDER_CORE && (config.smt > 1 || config.runahead || config.value_prediction)) {
+    throw std::invalid_argument("--smt, --runahead and --value-prediction need the out-of-order core");
+  }
+  if (config.checkpoint_path.empty() != (config.checkpoint_every == 0)) {
+    throw std::invalid_argument("--checkpoint and --checkpoint-every go together");
+  }
+  if (config.sample && (!config.checkpoint_path.empty() || !config.restore_path.empty())) {
+    throw std::invalid_argument("--sample cannot be combined with checkpoints");
+  }
+  if (config.sample && (config.cores > 1 || config.smt > 1)) { // intervals are cut from the retired instructions of one hart
+    throw std::invalid_argument("--sample needs --cores=1 and --smt=1");
+  }
+  if (config.core_model == OUT_OF_ORDER_CORE && config.branch_prediction == STATIC_PREDICTION) {
+    throw std::invalid_argument("--branch-prediction=static needs --core=in-order");
+  }
+  if (config.workloads.empty() && !config.grid.empty()) {
+    throw std::invalid_argument("--grid needs --workload");
+  }
+  if (!config.workloads.empty() && (config.sample || !config.variants.empty() || !config.checkpoint_path.empty() ||
+                                    !config.restore_path.empty())) {
+    throw std::invalid_argument("--workload cannot be combined with --sample, --variant or checkpoints");
+  }
+  if (!config.variants.empty() && (config.sample || !config.checkpoint_path.empty() || config.threads > 1)) {
+    throw std::invalid_argument("--variant cannot be combined with --sample, --checkpoint or --threads");
+  }
+  if (!config.trace_path.empty() && (config.sample || !config.restore_path.empty() || !config.variants.empty() ||
+                                     !config.workloads.empty())) {
+    throw std::invalid_argument("--trace cannot be combined with --sample, --restore, --variant or --workload");
+  }
+  if (!config.replay_path.empty() && (config.sample || !config.trace_path.empty() || !config.variants.empty() ||
+                                      !config.workloads.empty() || !config.checkpoint_path.empty() ||
+                                      !config.restore_path.empty())) {
+    throw std::invalid_argument("--replay cannot be combined with --sample, --trace, --variant, --workload "
+                                "or checkpoints");
+  }
+}
+
+// Options a sweep variant may set: those that can change between two cycles of a running simulation.
+// Latencies of the pipelined units cannot, as results in their stages would be lost, nor can the sizes of buffers,
+// whose entries past a smaller size would be, nor anything that changes which modules are built. A checkpoint
+// records those other options, see checkpoint::MACHINE_OPTIONS.
+const std::vector<std::string> VARIANT_OPTIONS = {
+  "--mem-latency", "--div-latency", "--arbiter", "--fetch-policy", "--itlb", "--dtlb", "--no-fusion",
+  "--no-elimination", "--value-prediction", "--predictor-entries", "--btb-entries", "--alus", "--issue-width",
+  "--commit-width"
+};
+
+// Set config from the options of a sweep variant, separated by commas and written without their leading dashes.
+void apply_variant(const std::string &variant) {
+  size_t start = 0;
+  while (start < variant.size()) {
+    auto end = std::min(variant.find(',', start), variant.size());
+    auto option = "--" + variant.substr(start, end - start);
+    auto key = option.substr(0, option.find('='));
+    if (std::find(VARIANT_OPTIONS.begin(), VARIANT_OPTIONS.end(), key) == VARIANT_OPTIONS.end()) {
+      throw std::invalid_argument("Option cannot be set by a variant: " + option);
+    }
+    apply_option(option);
+    start = end + 1;
+  }
+  check_config();
+}
+
+// Parse options of the form --key=value. The program itself is still read from stdin.
+void parse_arguments(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    apply_option(argv[i]);
+  }
+  check_config();
+  for (auto &variant: config.variants) {
+    Config base = config;
+    apply_variant(variant);
+    config = base;
+  }
+}
+
+#endif //RISC_V_CONFIG_HPP
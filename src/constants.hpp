@@ -5,29 +5,158 @@
 #ifndef RISC_V_CONSTANT_HPP
 #define RISC_V_CONSTANT_HPP
 
+#include <array>
 #include "template/tools.h"
 
-constexpr unsigned int REGISTER_COUNT = 1 << 5;
-constexpr unsigned int INSTRUCTION_BUFFER_SIZE = 1 << 4;
-constexpr unsigned int PREDICTOR_HASH_SIZE = 1 << 4;
-using InstPos = Register<4>; // a position in instruction buffer.
-using InstPosWire = Wire<4>;
+constexpr unsigned int REGISTER_COUNT = 1 << 6; // x0-x31, then f0-f31
+constexpr unsigned int FLOAT_REGISTER_BASE = 32;
+constexpr unsigned int MAX_ROB_ENTRIES = 1 << 5; // entries instruction buffer is built with
+constexpr unsigned int MAX_PREDICTOR_ENTRIES = 1 << 8; // counters the branch predictor is built with
+constexpr unsigned int FETCH_BLOCK_WORDS = 4; // words returned by one instruction fetch from memory
+constexpr unsigned int FETCH_BLOCK_SIZE = FETCH_BLOCK_WORDS * 4;
+constexpr unsigned int FETCH_BLOCK_HALVES = FETCH_BLOCK_SIZE / 2; // most instructions starting in one block
+constexpr unsigned int FETCH_TARGET_QUEUE_SIZE = 1 << 2;
+constexpr unsigned int FETCH_BUFFER_SIZE = 1 << 4;
+constexpr unsigned int MAX_BTB_ENTRIES = 1 << 6; // entries the branch target buffer is built with
+constexpr unsigned int TRACE_LENGTH = 8; // instructions in one trace
+constexpr unsigned int TRACE_MAX_BRANCHES = 4; // conditional branches in one trace
+constexpr unsigned int TRACE_CACHE_SETS = 1 << 4;
+constexpr unsigned int TRACE_CACHE_WAYS = 2;
+constexpr unsigned int VALUE_PREDICTOR_SIZE = 1 << 4;
+constexpr unsigned int DATA_CACHE_LINES = 1 << 6; // direct-mapped, each line is one fetch block
+constexpr unsigned int PREFETCH_QUEUE_SIZE = 1 << 2; // lines runahead found missing, waiting for memory
+constexpr unsigned int MAX_RS_ENTRIES = 1 << 4; // entries reservation station is built with
+constexpr unsigned int MAX_LSB_ENTRIES = 1 << 4; // entries load/store buffer is built with
+constexpr unsigned int MAX_ISSUE_WIDTH = 4; // slots of the issue bundle; config.issue_width are renamed per cycle
+constexpr unsigned int MAX_COMMIT_WIDTH = 4; // slots of the commit bundle; config.commit_width are retired per cycle
+constexpr unsigned int MAX_ALUS = 4; // ALUs reservation station is built with, each with its result bus
+constexpr unsigned int LOAD_BUS = MAX_ALUS; // result buses after the ALU ones
+constexpr unsigned int MULTIPLY_BUS = MAX_ALUS + 1;
+constexpr unsigned int DIVIDE_BUS = MAX_ALUS + 2;
+constexpr unsigned int FLOAT_BUS = MAX_ALUS + 3;
+constexpr unsigned int FLOAT_DIVIDE_BUS = MAX_ALUS + 4;
+constexpr unsigned int RESULT_BUS_COUNT = MAX_ALUS + 5;
+constexpr unsigned int MAX_MULTIPLY_LATENCY = 8; // stages the multiplier is built with
+constexpr unsigned int MAX_DIVIDE_LATENCY = 63;
+constexpr unsigned int MAX_FLOAT_LATENCY = 16; // stages each floating-point unit is built with
+constexpr unsigned int MAX_MEMORY_LATENCY = 1 << 10;
+constexpr unsigned int MAX_TLB_ENTRIES = 1 << 5; // each TLB is built with this many, config sets how many are used
+constexpr unsigned int MAX_CORES = 4; // cores sharing memory
+constexpr unsigned int MAX_THREADS = 4; // hardware threads sharing the back end of one core
+constexpr unsigned int MAX_SAMPLE_INTERVAL = 1 << 30; // instructions
+constexpr unsigned int MAX_SIMPOINTS = 1 << 10;
+constexpr unsigned int MAX_CYCLE_COUNT = 1 << 30; // of options that count cycles
+using InstPos = Register<5>; // a position in instruction buffer.
+using InstPosWire = Wire<5>;
+using StationCount = Register<5>; // number of entries in reservation station or load/store buffer
+using StationCountWire = Wire<5>;
+using DivideCountdown = Register<6>;
+using ExecuteCycles = Register<6>; // cycles an instruction of the in-order core has spent in execute
+using LoadStorePos = Register<5>; // one bit wider than a position in load/store buffer
+using FetchTargetPos = Register<2>; // a position in fetch target queue.
+using FetchBufferPos = Register<5>; // one bit wider than a position in fetch buffer, to tell full from empty.
+using FetchBufferPosWire = Wire<5>;
+using PrefetchPos = Register<3>; // one bit wider than a position in prefetch queue
+using TracePos = Register<5>; // an entry in trace cache.
+using TraceLength = Register<4>;
+using TraceBranches = Register<3>;
+using TracePath = Register<TRACE_MAX_BRANCHES>; // bit i is the direction of the i-th conditional branch
 using OpCode = Register<7>;
 using Data = Register<32>; // data or memory address
 using DataWire = Wire<32>;
-using RegPos = Register<5>;
+using RegPos = Register<6>;
+using RegPosWire = Wire<6>;
 using Flag = Register<1>;
 using FlagWire = Wire<1>;
 using Return = Register<8>;
+using OrderPos = Register<6>; // one bit wider than a position in the program order of a thread, see ReorderBuffer
+using TlbPos = Register<5>; // an entry of a TLB
+using VirtualPageNumber = Register<20>;
+using PhysicalPageNumber = Register<22>;
+using PageFlags = Register<4>; // V, R, W and X of a page table entry
+using PortIndex = Register<5>; // a memory port of the arbiter, see MemoryArbiter
+using CoreIndex = Register<2>;
+using ThreadIndex = Register<2>;
+using ThreadIndexWire = Wire<2>;
+using ThreadMask = Register<MAX_THREADS>; // bit i is thread i
+using ThreadMaskWire = Wire<MAX_THREADS>;
+using AtomicCode = Register<4>; // a memory::AtomicOperation
+using AtomicCodeWire = Wire<4>;
 using PredictorStatusCode = Register<2>;
+using Confidence = Register<3>;
 using MemoryAccessModeCode = Register<3>;
+using RoundingMode = Register<3>;
+using RoundingModeWire = Wire<3>;
+using FloatFlags = Register<5>; // accrued exceptions of floating-point instructions, as in fflags
+using FloatFlagsWire = Wire<5>;
 using MemoryAccessModeWire = Wire<3>;
 using Byte = Bit<8>;
 using HalfWord = Bit<16>;
 using Word = Bit<32>;
-int total_predict;
-int correct_predict;
 int total_tick;
-int total_committed;
+int arbiter_conflicts; // cycles in which more than one port asked for idle memory
+
+// Counters of the front end of one thread.
+struct FrontEndStatistics {
+  int frontend_redirects; // predict stage redirected by decode
+  int fetched_instructions; // instructions delivered into fetch buffer
+  int delivery_cycles; // cycles in which the front end delivered at least one instruction
+  int trace_lookups;
+  int trace_hits;
+  int trace_instructions; // instructions delivered from trace cache
+  int tlb_misses; // written by the instruction TLB of the thread, see InstructionTlb
+  int tlb_walk_cycles;
+  int page_faults;
+};
+
+// Counters of one core. Each is written by one module of the core; memory grants, waits and failed store conditionals
+// by the arbiter.
+struct Statistics {
+  int total_predict;
+  int correct_predict;
+  int total_committed;
+  int fetch_grants; // memory accesses granted to instruction fetch
+  int data_grants; // memory accesses granted to load/store
+  int fetch_wait_cycles; // cycles instruction fetch waited for memory
+  int data_wait_cycles; // cycles load/store waited for memory
+  std::array<FrontEndStatistics, MAX_THREADS> front_ends; // of each thread, written by its fetch unit
+  std::array<int, MAX_THREADS> thread_committed; // instructions retired by each thread
+  int fetch_buffer_empty_cycles; // cycles the back end found no instruction to issue
+  int issued_instructions;
+  int issue_stall_rob; // cycles issue stopped because instruction buffer was full
+  int issue_stall_rs; // ... because reservation station was full
+  int issue_stall_lsb; // ... because load/store buffer was full
+  int multiply_operations;
+  int divide_operations;
+  int divider_busy_cycles; // cycles a divide was ready but the divider was busy
+  int float_operations; // instructions executed by the floating-point unit
+  int float_divide_operations; // ... by the floating-point divide and square root unit
+  int fused_lui_addi; // fused pairs committed, by idiom
+  int fused_auipc_jalr;
+  int fused_slli_add;
+  int fused_slli_srli;
+  int eliminated_moves; // instructions resolved at rename, by idiom
+  int eliminated_constants;
+  int eliminated_zeros;
+  int committed_loads;
+  int predicted_loads; // committed loads whose value was predicted
+  int value_mispredicts;
+  int data_cache_hits; // loads answered by data cache
+  int data_cache_misses; // loads that waited for a line fill
+  int prefetches; // line fills asked for by runahead
+  int useful_prefetches; // prefetched lines a load hit before they were replaced
+  int runahead_periods;
+  int runahead_cycles;
+  int runahead_instructions; // instructions retired in runahead, and thrown away
+  int atomic_operations; // instructions of the A extension committed
+  int failed_store_conditionals;
+  int snoop_invalidations; // lines dropped because another core wrote them
+  int load_use_stalls; // cycles the in-order core held an instruction in execute for the load it depends on
+  int memory_stalls; // cycles the in-order core waited for data cache
+  int execute_stalls; // cycles the in-order core waited for a multi-cycle operation
+  int dtlb_misses; // loads and stores that walked the page table, see DataTlb
+  int dtlb_walk_cycles;
+  int data_page_faults;
+};
 
 #endif //RISC_V_CONSTANT_HPP
@@ -0,0 +1,88 @@
+#ifndef RISC_V_CORE_HPP
+#define RISC_V_CORE_HPP
+
+#include <memory>
+#include <vector>
+#include "data_cache.hpp"
+#include "tlb.hpp"
+#include "functional.hpp"
+#include "template/cpu.h"
+
+// The memory port of the front end of one hardware thread.
+struct FetchPort {
+  FlagWire &finished;
+  std::array<DataWire, FETCH_BLOCK_WORDS> &block;
+  Flag &request;
+  Data &addr; // aligned to FETCH_BLOCK_SIZE
+};
+
+// What main and the arbiter see of a core, whichever pipeline it has: an instruction TLB for each hardware thread,
+// in front of its fetch port, and a data cache for loads and stores, behind the data TLB.
+// Wires inside the core are connected by its constructor; the pipeline sends its loads and stores to data_tlb.
+struct Core {
+  Statistics statistics{};
+  std::vector<std::unique_ptr<InstructionTlb>> instruction_tlbs; // of each thread
+  DataTlb data_tlb{statistics};
+  DataCache data_cache{statistics};
+
+  Core() {
+    for (unsigned int thread = 0; thread < config.smt; thread++) {
+      instruction_tlbs.push_back(std::make_unique<InstructionTlb>(statistics.front_ends[thread]));
+    }
+  }
+  Core(const Core &) = delete; // wires refer to the members
+  virtual ~Core() = default;
+
+  virtual FetchPort fetch_port(unsigned int thread) = 0;
+  // Whether thread is flushing, which cancels its instruction fetch.
+  virtual bool flushing(unsigned int thread) = 0;
+  // The thread the access of data cache belongs to.
+  virtual unsigned int data_thread() = 0;
+  // Whether the first thread has halted, and the value it returns.
+  virtual bool halted() = 0;
+  virtual unsigned int return_value() = 0;
+  virtual unsigned int satp(unsigned int thread) = 0;
+  virtual void add_to(dark::CPU &cpu) = 0;
+  // Make the first thread continue from state instead of the reset state. Called before the first cycle;
+  // caches, TLBs and predictors stay cold.
+  virtual void start_at(const ArchState &state) = 0;
+
+  // Put the TLBs between the fetch ports and data cache. Called by the constructor of the core, once its ports exist.
+  void connect_tlbs() {
+    for (unsigned int thread = 0; thread < config.smt; thread++) {
+      FetchPort port = fetch_port(thread);
+      InstructionTlb &tlb = *instruction_tlbs[thread];
+      tlb.request.follow(port.request);
+      tlb.addr.follow(port.addr);
+      tlb.flushing = [&, thread]() { return flushing(thread); };
+      tlb.satp = [&, thread]() { return satp(thread); };
+      port.finished = [&]() { return tlb.fetch_finished(); };
+      for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+        port.block[i] = [&, i]() { return tlb.fetch_word(i); };
+      }
+    }
+    data_tlb.satp = [&]() { return satp(data_thread()); };
+    data_tlb.cache_load_finished.follow(data_cache.load_finished);
+    data_tlb.cache_store_finished.follow(data_cache.store_finished);
+    data_tlb.cache_data.follow(data_cache.data);
+    data_tlb.cache_poisoned.follow(data_cache.poisoned);
+    data_cache.load = [&]() { return data_tlb.forward_load(); };
+    data_cache.store = [&]() { return data_tlb.forward_store(); };
+    data_cache.addr = [&]() { return data_tlb.forward_addr(); };
+    data_cache.mode = [&]() { return data_tlb.forward_mode(); };
+    data_cache.atomic = [&]() { return data_tlb.forward_atomic(); };
+    data_cache.store_data = [&]() { return data_tlb.forward_store_data(); };
+    data_cache.flushing = [&]() { return data_tlb.forward_flushing(); };
+    data_cache.runahead = [&]() { return data_tlb.forward_runahead(); };
+  }
+
+  void add_memory_modules(dark::CPU &cpu) {
+    for (auto &tlb: instruction_tlbs) {
+      cpu.add_module(tlb.get());
+    }
+    cpu.add_module(&data_tlb);
+    cpu.add_module(&data_cache);
+  }
+};
+
+#endif //RISC_V_CORE_HPP
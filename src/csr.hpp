@@ -0,0 +1,95 @@
+#ifndef RISC_V_CSR_HPP
+#define RISC_V_CSR_HPP
+
+#include <array>
+#include "constants.hpp"
+
+// Control and status registers the guest can read with Zicsr instructions.
+// The counters of each hart live here. They are read-only: with no traps to raise, writes are ignored.
+// The floating-point csrs, satp and mhartid are kept by the core.
+namespace csr {
+  constexpr unsigned int FFLAGS = 0x001;
+  constexpr unsigned int FRM = 0x002;
+  constexpr unsigned int FCSR = 0x003;
+  constexpr unsigned int SATP = 0x180; // Sv32 translation of every access, see TranslationBuffer
+  constexpr unsigned int CYCLE = 0xc00;
+  constexpr unsigned int TIME = 0xc01; // no wall clock: counts cycles like cycle
+  constexpr unsigned int INSTRET = 0xc02;
+  constexpr unsigned int HPMCOUNTER3 = 0xc03; // hpmcounter3 ... hpmcounter31 follow
+  constexpr unsigned int HIGH_HALF = 0x80; // cycleh = cycle + HIGH_HALF, and so on
+  constexpr unsigned int MACHINE_COUNTERS = 0xb00; // mcycle, minstret and mhpmcounterN alias the counters above
+  constexpr unsigned int MHARTID = 0xf14; // the index of the hardware thread, answered by the reorder buffer
+
+  enum Counter {
+    CYCLES,
+    INSTRUCTIONS_RETIRED,
+    BRANCHES, // hpmcounter3: conditional branches committed
+    MISPREDICTS, // hpmcounter4
+    DATA_WAIT_CYCLES, // hpmcounter5: cycles load/store waited for memory
+    FETCH_WAIT_CYCLES, // hpmcounter6: cycles instruction fetch waited for memory
+    FETCH_BUFFER_EMPTY_CYCLES, // hpmcounter7
+    ISSUE_STALL_CYCLES, // hpmcounter8: cycles issue stopped on a full buffer
+    COUNTER_COUNT
+  };
+
+  // Counter values of each hart at the end of last cycle. They are sampled between cycles,
+  // so a module reads the same values however the modules of a cycle are ordered.
+  // Harts are numbered core by core, and the threads of a core share its counters other than instret.
+  // The counters are 64 bits wide, and the *h csrs read their upper halves; see advance.
+  using Counters = std::array<unsigned long long, COUNTER_COUNT>;
+  std::array<Counters, MAX_CORES * MAX_THREADS> hart_counters;
+
+  // Move counter on to value, a 32-bit count that wraps. Samples are taken every cycle,
+  // so no count grows by 2^32 between two of them, and counter carries into its upper half.
+  void advance(unsigned long long &counter, unsigned int value) {
+    counter += value - static_cast<unsigned int>(counter);
+  }
+
+  void sample_counters(unsigned int hart, const Statistics &statistics, unsigned int thread) {
+    auto &counters = hart_counters[hart];
+    advance(counters[CYCLES], static_cast<unsigned int>(total_tick));
+    advance(counters[INSTRUCTIONS_RETIRED], static_cast<unsigned int>(statistics.thread_committed[thread]));
+    advance(counters[BRANCHES], static_cast<unsigned int>(statistics.total_predict));
+    advance(counters[MISPREDICTS], static_cast<unsigned int>(statistics.total_predict) -
+                                   static_cast<unsigned int>(statistics.correct_predict));
+    advance(counters[DATA_WAIT_CYCLES], static_cast<unsigned int>(statistics.data_wait_cycles));
+    advance(counters[FETCH_WAIT_CYCLES], static_cast<unsigned int>(statistics.fetch_wait_cycles));
+    advance(counters[FETCH_BUFFER_EMPTY_CYCLES], static_cast<unsigned int>(statistics.fetch_buffer_empty_cycles));
+    advance(counters[ISSUE_STALL_CYCLES], static_cast<unsigned int>(statistics.issue_stall_rob) +
+                                          static_cast<unsigned int>(statistics.issue_stall_rs) +
+                                          static_cast<unsigned int>(statistics.issue_stall_lsb));
+  }
+
+  unsigned long long read_counter(const Counters &counters, unsigned int index) {
+    switch (index) {
+      case CYCLE - CYCLE:
+      case TIME - CYCLE:
+        return counters[CYCLES];
+      case INSTRET - CYCLE:
+        return counters[INSTRUCTIONS_RETIRED];
+      default:
+        index -= HPMCOUNTER3 - CYCLE;
+        return index + BRANCHES < COUNTER_COUNT ? counters[index + BRANCHES] : 0;
+    }
+  }
+
+  // Value of the csr at address, given the counters of its hart. Unknown csrs read as 0.
+  unsigned int read_csr(const Counters &counters, unsigned int address) {
+    address &= 0xfff;
+    if (address >= MACHINE_COUNTERS && address < MACHINE_COUNTERS + 0x100) {
+      address += CYCLE - MACHINE_COUNTERS;
+    }
+    if (address < CYCLE || address >= CYCLE + 0x100 || (address & (HIGH_HALF - 1)) >= 0x20) {
+      return 0;
+    }
+    auto value = read_counter(counters, address & (HIGH_HALF - 1));
+    return static_cast<unsigned int>(address & HIGH_HALF ? value >> 32 : value);
+  }
+
+  // Value of the csr at address for hart. Unknown csrs read as 0.
+  unsigned int read_csr(unsigned int hart, unsigned int address) {
+    return read_csr(hart_counters[hart], address);
+  }
+}
+
+#endif //RISC_V_CSR_HPP
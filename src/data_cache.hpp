@@ -0,0 +1,295 @@
+#ifndef RISC_V_DATA_CACHE_HPP
+#define RISC_V_DATA_CACHE_HPP
+
+#include "bundles.hpp"
+#include "memory.hpp"
+
+struct DataCacheInput {
+  FlagWire load; // from load/store buffer, held until answered
+  FlagWire store;
+  DataWire addr;
+  MemoryAccessModeWire mode;
+  AtomicCodeWire atomic; // the load is a memory::AtomicOperation
+  DataWire store_data;
+  FlagWire flushing; // the thread of the request is flushing
+  FlagWire runahead;
+  FlagWire memory_load_finished;
+  FlagWire memory_store_finished;
+  DataWire memory_data;
+  std::array<DataWire, FETCH_BLOCK_WORDS> memory_block;
+  FlagWire snooped; // another core started to write snoop_addr
+  DataWire snoop_addr;
+};
+
+struct DataCacheOutput {
+  Flag load_finished; // to load/store buffer
+  Flag store_finished;
+  Data data;
+  Flag poisoned; // in runahead, the load missed and data is not its value
+  Flag missing; // a load is waiting for its line to be filled
+  Flag memory_load; // to memory, through the arbiter, held until finished
+  Flag memory_store;
+  Flag memory_fill; // the load reads the whole line
+  Data memory_addr;
+  MemoryAccessModeCode memory_mode;
+  AtomicCode memory_atomic;
+  Data memory_store_data;
+};
+
+struct CacheLine {
+  Flag valid;
+  Data addr; // of the first byte
+  std::array<Data, FETCH_BLOCK_WORDS> words;
+  Flag prefetched; // filled for runahead, and not read by a load yet
+};
+
+struct DataCacheData {
+  std::array<CacheLine, DATA_CACHE_LINES> lines;
+  std::array<Data, PREFETCH_QUEUE_SIZE> prefetch_queue; // addresses of lines to fill when memory is free
+  PrefetchPos queue_head, queue_tail;
+  Flag pending; // the access in memory answers the request of load/store buffer
+  Flag prefetching; // the fill in memory was asked for by runahead
+};
+
+// Direct-mapped, write-through and no-write-allocate. A line is one fetch block, filled with one block read.
+// A load hit is answered in the cycle after the request; a miss fills its line first.
+// An access that crosses a line goes to memory as it is: a load is not cached, and a store drops the lines it touches.
+// A fill is not speculative, so it goes on when the load that asked for it is flushed.
+// In runahead a miss does not wait: the load is answered poisoned, and its line is queued to be prefetched
+// once memory is free. The load that started runahead is answered poisoned too, and its fill goes on.
+// An atomic always goes to memory, which does it on the shared copy; one that may write drops the line here.
+// A line another core writes is dropped too, see MemoryArbiter.
+struct DataCache : dark::Module<DataCacheInput, DataCacheOutput, DataCacheData> {
+  Statistics &statistics; // of the core
+
+  explicit DataCache(Statistics &statistics) : statistics(statistics) {}
+
+  using Words = std::array<unsigned int, FETCH_BLOCK_WORDS>;
+
+  static unsigned int size_of(memory::MemoryAccessMode mode) {
+    return mode == memory::WORD ? 4 : mode == memory::BYTE || mode == memory::BYTE_UNSIGNED ? 1 : 2;
+  }
+
+  static unsigned int line_of(unsigned int addr) {
+    return addr & ~(FETCH_BLOCK_SIZE - 1);
+  }
+
+  static unsigned int index_of(unsigned int addr) {
+    return addr / FETCH_BLOCK_SIZE & (DATA_CACHE_LINES - 1);
+  }
+
+  static bool in_one_line(unsigned int addr, memory::MemoryAccessMode mode) {
+    return addr % FETCH_BLOCK_SIZE + size_of(mode) <= FETCH_BLOCK_SIZE;
+  }
+
+  // Read a value out of the words of a line, extended as memory::load_data does.
+  static unsigned int extract(const Words &words, unsigned int addr, memory::MemoryAccessMode mode) {
+    auto offset = addr % FETCH_BLOCK_SIZE;
+    unsigned int value = 0;
+    for (auto i = size_of(mode); i-- > 0;) {
+      value = value << 8 | (words[(offset + i) / 4] >> (offset + i) % 4 * 8 & 0xff);
+    }
+    if (mode == memory::BYTE) {
+      return static_cast<unsigned int>(static_cast<signed char>(value));
+    }
+    if (mode == memory::HALF_WORD) {
+      return static_cast<unsigned int>(static_cast<short>(value));
+    }
+    return value;
+  }
+
+  bool hit(unsigned int addr) {
+    const CacheLine &line = lines[index_of(addr)];
+    return line.valid == true && line.addr == line_of(addr);
+  }
+
+  Words words_of(const CacheLine &line) {
+    Words words;
+    for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+      words[i] = to_unsigned(line.words[i]);
+    }
+    return words;
+  }
+
+  // Whether another core is writing the line of addr. The size of the write is not known, so a word is assumed.
+  bool snooping(unsigned int addr) {
+    auto first = to_unsigned(snoop_addr);
+    return snooped == true && (line_of(first) == line_of(addr) || line_of(first + 3) == line_of(addr));
+  }
+
+  // Drop the lines another core is writing.
+  void snoop() {
+    auto first = to_unsigned(snoop_addr);
+    for (auto byte: {first, first + 3}) {
+      if (snooped == true && hit(byte) && (byte == first || line_of(byte) != line_of(first))) {
+        lines[index_of(byte)].valid.assign(false);
+        statistics.snoop_invalidations++;
+      }
+    }
+  }
+
+  // Drop the line holding addr, unless a snoop drops it in this cycle.
+  void invalidate(unsigned int addr) {
+    if (hit(addr) && !snooping(addr)) {
+      lines[index_of(addr)].valid.assign(false);
+    }
+  }
+
+  void write(unsigned int addr, unsigned int value, memory::MemoryAccessMode mode) {
+    if (!in_one_line(addr, mode)) {
+      for (auto byte: {addr, addr + size_of(mode) - 1}) {
+        invalidate(byte);
+      }
+      return;
+    }
+    if (!hit(addr)) {
+      return;
+    }
+    CacheLine &line = lines[index_of(addr)];
+    auto words = words_of(line);
+    auto offset = addr % FETCH_BLOCK_SIZE;
+    for (unsigned int i = 0; i < size_of(mode); i++) {
+      auto shift = (offset + i) % 4 * 8;
+      unsigned int &word = words[(offset + i) / 4];
+      word = (word & ~(0xffu << shift)) | (value >> i * 8 & 0xff) << shift;
+    }
+    for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+      line.words[i].assign(words[i]);
+    }
+  }
+
+  void access(bool load, bool fill, unsigned int addr, unsigned int mode, unsigned int atomic_op = memory::NOT_ATOMIC) {
+    (load ? memory_load : memory_store).assign(true);
+    memory_fill.assign(fill);
+    memory_addr.assign(addr);
+    memory_mode.assign(mode);
+    memory_atomic.assign(atomic_op);
+  }
+
+  void queue_prefetch(unsigned int line) {
+    if ((to_unsigned(queue_tail) - to_unsigned(queue_head)) % (PREFETCH_QUEUE_SIZE * 2) == PREFETCH_QUEUE_SIZE ||
+        (memory_load == true && memory_fill == true && memory_addr == line)) {
+      return;
+    }
+    for (auto pos = to_unsigned(queue_head); pos != queue_tail; pos = (pos + 1) % (PREFETCH_QUEUE_SIZE * 2)) {
+      if (prefetch_queue[pos % PREFETCH_QUEUE_SIZE] == line) {
+        return;
+      }
+    }
+    prefetch_queue[to_unsigned(queue_tail) % PREFETCH_QUEUE_SIZE].assign(line);
+    queue_tail.assign((to_unsigned(queue_tail) + 1) % (PREFETCH_QUEUE_SIZE * 2));
+  }
+
+  // Start a fill for the oldest queued line, skipping one that is already here. Return whether memory is used.
+  bool prefetch() {
+    if (queue_head == queue_tail) {
+      return false;
+    }
+    auto line = to_unsigned(prefetch_queue[to_unsigned(queue_head) % PREFETCH_QUEUE_SIZE]);
+    queue_head.assign((to_unsigned(queue_head) + 1) % (PREFETCH_QUEUE_SIZE * 2));
+    if (hit(line)) {
+      return false;
+    }
+    access(true, true, line, memory::WORD);
+    statistics.prefetches++;
+    return true;
+  }
+
+  void work() override {
+    bool answered = false, answer_poisoned = false, store_answered = false, started = false;
+    unsigned int answer = 0;
+    bool next_pending = static_cast<bool>(pending), next_prefetching = static_cast<bool>(prefetching);
+    auto request_mode = static_cast<memory::MemoryAccessMode>(to_unsigned(mode));
+    snoop();
+    if (memory_load_finished == true) {
+      Words block;
+      for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+        block[i] = to_unsigned(memory_block[i]);
+      }
+      if (memory_fill == true) {
+        CacheLine &line = lines[index_of(to_unsigned(memory_addr))];
+        line.valid.assign(true);
+        line.addr.assign(memory_addr);
+        for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+          line.words[i].assign(block[i]);
+        }
+        line.prefetched.assign(prefetching);
+      }
+      if (pending == true && flushing == false) {
+        answered = true;
+        answer = memory_fill == true ? extract(block, to_unsigned(addr), request_mode) : to_unsigned(memory_data);
+      }
+      memory_load.assign(false);
+      missing.assign(false);
+      next_pending = next_prefetching = false;
+    } else if (memory_store_finished == true) {
+      store_answered = pending == true && flushing == false;
+      memory_store.assign(false);
+      next_pending = false;
+    } else if (flushing == true) {
+      next_pending = false;
+    } else if (pending == true) {
+      if (runahead == true && memory_load == true) { // the load runahead is waiting for
+        answered = answer_poisoned = true;
+        next_pending = false;
+      }
+    } else if (load_finished == false && store_finished == false) { // the last request is no longer held
+      bool memory_free = memory_load == false && memory_store == false;
+      auto request_addr = to_unsigned(addr);
+      bool cached = in_one_line(request_addr, request_mode);
+      if (load == true && atomic != memory::NOT_ATOMIC) {
+        if (memory_free) {
+          if (atomic != memory::LOAD_RESERVED) {
+            invalidate(request_addr);
+          }
+          access(true, false, request_addr, request_mode, to_unsigned(atomic));
+          memory_store_data.assign(store_data);
+          next_pending = started = true;
+          next_prefetching = false;
+        }
+      } else if (load == true) {
+        if (cached && hit(request_addr)) {
+          CacheLine &line = lines[index_of(request_addr)];
+          answered = true;
+          answer = extract(words_of(line), request_addr, request_mode);
+          if (runahead == false) {
+            statistics.data_cache_hits++;
+            if (line.prefetched == true) {
+              statistics.useful_prefetches++;
+              line.prefetched.assign(false);
+            }
+          }
+        } else if (runahead == true) {
+          answered = answer_poisoned = true;
+          if (cached) {
+            queue_prefetch(line_of(request_addr));
+          }
+        } else if (memory_free) {
+          access(true, cached, cached ? line_of(request_addr) : request_addr, request_mode);
+          missing.assign(true);
+          next_pending = started = true;
+          next_prefetching = false;
+          statistics.data_cache_misses++;
+        }
+      } else if (store == true && memory_free) {
+        write(request_addr, to_unsigned(store_data), request_mode);
+        access(false, false, request_addr, request_mode);
+        memory_store_data.assign(store_data);
+        next_pending = started = true;
+      }
+      if (memory_free && !started && prefetch()) {
+        next_prefetching = true;
+      }
+    }
+    load_finished.assign(answered);
+    store_finished.assign(store_answered);
+    if (answered) {
+      data.assign(answer_poisoned ? 0 : answer);
+      poisoned.assign(answer_poisoned);
+    }
+    pending.assign(next_pending);
+    prefetching.assign(next_prefetching);
+  }
+};
+
+#endif //RISC_V_DATA_CACHE_HPP
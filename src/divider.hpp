@@ -0,0 +1,60 @@
+#ifndef RISC_V_DIVIDER_HPP
+#define RISC_V_DIVIDER_HPP
+
+#include "alu.hpp"
+#include "bundles.hpp"
+#include "config.hpp"
+
+struct DividerInput {
+  UnitRequestWire request;
+  ThreadMaskWire flushing;
+};
+
+struct DividerOutput {
+  ResultBus bus;
+  Flag busy; // a request sent in this cycle would arrive before the divider is free
+};
+
+struct DividerData {
+  InstPos tag;
+  ThreadIndex thread;
+  Data value;
+  DivideCountdown remaining; // cycles until the result is broadcast; 0 when idle
+};
+
+// An iterative divider. It works on one instruction at a time, and its result is
+// broadcast config.divide_latency cycles after the request arrives.
+// The quotient is computed at once; the latency only models the iterations.
+// A flush of the thread of the instruction drops it.
+struct Divider : dark::Module<DividerInput, DividerOutput, DividerData> {
+  Statistics &statistics; // of the core
+
+  explicit Divider(Statistics &statistics) : statistics(statistics) {}
+
+  void work() override {
+    bool dropped = flushes(flushing, to_unsigned(thread));
+    bool accepted = request.valid == true && !flushes(flushing, to_unsigned(request.thread));
+    unsigned int next = remaining > 0 && !dropped ? to_unsigned(remaining) - 1 : 0;
+    bool finishing = remaining == 1 && !dropped;
+    bool immediate = accepted && config.divide_latency == 1;
+    unsigned int result = 0;
+    if (accepted) {
+      auto op = static_cast<Op>(to_unsigned(request.opcode));
+      result = execute_multiply_divide(op, to_signed(request.rs1), to_signed(request.rs2));
+      statistics.divide_operations++;
+      if (!immediate) {
+        tag.assign(request.tag);
+        thread.assign(request.thread);
+        value.assign(result);
+        next = config.divide_latency - 1;
+      }
+    }
+    bus.valid.assign(finishing || immediate);
+    bus.tag.assign(finishing ? to_unsigned(tag) : to_unsigned(request.tag));
+    bus.value.assign(finishing ? to_unsigned(value) : result);
+    remaining.assign(next);
+    busy.assign(next > 2); // the reservation station sees busy one cycle late, and its request takes another
+  }
+};
+
+#endif //RISC_V_DIVIDER_HPP
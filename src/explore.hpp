@@ -0,0 +1,258 @@
+#ifndef RISC_V_EXPLORE_HPP
+#define RISC_V_EXPLORE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "fork_pool.hpp"
+#include "system.hpp"
+
+// Design-space exploration over runtime parameters: every workload runs at every point of the cross product of
+// config.grid, each in its own forked child, and one table row per run is printed to stdout. A run whose child
+// fails gets a row with its error and no counters, and the others are printed all the same.
+// An axis is an option with its values split by '|', as in mem-latency=5|10|20, or a flag such as no-fusion,
+// which is tried without and with. Sizes of hardware structures, as in rob-entries=8|16|32, go up to the maximums
+// in constants.hpp.
+namespace explore {
+  struct Axis {
+    std::string key; // the option, without its leading dashes
+    std::vector<std::string> values; // for a flag, "0" without it and "1" with it
+    bool flag;
+  };
+
+  // One run: a workload at a point of the grid, given as the index of the value of each axis.
+  struct Run {
+    std::string workload;
+    std::vector<unsigned int> point;
+    RunResult result{};
+    std::string error{}; // why the child failed; empty if it did not
+  };
+
+  std::vector<Axis> parse_grid() {
+    std::vector<Axis> axes;
+    for (auto &axis: config.grid) {
+      auto eq = axis.find('=');
+      if (eq == std::string::npos) {
+        axes.push_back({axis, {"0", "1"}, true});
+        continue;
+      }
+      Axis parsed{axis.substr(0, eq), {}, false};
+      for (size_t start = eq + 1; start <= axis.size();) {
+        auto end = std::min(axis.find('|', start), axis.size());
+        parsed.values.push_back(axis.substr(start, end - start));
+        start = end + 1;
+      }
+      axes.push_back(parsed);
+    }
+    return axes;
+  }
+
+  // Set config to the base options with those of point applied.
+  void apply_point(const std::vector<Axis> &axes, const std::vector<unsigned int> &point) {
+    for (size_t i = 0; i < axes.size(); i++) {
+      if (!axes[i].flag) {
+        apply_option("--" + axes[i].key + "=" + axes[i].values[point[i]]);
+      } else if (point[i] == 1) {
+        apply_option("--" + axes[i].key);
+      }
+    }
+    check_config();
+  }
+
+  // The points of the grid that make a valid configuration; the others are reported and left out.
+  std::vector<std::vector<unsigned int>> valid_points(const std::vector<Axis> &axes) {
+    std::vector<std::vector<unsigned int>> points;
+    std::vector<unsigned int> point(axes.size());
+    Config base = config;
+    while (true) {
+      try {
+        apply_point(axes, point);
+        points.push_back(point);
+      } catch (const std::invalid_argument &error) {
+        std::cerr << "skipping a point of the grid: " << error.what() << std::endl;
+      }
+      config = base;
+      size_t i = 0;
+      for (; i < axes.size() && ++point[i] == axes[i].values.size(); i++) {
+        point[i] = 0;
+      }
+      if (i == axes.size()) {
+        return points;
+      }
+    }
+  }
+
+  // A column of the table and how a run fills it.
+  struct Column {
+    std::string name;
+    double (*value)(const RunResult &result, const Statistics &total);
+  };
+
+  const std::vector<Column> COLUMNS = {
+    {"return_value", [](const RunResult &result, const Statistics &) { return 1.0 * result.return_value; }},
+    {"cycles", [](const RunResult &result, const Statistics &) { return 1.0 * result.cycles; }},
+    {"instructions", [](const RunResult &, const Statistics &total) { return 1.0 * total.total_committed; }},
+    {"ipc", [](const RunResult &result, const Statistics &total) {
+      return result.cycles ? 1.0 * total.total_committed / result.cycles : 0;
+    }},
+    {"branch_accuracy", [](const RunResult &, const Statistics &total) {
+      return total.total_predict ? 1.0 * total.correct_predict / total.total_predict : 0;
+    }},
+    {"fetch_wait_cycles", [](const RunResult &, const Statistics &total) { return 1.0 * total.fetch_wait_cycles; }},
+    {"data_wait_cycles", [](const RunResult &, const Statistics &total) { return 1.0 * total.data_wait_cycles; }},
+    {"fetch_buffer_empty_cycles", [](const RunResult &, const Statistics &total) {
+      return 1.0 * total.fetch_buffer_empty_cycles;
+    }},
+    {"issue_stall_rob", [](const RunResult &, const Statistics &total) { return 1.0 * total.issue_stall_rob; }},
+    {"issue_stall_rs", [](const RunResult &, const Statistics &total) { return 1.0 * total.issue_stall_rs; }},
+    {"issue_stall_lsb", [](const RunResult &, const Statistics &total) { return 1.0 * total.issue_stall_lsb; }},
+    {"load_use_stalls", [](const RunResult &, const Statistics &total) { return 1.0 * total.load_use_stalls; }},
+    {"data_cache_misses", [](const RunResult &, const Statistics &total) { return 1.0 * total.data_cache_misses; }},
+  };
+
+  // The counters the table shows, summed over the cores.
+  Statistics total_of(const RunResult &result, unsigned int cores) {
+    Statistics total{};
+    for (unsigned int core = 0; core < cores; core++) {
+      auto &statistics = result.statistics[core];
+      total.total_committed += statistics.total_committed;
+      total.total_predict += statistics.total_predict;
+      total.correct_predict += statistics.correct_predict;
+      total.fetch_wait_cycles += statistics.fetch_wait_cycles;
+      total.data_wait_cycles += statistics.data_wait_cycles;
+      total.fetch_buffer_empty_cycles += statistics.fetch_buffer_empty_cycles;
+      total.issue_stall_rob += statistics.issue_stall_rob;
+      total.issue_stall_rs += statistics.issue_stall_rs;
+      total.issue_stall_lsb += statistics.issue_stall_lsb;
+      total.load_use_stalls += statistics.load_use_stalls;
+      total.data_cache_misses += statistics.data_cache_misses;
+    }
+    return total;
+  }
+
+  // Counts in full, ratios to 6 significant digits.
+  std::string format(double value) {
+    if (value == std::floor(value)) {
+      return std::to_string(static_cast<long long>(value));
+    }
+    std::ostringstream text;
+    text << value;
+    return text.str();
+  }
+
+  std::string quote(const std::string &text) {
+    std::string quoted = "\"";
+    for (auto c: text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+      }
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+
+  // A text field of the CSV table, in double quotes with its quotes doubled, so that commas and quotes are kept.
+  std::string csv_field(const std::string &text) {
+    std::string quoted = "\"";
+    for (auto c: text) {
+      if (c == '"') {
+        quoted += '"';
+      }
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+
+  void print_table(const std::vector<Axis> &axes, const std::vector<Run> &runs) {
+    bool json = config.table_format == JSON_TABLE;
+    Config base = config;
+    if (json) {
+      std::cout << "[" << std::endl;
+    } else {
+      std::cout << csv_field("workload");
+      for (auto &axis: axes) {
+        std::cout << "," << csv_field(axis.key);
+      }
+      for (auto &column: COLUMNS) {
+        std::cout << "," << csv_field(column.name);
+      }
+      std::cout << "," << csv_field("error") << std::endl;
+    }
+    for (size_t r = 0; r < runs.size(); r++) {
+      auto &run = runs[r];
+      apply_point(axes, run.point); // for the number of cores
+      auto total = total_of(run.result, config.cores);
+      config = base;
+      if (json) {
+        std::cout << "  {\"workload\": " << quote(run.workload);
+        for (size_t i = 0; i < axes.size(); i++) {
+          std::cout << ", " << quote(axes[i].key) << ": " << quote(axes[i].values[run.point[i]]);
+        }
+        for (auto &column: COLUMNS) {
+          std::cout << ", " << quote(column.name) << ": "
+                    << (run.error.empty() ? format(column.value(run.result, total)) : "null");
+        }
+        if (!run.error.empty()) {
+          std::cout << ", \"error\": " << quote(run.error);
+        }
+        std::cout << "}" << (r + 1 < runs.size() ? "," : "") << std::endl;
+      } else {
+        std::cout << csv_field(run.workload);
+        for (size_t i = 0; i < axes.size(); i++) {
+          std::cout << "," << csv_field(axes[i].values[run.point[i]]);
+        }
+        for (auto &column: COLUMNS) {
+          std::cout << "," << (run.error.empty() ? format(column.value(run.result, total)) : "");
+        }
+        std::cout << "," << (run.error.empty() ? "" : csv_field(run.error)) << std::endl;
+      }
+    }
+    if (json) {
+      std::cout << "]" << std::endl;
+    }
+  }
+
+  // Run every workload at every valid point of the grid, at most config.jobs at once, and print the table.
+  // Return how many runs failed.
+  unsigned int run() {
+    auto axes = parse_grid();
+    auto points = valid_points(axes);
+    for (auto &workload: config.workloads) {
+      if (!std::ifstream(workload)) {
+        throw std::invalid_argument("Cannot read workload " + workload);
+      }
+    }
+    std::vector<Run> runs;
+    for (auto &point: points) {
+      for (auto &workload: config.workloads) {
+        runs.push_back({workload, point});
+      }
+    }
+    ForkPool<RunResult> pool;
+    for (auto &run: runs) {
+      pool.spawn(run.result, "Run of " + run.workload, [&](RunResult &result) {
+        apply_point(axes, run.point);
+        if (pool.jobs() > 1 && config.threads == 0) { // the children already share the host
+          config.threads = 1;
+        }
+        std::ifstream in(run.workload);
+        memory::load_instructions(in);
+        System system;
+        while (!system.halted()) {
+          system.run_cycle();
+        }
+        result = system.result();
+      }, &run.error);
+    }
+    pool.wait();
+    print_table(axes, runs);
+    auto failed = std::count_if(runs.begin(), runs.end(), [](const Run &run) { return !run.error.empty(); });
+    return static_cast<unsigned int>(failed);
+  }
+}
+
+#endif //RISC_V_EXPLORE_HPP
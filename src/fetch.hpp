@@ -0,0 +1,682 @@
+#ifndef RISC_V_FETCH_HPP
+#define RISC_V_FETCH_HPP
+
+#include <memory>
+#include "instructions.hpp"
+#include "config.hpp"
+#include "trace.hpp"
+
+using namespace instructions;
+
+// Index bits of pc for the tables of the front end. This is pc >> 2 for a 4-byte aligned pc;
+// a pc in the middle of a word uses the neighbouring entry.
+unsigned int hash_pc(unsigned int pc) {
+  return (pc >> 2) ^ ((pc >> 1) & 1);
+}
+
+// An instruction decoded by the front end and waiting in the fetch buffer.
+// Register fields that the instruction does not use are x0.
+struct FetchedInstruction {
+  OpCode opcode;
+  RegPos rs1;
+  RegPos rs2;
+  RegPos rd;
+  Data immediate;
+  Data pc;
+  Flag predict; // whether the front end followed the taken path of this branch
+  Flag terminate;
+  Flag compressed;
+};
+
+struct FetchedInstructionWire {
+  Wire<7> opcode;
+  RegPosWire rs1;
+  RegPosWire rs2;
+  RegPosWire rd;
+  DataWire immediate;
+  DataWire pc;
+  FlagWire predict;
+  FlagWire terminate;
+  FlagWire compressed;
+};
+
+// Connect every field of wire to the instruction returned by entry().
+template<typename _Fn>
+void connect(FetchedInstructionWire &wire, _Fn entry) {
+  wire.opcode = [=]() -> auto & { return entry().opcode; };
+  wire.rs1 = [=]() -> auto & { return entry().rs1; };
+  wire.rs2 = [=]() -> auto & { return entry().rs2; };
+  wire.rd = [=]() -> auto & { return entry().rd; };
+  wire.immediate = [=]() -> auto & { return entry().immediate; };
+  wire.pc = [=]() -> auto & { return entry().pc; };
+  wire.predict = [=]() -> auto & { return entry().predict; };
+  wire.terminate = [=]() -> auto & { return entry().terminate; };
+  wire.compressed = [=]() -> auto & { return entry().compressed; };
+}
+
+// An instruction decoded by the fetch stage in this cycle.
+struct FetchSlot {
+  DecodedInstruction inst;
+  unsigned int pc;
+  bool predict;
+};
+
+// The instructions the fetch stage decodes in one cycle.
+struct Run {
+  std::array<FetchSlot, FETCH_BLOCK_HALVES> slots;
+  unsigned int length = 0;
+  unsigned int next = 0; // pc after the run
+};
+
+void write(FetchedInstruction &fetched, const FetchSlot &slot) {
+  fetched.opcode.assign(slot.inst.op);
+  fetched.rs1.assign(slot.inst.rs1);
+  fetched.rs2.assign(slot.inst.rs2);
+  fetched.rd.assign(slot.inst.rd);
+  fetched.immediate.assign(slot.inst.immediate);
+  fetched.pc.assign(slot.pc);
+  fetched.predict.assign(slot.predict);
+  fetched.terminate.assign(slot.inst.terminate);
+  fetched.compressed.assign(slot.inst.compressed);
+}
+
+void copy(FetchedInstruction &to, const FetchedInstruction &from) {
+  to.opcode.assign(from.opcode);
+  to.rs1.assign(from.rs1);
+  to.rs2.assign(from.rs2);
+  to.rd.assign(from.rd);
+  to.immediate.assign(from.immediate);
+  to.pc.assign(from.pc);
+  to.predict.assign(from.predict);
+  to.terminate.assign(from.terminate);
+  to.compressed.assign(from.compressed);
+}
+
+// A committed branch or jal, used to train the predictor and the BTB.
+struct BranchUpdate {
+  Flag valid;
+  Data pc;
+  Data target; // where the branch goes when taken
+  Flag taken;
+  Flag jump; // jal, always taken
+  Flag mispredicted;
+};
+
+struct BranchUpdateWire {
+  FlagWire valid;
+  DataWire pc;
+  DataWire target; // where the branch goes when taken
+  FlagWire taken;
+  FlagWire jump; // jal, always taken
+  FlagWire mispredicted;
+};
+
+void connect(BranchUpdateWire &wire, BranchUpdate &update) {
+  wire.valid.follow(update.valid);
+  wire.pc.follow(update.pc);
+  wire.target.follow(update.target);
+  wire.taken.follow(update.taken);
+  wire.jump.follow(update.jump);
+  wire.mispredicted.follow(update.mispredicted);
+}
+
+struct FetchInput {
+  FlagWire flushing; // of this thread
+  DataWire flush_pc;
+  FetchBufferPosWire fetch_head; // owned by the consumer of the fetch buffer
+  BranchUpdateWire branch_update;
+  FlagWire fetch_finished;
+  std::array<DataWire, FETCH_BLOCK_WORDS> fetch_block;
+};
+
+struct FetchOutput {
+  std::array<FetchedInstruction, FETCH_BUFFER_SIZE> fetch_buffer;
+  FetchBufferPos fetch_tail;
+  Flag fetch_request;
+  Data fetch_addr; // aligned to FETCH_BLOCK_SIZE
+};
+
+// A run of instructions inside one fetch block, ending at a predicted-taken branch or at the block end.
+// A run can also be a whole trace from trace cache.
+struct FetchTarget {
+  Flag valid;
+  Flag trace; // delivered by trace cache
+  TracePos trace_pos;
+  Data start;
+  Data end; // instructions starting before end belong to this run
+  Data next; // predicted pc after this run
+  Flag taken; // whether the last instruction is predicted taken
+};
+
+struct BranchTargetEntry {
+  Flag valid;
+  Data tag; // the full pc of the branch
+  Data target;
+  Flag jump;
+};
+
+enum PredictorStatus {
+  STRONGLY_NOT_TAKEN,
+  WEAKLY_NOT_TAKEN,
+  WEAKLY_TAKEN,
+  STRONGLY_TAKEN
+};
+
+// Two-bit direction counters and a branch target buffer, trained with committed branches.
+// Only the first config.predictor_entries counters and config.btb_entries targets are used.
+struct BranchPredictor {
+  std::array<BranchTargetEntry, MAX_BTB_ENTRIES> btb;
+  std::array<PredictorStatusCode, MAX_PREDICTOR_ENTRIES> predictors;
+
+  bool get_predict(unsigned int pc) {
+    auto hash = pc & (config.predictor_entries - 1);
+    auto &pr = predictors[hash];
+    auto state = static_cast<PredictorStatus>(to_unsigned(pr));
+    return state == STRONGLY_TAKEN || state == WEAKLY_TAKEN;
+  }
+
+  void store_predict(unsigned int pc, bool result) {
+    auto hash = pc & (config.predictor_entries - 1);
+    auto &pr = predictors[hash];
+    auto state = static_cast<PredictorStatus>(to_unsigned(pr));
+    switch (state) {
+      case STRONGLY_NOT_TAKEN:
+        pr.assign(result ? WEAKLY_NOT_TAKEN : STRONGLY_NOT_TAKEN);
+        break;
+      case WEAKLY_NOT_TAKEN:
+        pr.assign(result ? WEAKLY_TAKEN : STRONGLY_NOT_TAKEN);
+        break;
+      case WEAKLY_TAKEN:
+        pr.assign(result ? STRONGLY_TAKEN : WEAKLY_NOT_TAKEN);
+        break;
+      case STRONGLY_TAKEN:
+        pr.assign(result ? STRONGLY_TAKEN : WEAKLY_TAKEN);
+        break;
+    }
+  }
+
+  BranchTargetEntry *lookup_btb(unsigned int pc) {
+    auto &entry = btb[hash_pc(pc) & (config.btb_entries - 1)];
+    if (entry.valid == true && entry.tag == pc) {
+      return &entry;
+    }
+    return nullptr;
+  }
+
+  // Whether the branch or jump at pc is predicted taken.
+  bool predict_taken(unsigned int pc) {
+    auto entry = lookup_btb(pc);
+    return entry != nullptr && (entry->jump == true || get_predict(pc));
+  }
+
+  // Train with a committed branch or jal. The counter only moves on a misprediction.
+  void update(unsigned int pc, unsigned int target, bool taken, bool jump, bool mispredicted) {
+    if (mispredicted) {
+      store_predict(pc, taken);
+    }
+    if (taken) {
+      auto &entry = btb[hash_pc(pc) & (config.btb_entries - 1)];
+      entry.valid.assign(true);
+      entry.tag.assign(pc);
+      entry.target.assign(target);
+      entry.jump.assign(jump);
+    }
+  }
+};
+
+struct TraceEntry {
+  Flag valid;
+  Data start;
+  TracePath path;
+  TraceBranches branches;
+  TraceLength length;
+  Data next; // pc after the trace
+  std::array<FetchedInstruction, TRACE_LENGTH> instructions;
+};
+
+// Decoded instruction sequences that may span predicted-taken branches.
+// A trace is found by its start pc and the directions of the conditional branches in it,
+// so each start pc can keep a trace per path.
+// The fill unit builds traces from the runs the fetch stage decodes.
+struct TraceCache {
+  std::array<TraceEntry, TRACE_CACHE_SETS * TRACE_CACHE_WAYS> entries;
+  std::array<Flag, TRACE_CACHE_SETS> victims; // the way to replace next, as there are two ways
+  std::array<FetchedInstruction, TRACE_LENGTH> fill;
+  TraceLength fill_length;
+  TraceBranches fill_branches;
+  TracePath fill_path;
+  Data fill_next;
+  Flag fill_closed; // the trace in fill is complete and is written next cycle
+
+  // Most traces start at a block boundary, where hash_pc alone would use a quarter of the sets.
+  static unsigned int set_of(unsigned int pc) {
+    return (pc / FETCH_BLOCK_SIZE ^ hash_pc(pc)) & (TRACE_CACHE_SETS - 1);
+  }
+
+  // Find a trace starting at pc whose branches go the way predict(branch pc) says.
+  // Return its position, or -1 if there is none.
+  template<typename _Fn>
+  int lookup(unsigned int pc, _Fn predict) {
+    auto set = set_of(pc);
+    for (unsigned int way = 0; way < TRACE_CACHE_WAYS; way++) {
+      auto pos = set * TRACE_CACHE_WAYS + way;
+      TraceEntry &entry = entries[pos];
+      if (entry.valid == false || entry.start != pc) {
+        continue;
+      }
+      auto path = to_unsigned(entry.path);
+      unsigned int branch = 0;
+      bool match = true;
+      for (unsigned int i = 0; i < to_unsigned(entry.length) && match; i++) {
+        FetchedInstruction &inst = entry.instructions[i];
+        if (is_branch(static_cast<Op>(to_unsigned(inst.opcode)))) {
+          match = predict(to_unsigned(inst.pc)) == static_cast<bool>((path >> branch) & 1);
+          branch++;
+        }
+      }
+      if (match) {
+        return static_cast<int>(pos);
+      }
+    }
+    return -1;
+  }
+
+  void write_trace() {
+    auto start = to_unsigned(fill[0].pc);
+    auto set = set_of(start);
+    unsigned int way = TRACE_CACHE_WAYS;
+    for (unsigned int i = 0; i < TRACE_CACHE_WAYS && way == TRACE_CACHE_WAYS; i++) {
+      TraceEntry &entry = entries[set * TRACE_CACHE_WAYS + i];
+      if (entry.valid == true && entry.start == start && entry.path == fill_path) {
+        way = i;
+      }
+    }
+    for (unsigned int i = 0; i < TRACE_CACHE_WAYS && way == TRACE_CACHE_WAYS; i++) {
+      if (entries[set * TRACE_CACHE_WAYS + i].valid == false) {
+        way = i;
+      }
+    }
+    if (way == TRACE_CACHE_WAYS) {
+      way = to_unsigned(victims[set]);
+      victims[set].assign(way == 0);
+    }
+    TraceEntry &entry = entries[set * TRACE_CACHE_WAYS + way];
+    entry.valid.assign(true);
+    entry.start.assign(start);
+    entry.path.assign(fill_path);
+    entry.branches.assign(fill_branches);
+    entry.length.assign(fill_length);
+    entry.next.assign(fill_next);
+    for (unsigned int i = 0; i < to_unsigned(fill_length); i++) {
+      copy(entry.instructions[i], fill[i]);
+    }
+  }
+
+  // Append the run decoded in this cycle to the trace being built.
+  // A run that does not fit first writes the trace built so far. close ends the trace after this run.
+  // Called once every cycle the front end is not flushed.
+  void update_fill(const Run &run, bool close) {
+    unsigned int run_branches = 0;
+    for (unsigned int i = 0; i < run.length; i++) {
+      run_branches += is_branch(run.slots[i].inst.op);
+    }
+    auto length = to_unsigned(fill_length);
+    auto branches = to_unsigned(fill_branches);
+    auto path = to_unsigned(fill_path);
+    if (fill_closed == true ||
+        (run.length > 0 && (length + run.length > TRACE_LENGTH || branches + run_branches > TRACE_MAX_BRANCHES))) {
+      if (length > 0) {
+        write_trace();
+      }
+      length = branches = path = 0;
+    }
+    for (unsigned int i = 0; i < run.length; i++) {
+      const FetchSlot &slot = run.slots[i];
+      write(fill[length + i], slot);
+      if (is_branch(slot.inst.op)) {
+        path |= static_cast<unsigned int>(slot.predict) << branches;
+        branches++;
+      }
+    }
+    length += run.length;
+    fill_length.assign(length);
+    fill_branches.assign(branches);
+    fill_path.assign(path);
+    if (run.length > 0) {
+      fill_next.assign(run.next);
+    }
+    fill_closed.assign(length > 0 && (close || length == TRACE_LENGTH || branches == TRACE_MAX_BRANCHES));
+  }
+
+  void reset_fill() {
+    fill_length.assign(0);
+    fill_branches.assign(0);
+    fill_path.assign(0);
+    fill_closed.assign(false);
+  }
+};
+
+// Instruction blocks kept by the fetch stage. There are two, so that an instruction
+// crossing the end of one block can be read with the next one.
+struct FetchLine {
+  Flag valid;
+  Data addr;
+  std::array<Data, FETCH_BLOCK_WORDS> words;
+};
+
+using FetchLines = std::array<FetchLine, 2>;
+
+// The line holding the block at addr, or -1.
+int find_fetch_line(FetchLines &lines, unsigned int addr) {
+  for (unsigned int i = 0; i < lines.size(); i++) {
+    if (lines[i].valid == true && lines[i].addr == addr) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+// The 16 bits at pc, which is in line.
+unsigned int read_fetch_half(FetchLine &line, unsigned int pc) {
+  auto word = to_unsigned(line.words[(pc & (FETCH_BLOCK_SIZE - 1)) >> 2]);
+  return pc & 2 ? word >> 16 : word & 0xffff;
+}
+
+struct FetchData {
+  Data predict_pc; // where the predict stage continues
+  std::array<FetchTarget, FETCH_TARGET_QUEUE_SIZE> fetch_targets;
+  FetchTargetPos target_head, target_tail;
+  BranchPredictor predictor;
+  std::unique_ptr<TraceCache> trace_cache; // only with config.trace_cache, as it is large
+  FetchLines lines;
+  Flag line_recent; // the line used last; a new block replaces the other one
+  Flag resume_valid; // the last run ended with an instruction crossing its block,
+  Data resume_from; // so the run starting at resume_from
+  Data resume_pc; // really starts at resume_pc
+};
+
+// The front end. It runs ahead of the back end in two stages:
+// the predict stage walks the predicted path one fetch block per cycle and fills the fetch target queue;
+// the fetch stage reads the blocks named there from memory, decodes them and fills the fetch buffer.
+// Both queues absorb bubbles, so the back end sees a stall only when the fetch buffer runs empty.
+// When trace cache has a trace for the predicted path, the predict stage queues the whole trace instead,
+// and the fetch stage delivers it in one cycle without reading memory. Without config.trace_cache there is none.
+// Each hardware thread has its own front end, with its own pc and predictor history.
+struct FetchUnit : dark::Module<FetchInput, FetchOutput, FetchData> {
+  const unsigned int hart; // index of the hardware thread among all cores
+  FrontEndStatistics &statistics; // of the thread
+
+  FetchUnit(unsigned int hart, FrontEndStatistics &statistics) : hart(hart), statistics(statistics) {
+    if (config.trace_cache) {
+      trace_cache = std::make_unique<TraceCache>();
+    }
+  }
+
+
+  // Train the predictor with a committed branch.
+  void update_predictor() {
+    if (branch_update.valid == false) {
+      return;
+    }
+    predictor.update(to_unsigned(branch_update.pc), to_unsigned(branch_update.target),
+                     static_cast<bool>(branch_update.taken), static_cast<bool>(branch_update.jump),
+                     static_cast<bool>(branch_update.mispredicted));
+  }
+
+  // Predict the run starting at predict_pc and push it into the fetch target queue.
+  void predict() {
+    auto pos = to_unsigned(target_tail);
+    FetchTarget &target = fetch_targets[pos];
+    if (target.valid == true) {
+      return;
+    }
+    auto start = to_unsigned(predict_pc);
+    auto trace_pos = -1;
+    if (trace_cache) {
+      statistics.trace_lookups++;
+      trace_pos = trace_cache->lookup(start, [this](unsigned int pc) {
+        return predictor.lookup_btb(pc) != nullptr && predictor.get_predict(pc);
+      });
+    }
+    if (trace_pos >= 0) {
+      auto next = to_unsigned(trace_cache->entries[trace_pos].next);
+      target.valid.assign(true);
+      target.trace.assign(true);
+      target.trace_pos.assign(trace_pos);
+      target.start.assign(start);
+      target.next.assign(next);
+      target_tail.assign(target_tail + 1);
+      predict_pc.assign(next);
+      statistics.trace_hits++;
+      return;
+    }
+    auto block_end = (start & ~(FETCH_BLOCK_SIZE - 1)) + FETCH_BLOCK_SIZE;
+    auto end = block_end;
+    auto next = block_end;
+    bool taken = false;
+    for (auto pc = start; pc < block_end; pc += 2) {
+      if (predictor.predict_taken(pc)) {
+        end = pc + 2;
+        next = to_unsigned(predictor.lookup_btb(pc)->target);
+        taken = true;
+        break;
+      }
+    }
+    target.valid.assign(true);
+    target.trace.assign(false);
+    target.start.assign(start);
+    target.end.assign(end);
+    target.next.assign(next);
+    target.taken.assign(taken);
+    target_tail.assign(target_tail + 1);
+    predict_pc.assign(next);
+  }
+
+  // Predict from pc in the first cycle. Called before the first cycle.
+  void start_at(unsigned int pc) {
+    predict_pc.assign(pc);
+    sync();
+  }
+
+  void redirect(unsigned int pc) {
+    for (unsigned int i = 0; i < FETCH_TARGET_QUEUE_SIZE; i++) {
+      fetch_targets[i].valid.assign(false);
+    }
+    target_head.assign(0);
+    target_tail.assign(0);
+    predict_pc.assign(pc);
+    resume_valid.assign(false);
+    statistics.frontend_redirects++;
+  }
+
+  void pop_target(FetchTarget &target, unsigned int delivered) {
+    target.valid.assign(false);
+    target_head.assign(target_head + 1);
+    statistics.fetched_instructions += delivered;
+    statistics.delivery_cycles++;
+  }
+
+  // Copy the trace at the head of the fetch target queue into the fetch buffer.
+  // If the trace was replaced since it was predicted, fetch again from its start.
+  bool fetch_trace(FetchTarget &target, bool &close) {
+    TraceEntry &entry = trace_cache->entries[to_unsigned(target.trace_pos)];
+    if (entry.valid == false || entry.start != target.start || entry.next != target.next) {
+      redirect(to_unsigned(target.start));
+      return true;
+    }
+    auto length = to_unsigned(entry.length);
+    if (to_unsigned(fetch_tail - fetch_head) + length > FETCH_BUFFER_SIZE) {
+      return false;
+    }
+    auto tail = to_unsigned(fetch_tail);
+    for (unsigned int i = 0; i < length; i++) {
+      FetchedInstruction &inst = entry.instructions[i];
+      copy(fetch_buffer[(tail + i) & (FETCH_BUFFER_SIZE - 1)], inst);
+      if (trace::tracker) {
+        trace::tracker->deliver(hart, tail + i, to_unsigned(inst.pc), static_cast<Op>(to_unsigned(inst.opcode)),
+                                static_cast<bool>(inst.predict));
+      }
+    }
+    fetch_tail.assign(tail + length);
+    pop_target(target, length);
+    resume_valid.assign(false);
+    statistics.trace_instructions += length;
+    close = true; // the trace being built ends where a cached one begins
+    return false;
+  }
+
+  int find_line(unsigned int addr) {
+    return find_fetch_line(lines, addr);
+  }
+
+  unsigned int read_half(unsigned int line, unsigned int pc) {
+    auto half = read_fetch_half(lines[line], pc);
+    return trace::tracker ? trace::tracker->fetched_half(hart, pc, half) : half;
+  }
+
+  // Ask memory for the block at addr, keeping the line at keep.
+  void request_block(unsigned int addr, unsigned int keep) {
+    if (fetch_request == false && fetch_finished == false) {
+      fetch_request.assign(true);
+      fetch_addr.assign(addr);
+      line_recent.assign(keep);
+    }
+  }
+
+  // Decode the run at the head of the fetch target queue into the fetch buffer, and return it in run.
+  // Instructions are 2 or 4 bytes, and the last one may cross into the next block.
+  // Neighbouring instructions of the run that fuse() merges take one slot.
+  // A jal the predict stage did not see, or a predicted-taken slot holding no branch, redirects the predict stage.
+  // Return true if the front end was redirected.
+  bool fetch(Run &run, bool &close) {
+    auto pos = to_unsigned(target_head);
+    FetchTarget &target = fetch_targets[pos];
+    if (target.valid == false) {
+      return false;
+    }
+    if (target.trace == true) {
+      return fetch_trace(target, close);
+    }
+    auto start = to_unsigned(target.start);
+    if (resume_valid == true && resume_from == start) {
+      start = to_unsigned(resume_pc);
+    }
+    auto end = to_unsigned(target.end);
+    auto aligned = start & ~(FETCH_BLOCK_SIZE - 1);
+    auto line = find_line(aligned);
+    if (line < 0) {
+      request_block(aligned, line_recent == true ? 1 : 0);
+      return false;
+    }
+    Run decoded;
+    decoded.next = to_unsigned(target.next);
+    bool redirected = false, fused = false; // fused: the last slot holds a pair, and takes no third instruction
+    auto last_line = static_cast<unsigned int>(line);
+    auto pc = start;
+    while (pc < end && !redirected) {
+      auto code = read_half(line, pc);
+      if (!is_compressed(code)) {
+        auto next_line = pc + 2 < aligned + FETCH_BLOCK_SIZE ? line : find_line(aligned + FETCH_BLOCK_SIZE);
+        if (next_line < 0) {
+          request_block(aligned + FETCH_BLOCK_SIZE, line);
+          return false;
+        }
+        code |= read_half(next_line, pc + 2) << 16;
+        last_line = next_line;
+      }
+      auto inst = decode_instruction(code);
+      fused = config.fusion && decoded.length > 0 && !fused && fuse(decoded.slots[decoded.length - 1].inst, inst);
+      if (!fused) {
+        decoded.slots[decoded.length].pc = pc;
+        decoded.slots[decoded.length++].inst = inst;
+      }
+      FetchSlot &slot = decoded.slots[decoded.length - 1];
+      auto next_pc = pc + (inst.compressed ? 2 : 4);
+      bool predicted_taken = target.taken == true && pc + 2 == end;
+      slot.predict = predicted_taken && is_branch(slot.inst.op);
+      if (is_direct_jump(slot.inst.op) && !predicted_taken) {
+        decoded.next = slot.pc + slot.inst.immediate;
+        redirected = true;
+      } else if (predicted_taken && !is_direct_jump(slot.inst.op) && !is_branch(slot.inst.op)) {
+        decoded.next = next_pc;
+        redirected = true;
+      }
+      pc = next_pc;
+    }
+    if (to_unsigned(fetch_tail - fetch_head) + decoded.length > FETCH_BUFFER_SIZE) {
+      return false;
+    }
+    run = decoded;
+    auto tail = to_unsigned(fetch_tail);
+    for (unsigned int i = 0; i < run.length; i++) {
+      write(fetch_buffer[(tail + i) & (FETCH_BUFFER_SIZE - 1)], run.slots[i]);
+      if (trace::tracker) {
+        trace::tracker->deliver(hart, tail + i, run.slots[i].pc, run.slots[i].inst.op, run.slots[i].predict);
+      }
+    }
+    fetch_tail.assign(tail + run.length);
+    line_recent.assign(last_line);
+    if (redirected) {
+      redirect(run.next);
+      statistics.fetched_instructions += run.length;
+      statistics.delivery_cycles++;
+      return true;
+    }
+    bool crossed = target.taken == false && pc != end;
+    if (crossed) {
+      run.next = pc;
+    }
+    resume_valid.assign(crossed);
+    resume_from.assign(end);
+    resume_pc.assign(pc);
+    pop_target(target, run.length);
+    return false;
+  }
+
+  void receive_block() {
+    auto line = line_recent == true ? 0 : 1;
+    for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+      lines[line].words[i].assign(fetch_block[i]);
+    }
+    lines[line].addr.assign(fetch_addr);
+    lines[line].valid.assign(true);
+    fetch_request.assign(false);
+  }
+
+  void flush() {
+    predict_pc.assign(flush_pc);
+    for (unsigned int i = 0; i < FETCH_TARGET_QUEUE_SIZE; i++) {
+      fetch_targets[i].valid.assign(false);
+    }
+    target_head.assign(0);
+    target_tail.assign(0);
+    fetch_tail.assign(0);
+    fetch_request.assign(false);
+    resume_valid.assign(false);
+    if (trace_cache) {
+      trace_cache->reset_fill();
+    }
+  }
+
+  void work() override {
+    update_predictor();
+    if (flushing) {
+      flush();
+      return;
+    }
+    if (fetch_finished) {
+      receive_block();
+    }
+    Run run;
+    bool close = false;
+    bool redirected = fetch(run, close);
+    if (trace_cache) {
+      trace_cache->update_fill(run, close);
+    }
+    if (!redirected) {
+      predict();
+    }
+  }
+};
+
+#endif //RISC_V_FETCH_HPP
@@ -0,0 +1,255 @@
+#ifndef RISC_V_FLOATING_POINT_HPP
+#define RISC_V_FLOATING_POINT_HPP
+
+#include <bit>
+#include <cfenv>
+#include <cmath>
+#include <limits>
+#include "instructions.hpp"
+
+// Single-precision arithmetic of the F extension on host float.
+// The host rounding mode is switched around an operation only when the instruction asks for another one,
+// and the host exception flags are read back as fflags. Results that are NaN become the canonical NaN.
+namespace floating_point {
+  enum RoundingModeCode {
+    RNE, // round to nearest, ties to even
+    RTZ,
+    RDN,
+    RUP,
+    RMM, // round to nearest, ties to max magnitude; the host has no such mode
+    DYNAMIC = 0b111 // use frm
+  };
+
+  constexpr unsigned int FLAG_INEXACT = 1;
+  constexpr unsigned int FLAG_UNDERFLOW = 1 << 1;
+  constexpr unsigned int FLAG_OVERFLOW = 1 << 2;
+  constexpr unsigned int FLAG_DIVIDE_BY_ZERO = 1 << 3;
+  constexpr unsigned int FLAG_INVALID = 1 << 4;
+  constexpr unsigned int CANONICAL_NAN = 0x7fc00000;
+  constexpr unsigned int SIGN = 0x80000000;
+
+  float to_float(unsigned int bits) {
+    return std::bit_cast<float>(bits);
+  }
+
+  unsigned int to_bits(float value) {
+    return std::isnan(value) ? CANONICAL_NAN : std::bit_cast<unsigned int>(value);
+  }
+
+  bool is_nan(unsigned int bits) {
+    return (bits & ~SIGN) > 0x7f800000;
+  }
+
+  bool is_signaling_nan(unsigned int bits) {
+    return is_nan(bits) && (bits & 0x00400000) == 0;
+  }
+
+  unsigned int host_flags() {
+    auto raised = std::fetestexcept(FE_ALL_EXCEPT);
+    return (raised & FE_INEXACT ? FLAG_INEXACT : 0) | (raised & FE_UNDERFLOW ? FLAG_UNDERFLOW : 0) |
+           (raised & FE_OVERFLOW ? FLAG_OVERFLOW : 0) | (raised & FE_DIVBYZERO ? FLAG_DIVIDE_BY_ZERO : 0) |
+           (raised & FE_INVALID ? FLAG_INVALID : 0);
+  }
+
+  int host_rounding_mode(unsigned int rm) {
+    switch (rm) {
+      case RTZ:
+        return FE_TOWARDZERO;
+      case RDN:
+        return FE_DOWNWARD;
+      case RUP:
+        return FE_UPWARD;
+      default:
+        return FE_TONEAREST;
+    }
+  }
+
+  // The operations that round. T is float, or double for RMM.
+  template<typename T>
+  T compute(Op op, T x, T y, T z) {
+    switch (op) {
+      case FADD:
+        return x + y;
+      case FSUB:
+        return x - y;
+      case FMUL:
+        return x * y;
+      case FDIV:
+        return x / y;
+      case FSQRT:
+        return std::sqrt(x);
+      case FMADD:
+        return std::fma(x, y, z);
+      case FMSUB:
+        return std::fma(x, y, -z);
+      case FNMSUB:
+        return std::fma(-x, y, z);
+      case FNMADD:
+        return std::fma(-x, y, -z);
+      default:
+        throw std::invalid_argument("Invalid floating-point instruction.");
+    }
+  }
+
+  // Round value to float, ties away from zero.
+  float round_to_max_magnitude(double value) {
+    float nearest = static_cast<float>(value);
+    if (!std::isfinite(value) || nearest == value) {
+      return nearest;
+    }
+    float other = std::nextafter(nearest, value > nearest ? std::numeric_limits<float>::infinity()
+                                                          : -std::numeric_limits<float>::infinity());
+    if (value - nearest != other - value) {
+      return nearest;
+    }
+    return std::fabs(other) > std::fabs(nearest) ? other : nearest;
+  }
+
+  // Execute op with rounding mode rm (not DYNAMIC). The rounded operations run between volatile accesses
+  // so that the compiler cannot move them across the changes of host rounding mode.
+  unsigned int execute_rounded(Op op, unsigned int a, unsigned int b, unsigned int c, unsigned int rm,
+                               unsigned int &flags) {
+    bool from_integer = op == FCVTSW || op == FCVTSWU;
+    std::feclearexcept(FE_ALL_EXCEPT);
+    if (rm == RMM) {
+      // The operation is done in double rounded to odd: toward zero, with the last bit set if that dropped
+      // anything. Double has 29 bits more than float, so the float nearest to it is the one nearest to the
+      // exact result, it is a tie only if the exact result is, and it is inexact only if the exact result is.
+      std::fesetround(FE_TOWARDZERO);
+      volatile double x = op == FCVTSW ? static_cast<int>(a) : op == FCVTSWU ? static_cast<double>(a) : to_float(a);
+      volatile double y = to_float(b), z = to_float(c);
+      volatile double truncated = from_integer ? x : compute<double>(op, x, y, z);
+      flags = host_flags();
+      std::fesetround(FE_TONEAREST);
+      double odd = truncated;
+      if (flags & FLAG_INEXACT && std::isfinite(odd)) {
+        odd = std::bit_cast<double>(std::bit_cast<unsigned long long>(odd) | 1);
+      }
+      float result = round_to_max_magnitude(odd);
+      flags &= FLAG_INVALID | FLAG_DIVIDE_BY_ZERO;
+      if (std::isfinite(odd) && result != odd) {
+        flags |= FLAG_INEXACT;
+        flags |= std::isinf(result) ? FLAG_OVERFLOW : 0;
+        flags |= std::fabs(result) < std::numeric_limits<float>::min() ? FLAG_UNDERFLOW : 0;
+      }
+      return to_bits(result);
+    }
+    if (rm != RNE) {
+      std::fesetround(host_rounding_mode(rm));
+    }
+    volatile unsigned int x = a;
+    volatile float y = to_float(b), z = to_float(c);
+    volatile float result = op == FCVTSW ? static_cast<float>(static_cast<int>(x))
+                                         : op == FCVTSWU ? static_cast<float>(x)
+                                                         : compute<float>(op, to_float(x), y, z);
+    flags = host_flags();
+    if (rm != RNE) {
+      std::fesetround(FE_TONEAREST);
+    }
+    return to_bits(result);
+  }
+
+  // fcvt.w.s and fcvt.wu.s. Out of range values and NaN saturate, and raise invalid.
+  unsigned int convert_to_integer(unsigned int a, bool is_unsigned, unsigned int rm, unsigned int &flags) {
+    double value = to_float(a);
+    double rounded;
+    switch (rm) {
+      case RTZ:
+        rounded = std::trunc(value);
+        break;
+      case RDN:
+        rounded = std::floor(value);
+        break;
+      case RUP:
+        rounded = std::ceil(value);
+        break;
+      case RMM:
+        rounded = std::round(value);
+        break;
+      default:
+        rounded = std::nearbyint(value);
+    }
+    double low = is_unsigned ? 0 : std::numeric_limits<int>::min();
+    double high = is_unsigned ? std::numeric_limits<unsigned int>::max() : std::numeric_limits<int>::max();
+    if (std::isnan(value) || rounded > high) {
+      flags = FLAG_INVALID;
+      return is_unsigned ? std::numeric_limits<unsigned int>::max() : std::numeric_limits<int>::max();
+    }
+    if (rounded < low) {
+      flags = FLAG_INVALID;
+      return is_unsigned ? 0 : static_cast<unsigned int>(std::numeric_limits<int>::min());
+    }
+    flags = rounded != value ? FLAG_INEXACT : 0;
+    return is_unsigned ? static_cast<unsigned int>(rounded) : static_cast<unsigned int>(static_cast<int>(rounded));
+  }
+
+  unsigned int classify(unsigned int a) {
+    bool negative = a & SIGN;
+    auto exponent = a >> 23 & 0xff;
+    auto fraction = a & 0x7fffff;
+    if (exponent == 0xff) {
+      return fraction == 0 ? (negative ? 1 << 0 : 1 << 7) : is_signaling_nan(a) ? 1 << 8 : 1 << 9;
+    }
+    if (exponent == 0) {
+      return fraction == 0 ? (negative ? 1 << 3 : 1 << 4) : (negative ? 1 << 2 : 1 << 5);
+    }
+    return negative ? 1 << 1 : 1 << 6;
+  }
+
+  // fmin and fmax return the other operand when one is NaN, and order -0 below +0.
+  unsigned int min_max(unsigned int a, unsigned int b, bool is_max, unsigned int &flags) {
+    flags = is_signaling_nan(a) || is_signaling_nan(b) ? FLAG_INVALID : 0;
+    if (is_nan(a) || is_nan(b)) {
+      return is_nan(a) && is_nan(b) ? CANONICAL_NAN : is_nan(a) ? b : a;
+    }
+    float x = to_float(a), y = to_float(b);
+    if (x == y) { // equal, or zeros of either sign
+      return is_max ? a & b : a | b;
+    }
+    return (x < y) != is_max ? a : b;
+  }
+
+  // feq is a quiet comparison; flt and fle raise invalid on any NaN.
+  unsigned int compare(Op op, unsigned int a, unsigned int b, unsigned int &flags) {
+    if (is_nan(a) || is_nan(b)) {
+      flags = op != FEQ || is_signaling_nan(a) || is_signaling_nan(b) ? FLAG_INVALID : 0;
+      return 0;
+    }
+    flags = 0;
+    float x = to_float(a), y = to_float(b);
+    return op == FEQ ? x == y : op == FLT ? x < y : x <= y;
+  }
+
+  // Result of a floating-point instruction other than a load or store. rm is the resolved rounding mode.
+  // flags receives the exceptions raised.
+  unsigned int execute(Op op, unsigned int a, unsigned int b, unsigned int c, unsigned int rm, unsigned int &flags) {
+    flags = 0;
+    switch (op) {
+      case FSGNJ:
+        return (a & ~SIGN) | (b & SIGN);
+      case FSGNJN:
+        return (a & ~SIGN) | (~b & SIGN);
+      case FSGNJX:
+        return a ^ (b & SIGN);
+      case FMVXW:
+      case FMVWX:
+        return a;
+      case FCLASS:
+        return classify(a);
+      case FMIN:
+      case FMAX:
+        return min_max(a, b, op == FMAX, flags);
+      case FEQ:
+      case FLT:
+      case FLE:
+        return compare(op, a, b, flags);
+      case FCVTWS:
+      case FCVTWUS:
+        return convert_to_integer(a, op == FCVTWUS, rm, flags);
+      default:
+        return execute_rounded(op, a, b, c, rm, flags);
+    }
+  }
+}
+
+#endif //RISC_V_FLOATING_POINT_HPP
@@ -0,0 +1,92 @@
+#ifndef RISC_V_FLOATING_POINT_UNIT_HPP
+#define RISC_V_FLOATING_POINT_UNIT_HPP
+
+#include "floating_point.hpp"
+#include "bundles.hpp"
+#include "config.hpp"
+
+struct FloatingPointUnitInput {
+  UnitRequestWire request;
+  std::array<RoundingModeWire, MAX_THREADS> frm; // of each thread, for instructions that ask for the dynamic one
+  ThreadMaskWire flushing;
+};
+
+struct FloatingPointUnitOutput {
+  ResultBus bus;
+};
+
+struct FloatStage {
+  Flag valid;
+  InstPos tag;
+  ThreadIndex thread;
+  Data value;
+  FloatFlags flags;
+};
+
+struct FloatingPointUnitData {
+  std::array<FloatStage, MAX_FLOAT_LATENCY - 1> stages;
+};
+
+// A pipelined floating-point unit. It takes one instruction every cycle, and its result is broadcast
+// latency cycles after the request arrives. The processor has one for divide and square root,
+// and one for the rest of F. A flush drops the stages of its threads.
+struct FloatingPointUnit : dark::Module<FloatingPointUnitInput, FloatingPointUnitOutput, FloatingPointUnitData> {
+  const unsigned int &latency; // a field of config
+  int &operations; // statistics counter
+
+  FloatingPointUnit(const unsigned int &latency, int &operations) : latency(latency), operations(operations) {}
+
+  bool alive(const FloatStage &stage) {
+    return stage.valid == true && !flushes(flushing, to_unsigned(stage.thread));
+  }
+
+  void work() override {
+    unsigned int value = 0, flags = 0;
+    bool accepted = request.valid == true && !flushes(flushing, to_unsigned(request.thread));
+    if (accepted) {
+      auto op = static_cast<Op>(to_unsigned(request.opcode));
+      auto rm = to_unsigned(request.rounding_mode);
+      if (rm == floating_point::DYNAMIC) {
+        rm = to_unsigned(frm[to_unsigned(request.thread)]);
+      }
+      value = floating_point::execute(op, to_unsigned(request.rs1), to_unsigned(request.rs2), to_unsigned(request.rs3),
+                                      rm, flags);
+      operations++;
+    }
+    auto depth = latency - 1;
+    if (depth == 0) {
+      bus.valid.assign(accepted);
+      bus.tag.assign(request.tag);
+      bus.value.assign(value);
+      bus.flags.assign(flags);
+      return;
+    }
+    bool busy = accepted;
+    for (unsigned int i = 0; i < depth && !busy; i++) {
+      busy = stages[i].valid == true;
+    }
+    if (!busy) { // the stages of an empty pipeline keep their values, which nothing reads
+      bus.valid.assign(false);
+      return;
+    }
+    const FloatStage &last = stages[depth - 1];
+    bus.valid.assign(alive(last));
+    bus.tag.assign(last.tag);
+    bus.value.assign(last.value);
+    bus.flags.assign(last.flags);
+    for (auto i = depth - 1; i > 0; i--) {
+      stages[i].valid.assign(alive(stages[i - 1]));
+      stages[i].tag.assign(stages[i - 1].tag);
+      stages[i].thread.assign(stages[i - 1].thread);
+      stages[i].value.assign(stages[i - 1].value);
+      stages[i].flags.assign(stages[i - 1].flags);
+    }
+    stages[0].valid.assign(accepted);
+    stages[0].tag.assign(request.tag);
+    stages[0].thread.assign(request.thread);
+    stages[0].value.assign(value);
+    stages[0].flags.assign(flags);
+  }
+};
+
+#endif //RISC_V_FLOATING_POINT_UNIT_HPP
@@ -0,0 +1,113 @@
+#ifndef RISC_V_FORK_POOL_HPP
+#define RISC_V_FORK_POOL_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "config.hpp"
+
+// Children forked from the simulation as it stands, each computing one result and sending it back over a pipe.
+// A child starts with a copy-on-write copy of the whole process: guest memory, config, counters and every module,
+// so it continues from the state of the parent without saving anything. At most config.jobs children run at once,
+// 0 meaning one per host thread.
+template<typename Result>
+class ForkPool {
+  static_assert(std::is_trivially_copyable_v<Result>);
+
+  struct Job {
+    pid_t pid;
+    int pipe;
+    Result *result;
+    std::string name;
+    std::string *error; // receives why the child failed, or nullptr to throw instead
+  };
+
+  std::vector<Job> running;
+  unsigned int limit;
+
+  // Read what the child sent until it closes the pipe: its result, or the message of the exception it failed with.
+  void finish(Job &job) {
+    std::string sent;
+    char buffer[4096];
+    for (ssize_t count; (count = read(job.pipe, buffer, sizeof(buffer))) > 0;) {
+      sent.append(buffer, static_cast<size_t>(count));
+    }
+    close(job.pipe);
+    int status;
+    waitpid(job.pid, &status, 0);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && sent.size() == sizeof(Result)) {
+      std::memcpy(job.result, sent.data(), sizeof(Result));
+      return;
+    }
+    std::string error = WIFSIGNALED(status) ? "killed by signal " + std::to_string(WTERMSIG(status))
+                        : WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "sent no result"
+                        : sent.empty() ? "exited with status " + std::to_string(WEXITSTATUS(status))
+                        : sent;
+    if (!job.error) {
+      throw std::runtime_error(job.name + " failed: " + error);
+    }
+    *job.error = error;
+  }
+
+public:
+  ForkPool() : limit(config.jobs ? config.jobs : std::max(1u, std::thread::hardware_concurrency())) {}
+  ForkPool(const ForkPool &) = delete;
+
+  // How many children run at once.
+  unsigned int jobs() const {
+    return limit;
+  }
+
+  // Fork a child that calls compute(result) and sends result back; result is filled in by wait. name is for errors.
+  // If the child fails, error receives why, or wait throws when error is nullptr.
+  template<typename Compute>
+  void spawn(Result &result, const std::string &name, Compute &&compute, std::string *error = nullptr) {
+    if (running.size() == limit) {
+      finish(running.front());
+      running.erase(running.begin());
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+      throw std::runtime_error("pipe failed");
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+      throw std::runtime_error("fork failed");
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      bool written = false;
+      try {
+        compute(result);
+        written = write(fds[1], &result, sizeof(Result)) == sizeof(Result);
+      } catch (const std::exception &error) {
+        std::cerr << name << ": " << error.what() << std::endl;
+        [[maybe_unused]] auto sent = write(fds[1], error.what(), std::strlen(error.what()));
+      }
+      _exit(written ? 0 : 1);
+    }
+    close(fds[1]);
+    running.push_back({pid, fds[0], &result, name, error});
+  }
+
+  // Wait for all children, and their results.
+  void wait() {
+    while (!running.empty()) {
+      auto job = running.front();
+      running.erase(running.begin());
+      finish(job);
+    }
+  }
+};
+
+#endif //RISC_V_FORK_POOL_HPP
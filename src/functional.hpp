@@ -0,0 +1,191 @@
+#ifndef RISC_V_FUNCTIONAL_HPP
+#define RISC_V_FUNCTIONAL_HPP
+
+#include "alu.hpp"
+#include "floating_point.hpp"
+#include "csr.hpp"
+#include "tlb.hpp"
+
+// The state of one hart as the program sees it between two instructions.
+struct ArchState {
+  unsigned int pc = 0;
+  std::array<unsigned int, REGISTER_COUNT> registers{}; // x0-x31, then f0-f31
+  unsigned int fflags = 0;
+  unsigned int frm = 0;
+  unsigned int satp = 0;
+  bool reserved = false; // by lr, at reservation
+  unsigned int reservation = 0;
+  bool halted = false;
+  unsigned long long retired = 0; // instructions executed so far
+
+  // What the program returns once halted: the low byte of a0.
+  unsigned int return_value() const {
+    constexpr unsigned int A0 = 10;
+    return registers[A0] & 0xff;
+  }
+};
+
+// What one instruction did.
+struct StepResult {
+  unsigned int pc;
+  unsigned int code; // the instruction word; only the low half for a compressed one
+  DecodedInstruction inst;
+  unsigned int next_pc;
+  unsigned int addr = 0; // virtual address of a load, store or atomic
+  bool taken = false; // for a branch
+};
+
+// Runs a program one instruction at a time on a memory image, memory::memory unless given another, without timing:
+// the fast-forward of sampled simulation. Results are those of the timing model: accesses are translated with
+// the same page table, a fetch that faults reads zeros, a load that faults reads 0 and a store that faults is dropped.
+// Counter csrs read the number of retired instructions, for cycles too.
+struct FunctionalCore {
+  ArchState state;
+  const unsigned int hart;
+  memory::Image &image;
+  csr::Counters counters{};
+
+  explicit FunctionalCore(unsigned int hart = 0, memory::Image &image = memory::memory) : hart(hart), image(image) {}
+
+  // The 16 bits at pc, or 0 when the page of pc may not be executed.
+  unsigned int fetch_half(unsigned int pc) {
+    unsigned int physical;
+    if (!sv32::walk(state.satp, pc, sv32::EXECUTABLE, physical, image)) {
+      return 0;
+    }
+    return to_unsigned(memory::load_data(physical, memory::HALF_WORD_UNSIGNED, image));
+  }
+
+  unsigned int read_register(unsigned int reg) {
+    return reg == 0 ? 0 : state.registers[reg];
+  }
+
+  unsigned int read_csr(unsigned int address) {
+    switch (address) {
+      case csr::FFLAGS:
+        return state.fflags;
+      case csr::FRM:
+        return state.frm;
+      case csr::FCSR:
+        return state.frm << 5 | state.fflags;
+      case csr::SATP:
+        return state.satp;
+      case csr::MHARTID:
+        return hart;
+      default:
+        counters[csr::CYCLES] = state.retired;
+        counters[csr::INSTRUCTIONS_RETIRED] = state.retired;
+        return csr::read_csr(counters, address);
+    }
+  }
+
+  // Do a csr instruction and return the old value, as ReorderBuffer::access_csr does.
+  unsigned int access_csr(Op op, unsigned int address, unsigned int rs1) {
+    address &= 0xfff;
+    auto old = read_csr(address);
+    bool immediate = op == CSRRWI || op == CSRRSI || op == CSRRCI;
+    auto operand = immediate ? rs1 : read_register(rs1);
+    if (rs1 == 0 && op != CSRRW && op != CSRRWI) { // csrrs and csrrc with x0 only read
+      return old;
+    }
+    auto value = op == CSRRW || op == CSRRWI ? operand : op == CSRRS || op == CSRRSI ? old | operand : old & ~operand;
+    if (address == csr::FFLAGS || address == csr::FCSR) {
+      state.fflags = value & 0b11111;
+    }
+    if (address == csr::FRM || address == csr::FCSR) {
+      state.frm = (address == csr::FRM ? value : value >> 5) & 0b111;
+    }
+    if (address == csr::SATP) {
+      state.satp = value;
+    }
+    return old;
+  }
+
+  // Do a load, store or atomic at the virtual address addr, and return the value for rd.
+  unsigned int access_memory(Op op, unsigned int addr, unsigned int value) {
+    auto mode = get_memory_access_mode(op);
+    auto atomic = get_atomic_operation(op);
+    unsigned int need = is_store(op) ? sv32::WRITABLE
+                        : atomic == memory::NOT_ATOMIC || atomic == memory::LOAD_RESERVED
+                        ? sv32::READABLE
+                        : sv32::READABLE | sv32::WRITABLE;
+    unsigned int physical;
+    if (!sv32::walk(state.satp, addr, need, physical, image)) {
+      return 0;
+    }
+    if (is_store(op)) {
+      memory::store_data(physical, value, mode, image);
+      return 0;
+    }
+    if (atomic == memory::NOT_ATOMIC) {
+      return to_unsigned(memory::load_data(physical, mode, image));
+    }
+    bool lost = false;
+    if (atomic == memory::LOAD_RESERVED) {
+      state.reserved = true;
+      state.reservation = physical;
+    } else if (atomic == memory::STORE_CONDITIONAL) {
+      lost = !state.reserved || state.reservation != physical;
+      state.reserved = false;
+    }
+    return memory::atomic_access(physical, value, atomic, lost, image);
+  }
+
+  // Execute the instruction at pc. The halt instruction only stops the hart.
+  StepResult step() {
+    StepResult result{state.pc, 0, {}, 0};
+    auto pc = state.pc;
+    unsigned int code = fetch_half(pc);
+    if (!is_compressed(code)) {
+      code |= fetch_half(pc + 2) << 16;
+    }
+    auto inst = decode_instruction(code);
+    result.code = inst.compressed ? code & 0xffff : code;
+    result.inst = inst;
+    auto op = inst.op;
+    auto imm = inst.immediate;
+    auto next = pc + (inst.compressed ? 2 : 4);
+    if (inst.terminate) {
+      state.halted = true;
+      result.next_pc = pc;
+      return result;
+    }
+    auto a = read_register(inst.rs1), b = read_register(inst.rs2);
+    auto rs1 = static_cast<int>(a), rs2 = static_cast<int>(b);
+    unsigned int value = 0, flags = 0;
+    if (is_branch(op)) {
+      result.taken = execute_alu(op, rs1, rs2, imm, pc, inst.compressed);
+      if (result.taken) {
+        next = pc + imm;
+      }
+    } else if (op == JAL || op == JALR) {
+      value = execute_alu(op, rs1, rs2, imm, pc, inst.compressed);
+      next = op == JAL ? pc + imm : static_cast<unsigned int>(rs1 + imm);
+    } else if (is_multiply(op) || is_divide(op)) {
+      value = execute_multiply_divide(op, rs1, rs2);
+    } else if (is_memory_access(op)) {
+      result.addr = a + imm;
+      value = access_memory(op, result.addr, b);
+    } else if (is_floating_point(op)) {
+      auto rm = static_cast<unsigned int>(imm) & 0b111;
+      if (rm == floating_point::DYNAMIC) {
+        rm = state.frm;
+      }
+      value = floating_point::execute(op, a, b, read_register(rs3(op, imm)), rm, flags);
+      state.fflags |= flags;
+    } else if (is_csr_access(op)) {
+      value = access_csr(op, static_cast<unsigned int>(imm), inst.rs1);
+    } else {
+      value = execute_alu(op, rs1, rs2, imm, pc, inst.compressed);
+    }
+    if (inst.rd != 0 && !is_branch(op) && !is_store(op)) {
+      state.registers[inst.rd] = value;
+    }
+    state.pc = next;
+    state.retired++;
+    result.next_pc = next;
+    return result;
+  }
+};
+
+#endif //RISC_V_FUNCTIONAL_HPP
@@ -0,0 +1,592 @@
+#ifndef RISC_V_IN_ORDER_PIPELINE_HPP
+#define RISC_V_IN_ORDER_PIPELINE_HPP
+
+#include "fetch.hpp"
+#include "alu.hpp"
+#include "floating_point.hpp"
+#include "csr.hpp"
+#include "core.hpp"
+#include "trace.hpp"
+
+struct InOrderPipelineInput {
+  FlagWire fetch_finished;
+  std::array<DataWire, FETCH_BLOCK_WORDS> fetch_block;
+  FlagWire load_finished; // from data cache
+  FlagWire store_finished;
+  DataWire data;
+};
+
+struct InOrderPipelineOutput {
+  Flag fetch_request;
+  Data fetch_addr; // aligned to FETCH_BLOCK_SIZE
+  Flag flushing; // fetch was redirected in last cycle, which cancels the block being fetched
+  Flag load; // to data cache, held until answered
+  Flag store;
+  Data addr;
+  MemoryAccessModeCode mode;
+  AtomicCode atomic; // the load is a memory::AtomicOperation
+  Data store_data;
+  Flag should_return; // the core halted
+  Return return_value;
+  Data satp; // for the TLBs
+};
+
+// An instruction in a pipeline register. Register fields it does not use are x0.
+struct StageLatch {
+  Flag valid;
+  OpCode opcode;
+  RegPos rs1;
+  RegPos rs2;
+  RegPos rd;
+  Data immediate;
+  Data pc;
+  Data next_pc; // where fetch went after this instruction
+  Flag terminate;
+  Flag compressed;
+  Data value; // from execute on: the result; for a csr access, the value of rs1; for a load, store or atomic,
+              // its address; for a branch, whether it is taken
+  FloatFlags flags; // floating-point exceptions, accrued to fflags at write back
+};
+
+struct InOrderPipelineData {
+  Data pc; // of the next instruction to fetch
+  FetchLines lines;
+  Flag line_recent; // the line used last; a new block replaces the other one
+  BranchPredictor predictor; // with dynamic prediction
+  StageLatch decode_latch; // IF/ID
+  StageLatch execute_latch; // ID/EX
+  StageLatch memory_latch; // EX/MEM
+  StageLatch writeback_latch; // MEM/WB
+  ExecuteCycles execute_cycles; // spent so far by the instruction in execute
+  std::array<Data, REGISTER_COUNT> registers;
+  FloatFlags fflags;
+  RoundingMode frm;
+  Flag halted;
+};
+
+// Copy the instruction in from into the next pipeline register. next_pc, value and flags are left to the caller.
+void advance(StageLatch &to, const StageLatch &from) {
+  to.valid.assign(from.valid);
+  to.opcode.assign(from.opcode);
+  to.rs1.assign(from.rs1);
+  to.rs2.assign(from.rs2);
+  to.rd.assign(from.rd);
+  to.immediate.assign(from.immediate);
+  to.pc.assign(from.pc);
+  to.terminate.assign(from.terminate);
+  to.compressed.assign(from.compressed);
+}
+
+// A classic five-stage in-order core, one instruction per stage:
+// fetch (IF) reads the instruction at pc from two fetch lines, decodes it and follows the predicted path;
+// decode (ID) applies static prediction; execute (EX) reads the operands, computes, resolves branches and sends
+// loads and stores to data cache; memory (MEM) is the cycle data cache takes to answer; write back (WB) writes
+// the register and retires.
+// Operands are read in execute from the register file, or forwarded from the two instructions ahead of it.
+// An instruction that needs the value of a load right ahead of it waits a cycle in execute (load-use), and
+// one right behind a csr access waits for it to retire, since it may change frm or its destination.
+// Multiply, divide and floating-point operations hold execute for their configured latency.
+// Data cache takes one request at a time: a load or atomic waits in write back for its value,
+// a store goes on without waiting, and the next access waits in execute until data cache is free again.
+// A mispredicted branch or jalr redirects fetch from execute and drops the two instructions behind it.
+// The halt instruction waits in write back for the last store, then stops the core.
+struct InOrderPipeline : dark::Module<InOrderPipelineInput, InOrderPipelineOutput, InOrderPipelineData> {
+  const unsigned int core; // index of the core among those sharing memory
+  Statistics &statistics; // of the core
+
+  InOrderPipeline(unsigned int core, Statistics &statistics) : core(core), statistics(statistics) {}
+
+  // Continue from state. Called before the first cycle.
+  void start_at(const ArchState &state) {
+    pc.assign(state.pc);
+    for (unsigned int i = 1; i < REGISTER_COUNT; i++) {
+      registers[i].assign(state.registers[i]);
+    }
+    fflags.assign(state.fflags);
+    frm.assign(state.frm);
+    satp.assign(state.satp);
+    sync();
+  }
+
+  static unsigned int length_of(bool compressed) {
+    return compressed ? 2 : 4;
+  }
+
+  // Cycles op spends in execute. The multi-cycle units are not pipelined.
+  static unsigned int latency_of(Op op) {
+    if (is_multiply(op)) {
+      return config.multiply_latency;
+    }
+    if (is_divide(op)) {
+      return config.divide_latency;
+    }
+    if (is_float_divide(op)) {
+      return config.float_divide_latency;
+    }
+    if (is_floating_point(op) && !is_memory_access(op)) {
+      return config.float_latency;
+    }
+    return 1;
+  }
+
+  // Whether op has its value in write back rather than after execute.
+  static bool late_value(Op op) {
+    return is_load(op) || is_atomic(op);
+  }
+
+  static bool immediate_csr(Op op) {
+    return op == CSRRWI || op == CSRRSI || op == CSRRCI;
+  }
+
+  // Whether the request held for data cache is answered in this cycle, or there is none, so that a new one may go.
+  bool port_free() {
+    return (load == false && store == false) || load_finished == true || store_finished == true;
+  }
+
+  void receive_block() {
+    auto line = line_recent == true ? 0 : 1;
+    for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+      lines[line].words[i].assign(fetch_block[i]);
+    }
+    lines[line].addr.assign(fetch_addr);
+    lines[line].valid.assign(true);
+    fetch_request.assign(false);
+  }
+
+  // Ask memory for the block at addr, keeping the line at keep.
+  void request_block(unsigned int addr, unsigned int keep) {
+    if (fetch_request == false && fetch_finished == false) {
+      fetch_request.assign(true);
+      fetch_addr.assign(addr);
+      line_recent.assign(keep);
+    }
+  }
+
+  unsigned int read_half(int line, unsigned int pc) {
+    auto half = read_fetch_half(lines[line], pc);
+    return trace::tracker ? trace::tracker->fetched_half(core * config.smt, pc, half) : half;
+  }
+
+  // Fetch the instruction at pc into decode_latch and move pc to the one predicted after it.
+  // An instruction is 2 or 4 bytes, and may cross into the next block. A missing block is asked for,
+  // and a bubble goes to decode. With hold, decode has not taken the last instruction, so only the block is asked for.
+  void fetch(bool hold) {
+    auto start = to_unsigned(pc);
+    auto aligned = start & ~(FETCH_BLOCK_SIZE - 1);
+    auto line = find_fetch_line(lines, aligned);
+    auto last_line = line;
+    unsigned int code = 0;
+    if (line >= 0) {
+      code = read_half(line, start);
+      if (!is_compressed(code) && start + 2 == aligned + FETCH_BLOCK_SIZE) {
+        last_line = find_fetch_line(lines, aligned + FETCH_BLOCK_SIZE);
+        if (last_line < 0) {
+          request_block(aligned + FETCH_BLOCK_SIZE, line);
+        } else {
+          code |= read_half(last_line, start + 2) << 16;
+        }
+      } else if (!is_compressed(code)) {
+        code |= read_half(line, start + 2) << 16;
+      }
+    } else {
+      request_block(aligned, line_recent == true ? 1 : 0);
+    }
+    if (hold) {
+      return;
+    }
+    if (line < 0 || last_line < 0) {
+      decode_latch.valid.assign(false);
+      statistics.fetch_buffer_empty_cycles++;
+      return;
+    }
+    auto inst = decode_instruction(code);
+    auto next = start + length_of(inst.compressed);
+    if (config.branch_prediction == DYNAMIC_PREDICTION && predictor.predict_taken(start)) {
+      next = to_unsigned(predictor.lookup_btb(start)->target);
+    }
+    decode_latch.valid.assign(true);
+    decode_latch.opcode.assign(inst.op);
+    decode_latch.rs1.assign(inst.rs1);
+    decode_latch.rs2.assign(inst.rs2);
+    decode_latch.rd.assign(inst.rd);
+    decode_latch.immediate.assign(inst.immediate);
+    decode_latch.pc.assign(start);
+    decode_latch.next_pc.assign(next);
+    decode_latch.terminate.assign(inst.terminate);
+    decode_latch.compressed.assign(inst.compressed);
+    if (trace::tracker) {
+      trace::tracker->deliver(core * config.smt, 0, start, inst.op, next != start + length_of(inst.compressed));
+    }
+    pc.assign(next);
+    line_recent.assign(last_line);
+    statistics.front_ends[0].fetched_instructions++;
+    statistics.front_ends[0].delivery_cycles++;
+  }
+
+  // Move the instruction in decode_latch to execute_latch. A jal goes to its target from here when fetch did not,
+  // and so does a backward branch with static prediction. Return whether fetch is redirected, to next.
+  bool decode(unsigned int &next) {
+    const StageLatch &inst = decode_latch;
+    advance(execute_latch, inst);
+    if (inst.valid == false) {
+      return false;
+    }
+    auto op = static_cast<Op>(to_unsigned(inst.opcode));
+    bool taken = op == JAL ||
+                 (config.branch_prediction == STATIC_PREDICTION && is_branch(op) && to_signed(inst.immediate) < 0);
+    next = taken ? to_unsigned(inst.pc + inst.immediate) : to_unsigned(inst.next_pc);
+    execute_latch.next_pc.assign(next);
+    if (next == inst.next_pc) {
+      return false;
+    }
+    statistics.front_ends[0].frontend_redirects++;
+    return true;
+  }
+
+  // Value of register reg for the instruction in execute. The instruction in write back gives written_back.
+  // Return false when the value is that of a load right ahead, which is not there yet.
+  bool read_operand(unsigned int reg, unsigned int written_back, unsigned int &value) {
+    if (reg == 0) {
+      value = 0;
+    } else if (memory_latch.valid == true && memory_latch.rd == reg) {
+      if (late_value(static_cast<Op>(to_unsigned(memory_latch.opcode)))) {
+        return false;
+      }
+      value = to_unsigned(memory_latch.value);
+    } else if (writeback_latch.valid == true && writeback_latch.rd == reg) {
+      value = written_back;
+    } else {
+      value = to_unsigned(registers[reg]);
+    }
+    return true;
+  }
+
+  bool is_csr_latch(const StageLatch &latch) {
+    return latch.valid == true && is_csr_access(static_cast<Op>(to_unsigned(latch.opcode)));
+  }
+
+  // Send a load, store or atomic to data cache.
+  void request(Op op, unsigned int address, unsigned int value) {
+    bool loads = !is_store(op);
+    load.assign(loads);
+    store.assign(!loads);
+    addr.assign(address);
+    mode.assign(get_memory_access_mode(op));
+    atomic.assign(get_atomic_operation(op));
+    store_data.assign(value);
+  }
+
+  // Execute the instruction in execute_latch into memory_latch. Return false when it stays in execute for another
+  // cycle, and a bubble goes on. Set redirected, with the right pc in next, when fetch did not go there after it,
+  // and requested when a memory access is sent.
+  bool execute(unsigned int written_back, bool &redirected, unsigned int &next, bool &requested) {
+    const StageLatch &inst = execute_latch;
+    if (inst.valid == false) {
+      memory_latch.valid.assign(false);
+      return true;
+    }
+    auto op = static_cast<Op>(to_unsigned(inst.opcode));
+    auto imm = to_signed(inst.immediate);
+    std::array<unsigned int, 3> sources{to_unsigned(inst.rs1), to_unsigned(inst.rs2), rs3(op, imm)};
+    std::array<unsigned int, 3> operands{};
+    bool ready = !is_csr_latch(memory_latch) && !is_csr_latch(writeback_latch);
+    for (unsigned int i = 0; i < 3 && ready; i++) {
+      if (!(i == 0 && immediate_csr(op)) && !read_operand(sources[i], written_back, operands[i])) {
+        ready = false;
+        statistics.load_use_stalls++;
+      }
+    }
+    if (ready && is_memory_access(op) && !port_free()) {
+      ready = false;
+      statistics.memory_stalls++;
+    }
+    if (ready && to_unsigned(execute_cycles) + 1 < latency_of(op)) {
+      execute_cycles.assign(execute_cycles + 1);
+      ready = false;
+      statistics.execute_stalls++;
+    }
+    if (!ready) {
+      memory_latch.valid.assign(false);
+      return false;
+    }
+    if (execute_cycles != 0) {
+      execute_cycles.assign(0);
+    }
+    auto rs1 = static_cast<int>(operands[0]), rs2 = static_cast<int>(operands[1]);
+    auto pc_value = to_unsigned(inst.pc);
+    bool compressed = static_cast<bool>(inst.compressed);
+    unsigned int value = 0, flags = 0;
+    next = pc_value + length_of(compressed);
+    if (is_branch(op)) {
+      bool taken = execute_alu(op, rs1, rs2, imm, pc_value, compressed);
+      value = taken;
+      if (taken) {
+        next = pc_value + imm;
+      }
+      bool mispredicted = next != inst.next_pc;
+      statistics.total_predict++;
+      statistics.correct_predict += !mispredicted;
+      if (config.branch_prediction == DYNAMIC_PREDICTION) {
+        predictor.update(pc_value, pc_value + imm, taken, false, mispredicted);
+      }
+    } else if (op == JAL || op == JALR) {
+      value = execute_alu(op, rs1, rs2, imm, pc_value, compressed);
+      next = op == JAL ? pc_value + imm : static_cast<unsigned int>(rs1 + imm);
+      if (op == JAL && config.branch_prediction == DYNAMIC_PREDICTION) {
+        predictor.update(pc_value, next, true, true, false);
+      }
+    } else if (is_multiply(op) || is_divide(op)) {
+      value = execute_multiply_divide(op, rs1, rs2);
+      (is_multiply(op) ? statistics.multiply_operations : statistics.divide_operations)++;
+    } else if (is_memory_access(op)) {
+      value = rs1 + imm;
+      request(op, value, operands[1]);
+      requested = true;
+    } else if (is_floating_point(op)) {
+      auto rm = static_cast<unsigned int>(imm) & 0b111;
+      if (rm == floating_point::DYNAMIC) {
+        rm = to_unsigned(frm);
+      }
+      value = floating_point::execute(op, operands[0], operands[1], operands[2], rm, flags);
+      (is_float_divide(op) ? statistics.float_divide_operations : statistics.float_operations)++;
+    } else if (is_csr_access(op)) {
+      value = operands[0];
+    } else {
+      value = execute_alu(op, rs1, rs2, imm, pc_value, compressed);
+    }
+    advance(memory_latch, inst);
+    memory_latch.value.assign(value);
+    memory_latch.flags.assign(flags);
+    redirected = next != inst.next_pc;
+    return true;
+  }
+
+  unsigned int read_csr(unsigned int address) {
+    switch (address) {
+      case csr::FFLAGS:
+        return to_unsigned(fflags);
+      case csr::FRM:
+        return to_unsigned(frm);
+      case csr::FCSR:
+        return to_unsigned(frm) << 5 | to_unsigned(fflags);
+      case csr::SATP:
+        return to_unsigned(satp);
+      case csr::MHARTID:
+        return core;
+      default:
+        return csr::read_csr(core, address);
+    }
+  }
+
+  // Do a csr instruction and return the old value, as ReorderBuffer::access_csr does.
+  // rs1 is the register field, and operand its value, or the immediate for the I forms.
+  unsigned int access_csr(Op op, unsigned int address, unsigned int rs1, unsigned int operand) {
+    address &= 0xfff;
+    auto old = read_csr(address);
+    if (immediate_csr(op)) {
+      operand = rs1;
+    }
+    if (rs1 == 0 && op != CSRRW && op != CSRRWI) { // csrrs and csrrc with x0 only read
+      return old;
+    }
+    auto value = op == CSRRW || op == CSRRWI ? operand : op == CSRRS || op == CSRRSI ? old | operand : old & ~operand;
+    if (address == csr::FFLAGS || address == csr::FCSR) {
+      fflags.assign(value & 0b11111);
+    }
+    if (address == csr::FRM || address == csr::FCSR) {
+      frm.assign((address == csr::FRM ? value : value >> 5) & 0b111);
+    }
+    if (address == csr::SATP) {
+      satp.assign(value);
+    }
+    return old;
+  }
+
+  // Find the value the instruction in write back writes to its register.
+  // Return false while it waits: a load or atomic for data cache, the halt instruction for the last store.
+  bool write_back(unsigned int &value) {
+    const StageLatch &inst = writeback_latch;
+    if (inst.valid == false) {
+      return true;
+    }
+    auto op = static_cast<Op>(to_unsigned(inst.opcode));
+    if (late_value(op)) {
+      if (load_finished == false) {
+        statistics.memory_stalls++;
+        return false;
+      }
+      value = to_unsigned(data);
+      if (trace::tracker) {
+        value = trace::tracker->written_back(core * config.smt, value);
+      }
+    } else if (inst.terminate == true) {
+      if (!port_free()) {
+        statistics.memory_stalls++;
+        return false;
+      }
+    } else if (is_csr_access(op)) {
+      value = access_csr(op, to_unsigned(inst.immediate), to_unsigned(inst.rs1), to_unsigned(inst.value));
+    } else {
+      value = to_unsigned(inst.value);
+    }
+    return true;
+  }
+
+  // Retire the instruction in write back. Return whether it is the halt instruction.
+  bool retire(unsigned int value) {
+    constexpr unsigned int A0 = 10;
+    const StageLatch &inst = writeback_latch;
+    if (inst.valid == false) {
+      return false;
+    }
+    if (inst.terminate == true) {
+      should_return.assign(true);
+      return_value.assign(to_unsigned(registers[A0]));
+      halted.assign(true);
+      return true;
+    }
+    auto op = static_cast<Op>(to_unsigned(inst.opcode));
+    auto rd = to_unsigned(inst.rd);
+    if (rd != 0) {
+      registers[rd].assign(value);
+    }
+    auto accrued = to_unsigned(inst.flags);
+    if (accrued & ~to_unsigned(fflags)) {
+      fflags.assign(to_unsigned(fflags) | accrued);
+    }
+    statistics.total_committed++;
+    statistics.thread_committed[0]++;
+    if (trace::tracker) {
+      trace::tracker->retire(core * config.smt, to_unsigned(inst.pc),
+                             is_memory_access(op) ? to_unsigned(inst.value) : 0,
+                             is_branch(op) && static_cast<bool>(inst.value), late_value(op), value);
+    }
+    if (is_load(op)) {
+      statistics.committed_loads++;
+    } else if (is_atomic(op)) {
+      statistics.atomic_operations++;
+    }
+    return false;
+  }
+
+  // Drop the request data cache answers in this cycle, unless execute has sent a new one.
+  void release_port(bool requested) {
+    if (requested) {
+      return;
+    }
+    if (load_finished == true) {
+      load.assign(false);
+    }
+    if (store_finished == true) {
+      store.assign(false);
+    }
+  }
+
+  // Stop fetching, and cancel the block being fetched. received: a block was taken in this cycle.
+  void cancel_fetch(bool received) {
+    if (!received && fetch_request == true) {
+      fetch_request.assign(false);
+    }
+  }
+
+  void work() override {
+    if (halted == true) {
+      return;
+    }
+    bool received = fetch_finished == true && flushing == false;
+    if (received) {
+      receive_block();
+    }
+    unsigned int written_back = 0;
+    if (!write_back(written_back)) { // everything waits
+      release_port(false);
+      flushing.assign(false);
+      return;
+    }
+    if (retire(written_back)) {
+      cancel_fetch(received);
+      flushing.assign(true);
+      return;
+    }
+    advance(writeback_latch, memory_latch);
+    writeback_latch.value.assign(memory_latch.value);
+    writeback_latch.flags.assign(memory_latch.flags);
+    bool redirected = false, requested = false;
+    unsigned int next = 0;
+    bool executed = execute(written_back, redirected, next, requested);
+    release_port(requested);
+    if (redirected) { // drop the instructions behind
+      execute_latch.valid.assign(false);
+      decode_latch.valid.assign(false);
+    } else if (executed) {
+      redirected = decode(next);
+      if (redirected) {
+        decode_latch.valid.assign(false);
+      } else {
+        fetch(false);
+      }
+    } else {
+      fetch(true);
+    }
+    if (redirected) {
+      pc.assign(next);
+      cancel_fetch(received);
+    }
+    flushing.assign(redirected);
+  }
+};
+
+// One in-order core: the pipeline, its TLBs and its data cache.
+struct InOrderProcessor : Core {
+  InOrderPipeline pipeline;
+
+  explicit InOrderProcessor(unsigned int core) : pipeline(core, statistics) {
+    data_tlb.load.follow(pipeline.load);
+    data_tlb.store.follow(pipeline.store);
+    data_tlb.addr.follow(pipeline.addr);
+    data_tlb.mode.follow(pipeline.mode);
+    data_tlb.atomic.follow(pipeline.atomic);
+    data_tlb.store_data.follow(pipeline.store_data);
+    data_tlb.flushing = []() { return false; }; // only accesses that retire are sent
+    data_tlb.runahead = []() { return false; };
+    pipeline.load_finished = [&]() { return data_tlb.load_finished(); };
+    pipeline.store_finished = [&]() { return data_tlb.store_finished(); };
+    pipeline.data = [&]() { return data_tlb.data(); };
+    connect_tlbs();
+  }
+
+  FetchPort fetch_port(unsigned int) override {
+    return {pipeline.fetch_finished, pipeline.fetch_block, pipeline.fetch_request, pipeline.fetch_addr};
+  }
+
+  bool flushing(unsigned int) override {
+    return pipeline.flushing == true;
+  }
+
+  unsigned int data_thread() override {
+    return 0;
+  }
+
+  bool halted() override {
+    return pipeline.should_return == true;
+  }
+
+  unsigned int return_value() override {
+    return to_unsigned(pipeline.return_value);
+  }
+
+  unsigned int satp(unsigned int) override {
+    return to_unsigned(pipeline.satp);
+  }
+
+  void start_at(const ArchState &state) override {
+    pipeline.start_at(state);
+  }
+
+  void add_to(dark::CPU &cpu) override {
+    cpu.add_module(&pipeline);
+    add_memory_modules(cpu);
+  }
+};
+
+#endif //RISC_V_IN_ORDER_PIPELINE_HPP
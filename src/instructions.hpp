@@ -46,6 +46,82 @@ namespace instructions {
     SRA,
     OR,
     AND,
+    MUL,
+    MULH,
+    MULHSU,
+    MULHU,
+    DIV,
+    DIVU,
+    REM,
+    REMU,
+    SH1ADD,
+    SH2ADD,
+    SH3ADD,
+    ANDN,
+    ORN,
+    XNOR,
+    CLZ,
+    CTZ,
+    CPOP,
+    MAX,
+    MAXU,
+    MIN,
+    MINU,
+    SEXTB,
+    SEXTH,
+    ZEXTH,
+    ROL,
+    ROR,
+    RORI,
+    ORCB,
+    REV8,
+    CSRRW,
+    CSRRS,
+    CSRRC,
+    CSRRWI,
+    CSRRSI,
+    CSRRCI,
+    FLW,
+    FSW,
+    FMADD,
+    FMSUB,
+    FNMSUB,
+    FNMADD,
+    FADD,
+    FSUB,
+    FMUL,
+    FDIV,
+    FSQRT,
+    FSGNJ,
+    FSGNJN,
+    FSGNJX,
+    FMIN,
+    FMAX,
+    FCVTWS,
+    FCVTWUS,
+    FMVXW,
+    FEQ,
+    FLT,
+    FLE,
+    FCLASS,
+    FCVTSW,
+    FCVTSWU,
+    FMVWX,
+    LR_W,
+    SC_W,
+    AMOSWAP_W,
+    AMOADD_W,
+    AMOXOR_W,
+    AMOAND_W,
+    AMOOR_W,
+    AMOMIN_W,
+    AMOMAX_W,
+    AMOMINU_W,
+    AMOMAXU_W,
+    LUI_ADDI, // instruction pairs merged by fuse(); no word decodes to them
+    AUIPC_JALR,
+    SLLI_ADD,
+    SLLI_SRLI,
     UNKNOWN // for invalid instructions
   };
 
@@ -53,6 +129,7 @@ namespace instructions {
     R,
     I1,
     I2,
+    R4, // fused multiply-add, with a third source register
     S,
     B,
     U,
@@ -62,216 +139,650 @@ namespace instructions {
   constexpr Word NO_OPERATION = 0b0010011; // ADDI x0, x0, 0
   constexpr Word TERMINATION = 0x0ff00513;
 
-  Op decode(Word word) {
-    auto opcode = to_unsigned(word.range<6, 0>());
-    auto funct3 = to_unsigned(word.range<14, 12>());
-    auto funct7 = to_unsigned(word.range<31, 25>());
-    switch (opcode) {
-      case 0b0110111:
-        return LUI;
-      case 0b0010111:
-        return AUIPC;
-      case 0b1101111:
-        return JAL;
-      case 0b1100111:
-        return JALR;
-      case 0b1100011:
-        switch (funct3) {
-          case 0b000:
-            return BEQ;
-          case 0b001:
-            return BNE;
-          case 0b100:
-            return BLT;
-          case 0b101:
-            return BGE;
-          case 0b110:
-            return BLTU;
-          case 0b111:
-            return BGEU;
-          default:
-            return UNKNOWN;
+  // Fields of a decoded instruction. Register fields that the instruction does not use are x0.
+  // Floating-point instructions keep their rounding mode in immediate; fused multiply-add keeps its
+  // third source register above it, see rs3().
+  struct DecodedInstruction {
+    Op op;
+    unsigned int rs1;
+    unsigned int rs2;
+    unsigned int rd;
+    int immediate;
+    bool terminate;
+    bool compressed; // a 16-bit instruction, so the next one is at pc + 2; for a fused pair, its second one
+  };
+
+  // Which unit executes an instruction, and how the back end treats it.
+  enum OpClass {
+    INTEGER, // one of the ALUs
+    BRANCH,
+    JUMP,
+    LOAD,
+    STORE,
+    MULTIPLY,
+    DIVIDE,
+    FLOAT, // the floating-point unit
+    FLOAT_DIVIDE, // the floating-point divide and square root unit
+    CSR_ACCESS, // done by the reorder buffer
+    ATOMIC // done by memory, when the instruction is at head of the reorder buffer
+  };
+
+  // An instruction is recognized by (word & mask) == match.
+  struct Encoding {
+    unsigned int match;
+    unsigned int mask;
+  };
+
+  struct InstructionInfo {
+    Op op;
+    Encoding encoding;
+    OpType type;
+    OpClass op_class;
+    memory::MemoryAccessMode mode; // for loads and stores
+  };
+
+  constexpr Encoding opcode_only(unsigned int opcode) {
+    return {opcode, 0x7f};
+  }
+
+  constexpr Encoding with_funct3(unsigned int opcode, unsigned int funct3) {
+    return {funct3 << 12 | opcode, 0x707f};
+  }
+
+  constexpr Encoding with_funct7(unsigned int opcode, unsigned int funct3, unsigned int funct7) {
+    return {funct7 << 25 | funct3 << 12 | opcode, 0xfe00707f};
+  }
+
+  // The rs2 field selects the instruction, e.g. clz and ctz.
+  constexpr Encoding with_rs2(unsigned int opcode, unsigned int funct3, unsigned int funct7, unsigned int rs2) {
+    return {funct7 << 25 | rs2 << 20 | funct3 << 12 | opcode, 0xfff0707f};
+  }
+
+  // Floating-point instructions whose funct3 is the rounding mode.
+  constexpr Encoding any_rounding(unsigned int funct7) {
+    return {funct7 << 25 | 0b1010011, 0xfe00007f};
+  }
+
+  constexpr Encoding any_rounding(unsigned int funct7, unsigned int rs2) {
+    return {funct7 << 25 | rs2 << 20 | 0b1010011, 0xfff0007f};
+  }
+
+  // Fused multiply-add, with format 00 for single precision.
+  constexpr Encoding fused(unsigned int opcode) {
+    return {opcode, 0x0600007f};
+  }
+
+  // Instructions of the A extension. The aq and rl bits are not checked: atomics are done in program order anyway.
+  constexpr Encoding atomic(unsigned int funct5) {
+    return {funct5 << 27 | 0b010 << 12 | 0b0101111, 0xf800707f};
+  }
+
+  constexpr Encoding atomic(unsigned int funct5, unsigned int rs2) {
+    return {funct5 << 27 | rs2 << 20 | 0b010 << 12 | 0b0101111, 0xf9f0707f};
+  }
+
+  // Encoding of the fused pairs, which the decode tables leave out.
+  constexpr Encoding FUSED_PAIR = {0, 0};
+
+  constexpr memory::MemoryAccessMode NO_ACCESS = memory::WORD; // mode of instructions that do not access memory
+
+  // Every instruction, in the order of Op.
+  constexpr std::array<InstructionInfo, UNKNOWN> INSTRUCTION_SET = {{
+    {LUI, opcode_only(0b0110111), U, INTEGER, NO_ACCESS},
+    {AUIPC, opcode_only(0b0010111), U, INTEGER, NO_ACCESS},
+    {JAL, opcode_only(0b1101111), J, JUMP, NO_ACCESS},
+    {JALR, opcode_only(0b1100111), I1, JUMP, NO_ACCESS}, // funct3 is not checked
+    {BEQ, with_funct3(0b1100011, 0b000), B, BRANCH, NO_ACCESS},
+    {BNE, with_funct3(0b1100011, 0b001), B, BRANCH, NO_ACCESS},
+    {BLT, with_funct3(0b1100011, 0b100), B, BRANCH, NO_ACCESS},
+    {BGE, with_funct3(0b1100011, 0b101), B, BRANCH, NO_ACCESS},
+    {BLTU, with_funct3(0b1100011, 0b110), B, BRANCH, NO_ACCESS},
+    {BGEU, with_funct3(0b1100011, 0b111), B, BRANCH, NO_ACCESS},
+    {LB, with_funct3(0b0000011, 0b000), I1, LOAD, memory::BYTE},
+    {LH, with_funct3(0b0000011, 0b001), I1, LOAD, memory::HALF_WORD},
+    {LW, with_funct3(0b0000011, 0b010), I1, LOAD, memory::WORD},
+    {LBU, with_funct3(0b0000011, 0b100), I1, LOAD, memory::BYTE_UNSIGNED},
+    {LHU, with_funct3(0b0000011, 0b101), I1, LOAD, memory::HALF_WORD_UNSIGNED},
+    {SB, with_funct3(0b0100011, 0b000), S, STORE, memory::BYTE},
+    {SH, with_funct3(0b0100011, 0b001), S, STORE, memory::HALF_WORD},
+    {SW, with_funct3(0b0100011, 0b010), S, STORE, memory::WORD},
+    {ADDI, with_funct3(0b0010011, 0b000), I1, INTEGER, NO_ACCESS},
+    {SLTI, with_funct3(0b0010011, 0b010), I1, INTEGER, NO_ACCESS},
+    {SLTIU, with_funct3(0b0010011, 0b011), I1, INTEGER, NO_ACCESS},
+    {XORI, with_funct3(0b0010011, 0b100), I1, INTEGER, NO_ACCESS},
+    {ORI, with_funct3(0b0010011, 0b110), I1, INTEGER, NO_ACCESS},
+    {ANDI, with_funct3(0b0010011, 0b111), I1, INTEGER, NO_ACCESS},
+    {SLLI, with_funct7(0b0010011, 0b001, 0b0000000), I2, INTEGER, NO_ACCESS},
+    {SRLI, with_funct7(0b0010011, 0b101, 0b0000000), I2, INTEGER, NO_ACCESS},
+    {SRAI, with_funct7(0b0010011, 0b101, 0b0100000), I2, INTEGER, NO_ACCESS},
+    {ADD, with_funct7(0b0110011, 0b000, 0b0000000), R, INTEGER, NO_ACCESS},
+    {SUB, with_funct7(0b0110011, 0b000, 0b0100000), R, INTEGER, NO_ACCESS},
+    {SLL, with_funct7(0b0110011, 0b001, 0b0000000), R, INTEGER, NO_ACCESS},
+    {SLT, with_funct7(0b0110011, 0b010, 0b0000000), R, INTEGER, NO_ACCESS},
+    {SLTU, with_funct7(0b0110011, 0b011, 0b0000000), R, INTEGER, NO_ACCESS},
+    {XOR, with_funct7(0b0110011, 0b100, 0b0000000), R, INTEGER, NO_ACCESS},
+    {SRL, with_funct7(0b0110011, 0b101, 0b0000000), R, INTEGER, NO_ACCESS},
+    {SRA, with_funct7(0b0110011, 0b101, 0b0100000), R, INTEGER, NO_ACCESS},
+    {OR, with_funct7(0b0110011, 0b110, 0b0000000), R, INTEGER, NO_ACCESS},
+    {AND, with_funct7(0b0110011, 0b111, 0b0000000), R, INTEGER, NO_ACCESS},
+    {MUL, with_funct7(0b0110011, 0b000, 0b0000001), R, MULTIPLY, NO_ACCESS},
+    {MULH, with_funct7(0b0110011, 0b001, 0b0000001), R, MULTIPLY, NO_ACCESS},
+    {MULHSU, with_funct7(0b0110011, 0b010, 0b0000001), R, MULTIPLY, NO_ACCESS},
+    {MULHU, with_funct7(0b0110011, 0b011, 0b0000001), R, MULTIPLY, NO_ACCESS},
+    {DIV, with_funct7(0b0110011, 0b100, 0b0000001), R, DIVIDE, NO_ACCESS},
+    {DIVU, with_funct7(0b0110011, 0b101, 0b0000001), R, DIVIDE, NO_ACCESS},
+    {REM, with_funct7(0b0110011, 0b110, 0b0000001), R, DIVIDE, NO_ACCESS},
+    {REMU, with_funct7(0b0110011, 0b111, 0b0000001), R, DIVIDE, NO_ACCESS},
+    {SH1ADD, with_funct7(0b0110011, 0b010, 0b0010000), R, INTEGER, NO_ACCESS},
+    {SH2ADD, with_funct7(0b0110011, 0b100, 0b0010000), R, INTEGER, NO_ACCESS},
+    {SH3ADD, with_funct7(0b0110011, 0b110, 0b0010000), R, INTEGER, NO_ACCESS},
+    {ANDN, with_funct7(0b0110011, 0b111, 0b0100000), R, INTEGER, NO_ACCESS},
+    {ORN, with_funct7(0b0110011, 0b110, 0b0100000), R, INTEGER, NO_ACCESS},
+    {XNOR, with_funct7(0b0110011, 0b100, 0b0100000), R, INTEGER, NO_ACCESS},
+    {CLZ, with_rs2(0b0010011, 0b001, 0b0110000, 0b00000), I2, INTEGER, NO_ACCESS},
+    {CTZ, with_rs2(0b0010011, 0b001, 0b0110000, 0b00001), I2, INTEGER, NO_ACCESS},
+    {CPOP, with_rs2(0b0010011, 0b001, 0b0110000, 0b00010), I2, INTEGER, NO_ACCESS},
+    {MAX, with_funct7(0b0110011, 0b110, 0b0000101), R, INTEGER, NO_ACCESS},
+    {MAXU, with_funct7(0b0110011, 0b111, 0b0000101), R, INTEGER, NO_ACCESS},
+    {MIN, with_funct7(0b0110011, 0b100, 0b0000101), R, INTEGER, NO_ACCESS},
+    {MINU, with_funct7(0b0110011, 0b101, 0b0000101), R, INTEGER, NO_ACCESS},
+    {SEXTB, with_rs2(0b0010011, 0b001, 0b0110000, 0b00100), I2, INTEGER, NO_ACCESS},
+    {SEXTH, with_rs2(0b0010011, 0b001, 0b0110000, 0b00101), I2, INTEGER, NO_ACCESS},
+    {ZEXTH, with_rs2(0b0110011, 0b100, 0b0000100, 0b00000), R, INTEGER, NO_ACCESS},
+    {ROL, with_funct7(0b0110011, 0b001, 0b0110000), R, INTEGER, NO_ACCESS},
+    {ROR, with_funct7(0b0110011, 0b101, 0b0110000), R, INTEGER, NO_ACCESS},
+    {RORI, with_funct7(0b0010011, 0b101, 0b0110000), I2, INTEGER, NO_ACCESS},
+    {ORCB, with_rs2(0b0010011, 0b101, 0b0010100, 0b00111), I2, INTEGER, NO_ACCESS},
+    {REV8, with_rs2(0b0010011, 0b101, 0b0110100, 0b11000), I2, INTEGER, NO_ACCESS},
+    {CSRRW, with_funct3(0b1110011, 0b001), I1, CSR_ACCESS, NO_ACCESS},
+    {CSRRS, with_funct3(0b1110011, 0b010), I1, CSR_ACCESS, NO_ACCESS},
+    {CSRRC, with_funct3(0b1110011, 0b011), I1, CSR_ACCESS, NO_ACCESS},
+    {CSRRWI, with_funct3(0b1110011, 0b101), I1, CSR_ACCESS, NO_ACCESS}, // rs1 is a 5-bit immediate here
+    {CSRRSI, with_funct3(0b1110011, 0b110), I1, CSR_ACCESS, NO_ACCESS},
+    {CSRRCI, with_funct3(0b1110011, 0b111), I1, CSR_ACCESS, NO_ACCESS},
+    {FLW, with_funct3(0b0000111, 0b010), I1, LOAD, memory::WORD},
+    {FSW, with_funct3(0b0100111, 0b010), S, STORE, memory::WORD},
+    {FMADD, fused(0b1000011), R4, FLOAT, NO_ACCESS},
+    {FMSUB, fused(0b1000111), R4, FLOAT, NO_ACCESS},
+    {FNMSUB, fused(0b1001011), R4, FLOAT, NO_ACCESS},
+    {FNMADD, fused(0b1001111), R4, FLOAT, NO_ACCESS},
+    {FADD, any_rounding(0b0000000), R, FLOAT, NO_ACCESS},
+    {FSUB, any_rounding(0b0000100), R, FLOAT, NO_ACCESS},
+    {FMUL, any_rounding(0b0001000), R, FLOAT, NO_ACCESS},
+    {FDIV, any_rounding(0b0001100), R, FLOAT_DIVIDE, NO_ACCESS},
+    {FSQRT, any_rounding(0b0101100, 0b00000), R, FLOAT_DIVIDE, NO_ACCESS},
+    {FSGNJ, with_funct7(0b1010011, 0b000, 0b0010000), R, FLOAT, NO_ACCESS},
+    {FSGNJN, with_funct7(0b1010011, 0b001, 0b0010000), R, FLOAT, NO_ACCESS},
+    {FSGNJX, with_funct7(0b1010011, 0b010, 0b0010000), R, FLOAT, NO_ACCESS},
+    {FMIN, with_funct7(0b1010011, 0b000, 0b0010100), R, FLOAT, NO_ACCESS},
+    {FMAX, with_funct7(0b1010011, 0b001, 0b0010100), R, FLOAT, NO_ACCESS},
+    {FCVTWS, any_rounding(0b1100000, 0b00000), R, FLOAT, NO_ACCESS},
+    {FCVTWUS, any_rounding(0b1100000, 0b00001), R, FLOAT, NO_ACCESS},
+    {FMVXW, with_rs2(0b1010011, 0b000, 0b1110000, 0b00000), R, FLOAT, NO_ACCESS},
+    {FEQ, with_funct7(0b1010011, 0b010, 0b1010000), R, FLOAT, NO_ACCESS},
+    {FLT, with_funct7(0b1010011, 0b001, 0b1010000), R, FLOAT, NO_ACCESS},
+    {FLE, with_funct7(0b1010011, 0b000, 0b1010000), R, FLOAT, NO_ACCESS},
+    {FCLASS, with_rs2(0b1010011, 0b001, 0b1110000, 0b00000), R, FLOAT, NO_ACCESS},
+    {FCVTSW, any_rounding(0b1101000, 0b00000), R, FLOAT, NO_ACCESS},
+    {FCVTSWU, any_rounding(0b1101000, 0b00001), R, FLOAT, NO_ACCESS},
+    {FMVWX, with_rs2(0b1010011, 0b000, 0b1111000, 0b00000), R, FLOAT, NO_ACCESS},
+    {LR_W, atomic(0b00010, 0b00000), R, ATOMIC, memory::WORD},
+    {SC_W, atomic(0b00011), R, ATOMIC, memory::WORD},
+    {AMOSWAP_W, atomic(0b00001), R, ATOMIC, memory::WORD},
+    {AMOADD_W, atomic(0b00000), R, ATOMIC, memory::WORD},
+    {AMOXOR_W, atomic(0b00100), R, ATOMIC, memory::WORD},
+    {AMOAND_W, atomic(0b01100), R, ATOMIC, memory::WORD},
+    {AMOOR_W, atomic(0b01000), R, ATOMIC, memory::WORD},
+    {AMOMIN_W, atomic(0b10000), R, ATOMIC, memory::WORD},
+    {AMOMAX_W, atomic(0b10100), R, ATOMIC, memory::WORD},
+    {AMOMINU_W, atomic(0b11000), R, ATOMIC, memory::WORD},
+    {AMOMAXU_W, atomic(0b11100), R, ATOMIC, memory::WORD},
+    {LUI_ADDI, FUSED_PAIR, U, INTEGER, NO_ACCESS},
+    {AUIPC_JALR, FUSED_PAIR, J, JUMP, NO_ACCESS},
+    {SLLI_ADD, FUSED_PAIR, R, INTEGER, NO_ACCESS},
+    {SLLI_SRLI, FUSED_PAIR, I2, INTEGER, NO_ACCESS},
+  }};
+
+  constexpr bool in_op_order() {
+    for (unsigned int i = 0; i < UNKNOWN; i++) {
+      if (INSTRUCTION_SET[i].op != i) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static_assert(in_op_order(), "INSTRUCTION_SET must list every Op in order");
+
+  // Lookup tables generated from INSTRUCTION_SET. The primary table is indexed by opcode and funct3;
+  // where that is not enough, an entry names a secondary table indexed by funct7, and then a tertiary
+  // table indexed by rs2. An entry is an Op, UNKNOWN, or TABLE_REFERENCE + the index of a table.
+  constexpr unsigned int TABLE_REFERENCE = UNKNOWN + 1;
+  constexpr unsigned int PRIMARY_BITS = 0x0000707f; // opcode and funct3
+  constexpr unsigned int SECONDARY_BITS = PRIMARY_BITS | 0xfe000000; // ... and funct7
+  constexpr unsigned int TERTIARY_BITS = SECONDARY_BITS | 0x01f00000; // ... and rs2
+
+  struct DecodeTables {
+    std::array<unsigned char, 1 << 8> primary{};
+    std::array<std::array<unsigned char, 1 << 7>, 32> secondary{};
+    std::array<std::array<unsigned char, 1 << 5>, 32> tertiary{};
+  };
+
+  // How many instructions agree with word on the bits in known. first receives the first of them.
+  constexpr unsigned int count_candidates(unsigned int word, unsigned int known, unsigned int &first) {
+    unsigned int count = 0;
+    for (auto &info: INSTRUCTION_SET) {
+      if (info.encoding.mask == 0) {
+        continue; // a fused pair
+      }
+      auto mask = info.encoding.mask & known;
+      if ((word & mask) == (info.encoding.match & mask) && count++ == 0) {
+        first = info.op;
+      }
+    }
+    return count;
+  }
+
+  constexpr DecodeTables build_decode_tables() {
+    DecodeTables tables;
+    unsigned int secondary_count = 0, tertiary_count = 0, op = UNKNOWN;
+    for (unsigned int cell = 0; cell < tables.primary.size(); cell++) {
+      unsigned int word = (cell & 0b111) << 12 | (cell >> 3) << 2 | 0b11;
+      auto count = count_candidates(word, PRIMARY_BITS, op);
+      if (count <= 1) {
+        tables.primary[cell] = count ? op : static_cast<unsigned int>(UNKNOWN);
+        continue;
+      }
+      if (secondary_count == tables.secondary.size()) {
+        throw "too many secondary decode tables";
+      }
+      auto &secondary = tables.secondary[secondary_count];
+      tables.primary[cell] = TABLE_REFERENCE + secondary_count++;
+      for (unsigned int funct7 = 0; funct7 < secondary.size(); funct7++) {
+        unsigned int word7 = word | funct7 << 25;
+        count = count_candidates(word7, SECONDARY_BITS, op);
+        if (count <= 1) {
+          secondary[funct7] = count ? op : static_cast<unsigned int>(UNKNOWN);
+          continue;
         }
-      case 0b0000011:
-        switch (funct3) {
-          case 0b000:
-            return LB;
-          case 0b001:
-            return LH;
-          case 0b010:
-            return LW;
-          case 0b100:
-            return LBU;
-          case 0b101:
-            return LHU;
-          default:
-            return UNKNOWN;
+        if (tertiary_count == tables.tertiary.size()) {
+          throw "too many tertiary decode tables";
         }
-      case 0b0100011:
-        switch (funct3) {
-          case 0b000:
-            return SB;
-          case 0b001:
-            return SH;
-          case 0b010:
-            return SW;
-          default:
-            return UNKNOWN;
+        auto &tertiary = tables.tertiary[tertiary_count];
+        secondary[funct7] = TABLE_REFERENCE + tertiary_count++;
+        for (unsigned int rs2 = 0; rs2 < tertiary.size(); rs2++) {
+          count = count_candidates(word7 | rs2 << 20, TERTIARY_BITS, op);
+          if (count > 1) {
+            throw "instructions that opcode, funct3, funct7 and rs2 cannot tell apart";
+          }
+          tertiary[rs2] = count ? op : static_cast<unsigned int>(UNKNOWN);
         }
-      case 0b0010011:
-        switch (funct3) {
-          case 0b000:
-            return ADDI;
-          case 0b010:
-            return SLTI;
-          case 0b011:
-            return SLTIU;
-          case 0b100:
-            return XORI;
-          case 0b110:
-            return ORI;
-          case 0b111:
-            return ANDI;
-          case 0b001:
-            return funct7 == 0b0000000 ? SLLI : UNKNOWN;
-          case 0b101:
-            return funct7 == 0b0000000 ? SRLI : funct7 == 0b0100000 ? SRAI : UNKNOWN;
-          default:
-            return UNKNOWN;
+      }
+    }
+    return tables;
+  }
+
+  constexpr DecodeTables DECODE_TABLES = build_decode_tables();
+
+  Op decode(Word word) {
+    auto code = to_unsigned(word);
+    unsigned int entry = DECODE_TABLES.primary[(code >> 12 & 0b111) | (code >> 2 & 0b11111) << 3];
+    if (entry >= TABLE_REFERENCE) {
+      entry = DECODE_TABLES.secondary[entry - TABLE_REFERENCE][code >> 25];
+    }
+    if (entry >= TABLE_REFERENCE) {
+      entry = DECODE_TABLES.tertiary[entry - TABLE_REFERENCE][code >> 20 & 0b11111];
+    }
+    if (entry == UNKNOWN || (code & INSTRUCTION_SET[entry].encoding.mask) != INSTRUCTION_SET[entry].encoding.match) {
+      return UNKNOWN; // the bits no table looked at do not fit
+    }
+    return static_cast<Op>(entry);
+  }
+
+  OpType get_op_type(Op op) {
+    return INSTRUCTION_SET[op].type;
+  }
+
+  OpClass get_op_class(Op op) {
+    return INSTRUCTION_SET[op].op_class;
+  }
+
+  bool is_branch(Op op) {
+    return get_op_class(op) == BRANCH;
+  }
+
+  bool is_load(Op op) {
+    return get_op_class(op) == LOAD;
+  }
+
+  bool is_store(Op op) {
+    return get_op_class(op) == STORE;
+  }
+
+  // Instructions executed by the multiplier.
+  bool is_multiply(Op op) {
+    return get_op_class(op) == MULTIPLY;
+  }
+
+  // Instructions executed by the divider.
+  bool is_divide(Op op) {
+    return get_op_class(op) == DIVIDE;
+  }
+
+  // Instructions executed by the floating-point divide and square root unit; the rest of F goes to the
+  // floating-point unit.
+  bool is_float_divide(Op op) {
+    return get_op_class(op) == FLOAT_DIVIDE;
+  }
+
+  // Macro-ops made by fuse() from two instructions.
+  bool is_fused(Op op) {
+    return INSTRUCTION_SET[op].encoding.mask == 0;
+  }
+
+  // Jumps whose target is pc + immediate, known at decode: jal, and auipc fused with jalr.
+  bool is_direct_jump(Op op) {
+    return op == JAL || op == AUIPC_JALR;
+  }
+
+  // Instructions of the A extension. They go to load/store buffer, but wait for the reorder buffer like stores.
+  bool is_atomic(Op op) {
+    return get_op_class(op) == ATOMIC;
+  }
+
+  static_assert(AMOMAXU_W - LR_W == memory::AMO_MAXU - memory::LOAD_RESERVED, "atomics must be listed in the same order");
+
+  memory::AtomicOperation get_atomic_operation(Op op) {
+    return is_atomic(op) ? static_cast<memory::AtomicOperation>(op - LR_W + memory::LOAD_RESERVED) : memory::NOT_ATOMIC;
+  }
+
+  bool is_memory_access(Op op) {
+    return is_load(op) || is_store(op) || is_atomic(op);
+  }
+
+  // Zicsr instructions. The csr address is the immediate.
+  bool is_csr_access(Op op) {
+    return get_op_class(op) == CSR_ACCESS;
+  }
+
+  // Instructions of the F extension, loads and stores included.
+  bool is_floating_point(Op op) {
+    return get_op_class(op) == FLOAT || get_op_class(op) == FLOAT_DIVIDE || op == FLW || op == FSW;
+  }
+
+  memory::MemoryAccessMode get_memory_access_mode(Op op) {
+    if (!is_memory_access(op)) {
+      throw std::invalid_argument("Invalid memory access mode.");
+    }
+    return INSTRUCTION_SET[op].mode;
+  }
+
+  // Whether the instruction whose low half is given is 16-bit.
+  bool is_compressed(unsigned int low_half) {
+    return (low_half & 0b11) != 0b11;
+  }
+
+  // Expand a 16-bit RV32C instruction into the 32-bit instruction it stands for.
+  // Reserved encodings and the double-precision loads and stores become 0, which decodes as UNKNOWN.
+  unsigned int expand_compressed(unsigned int half) {
+    auto bits = [half](unsigned int hi, unsigned int lo) { return (half >> lo) & ((1u << (hi - lo + 1)) - 1); };
+    auto sign_extend = [](unsigned int value, unsigned int width) {
+      return static_cast<unsigned int>(static_cast<int>(value << (32 - width)) >> (32 - width));
+    };
+    auto r_type = [](unsigned int funct7, unsigned int rs2, unsigned int rs1, unsigned int funct3, unsigned int rd) {
+      return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | 0b0110011;
+    };
+    auto i_type = [](unsigned int imm, unsigned int rs1, unsigned int funct3, unsigned int rd, unsigned int opcode) {
+      return (imm & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+    };
+    auto s_type = [](unsigned int imm, unsigned int rs2, unsigned int rs1, unsigned int opcode) {
+      return (imm >> 5) << 25 | rs2 << 20 | rs1 << 15 | 0b010 << 12 | (imm & 0b11111) << 7 | opcode;
+    };
+    auto b_type = [](unsigned int imm, unsigned int rs1, unsigned int funct3) {
+      return (imm >> 12 & 1) << 31 | (imm >> 5 & 0b111111) << 25 | rs1 << 15 | funct3 << 12 |
+             (imm >> 1 & 0b1111) << 8 | (imm >> 11 & 1) << 7 | 0b1100011;
+    };
+    auto j_type = [](unsigned int imm, unsigned int rd) {
+      return (imm >> 20 & 1) << 31 | (imm >> 1 & 0x3ff) << 21 | (imm >> 11 & 1) << 20 | (imm >> 12 & 0xff) << 12 |
+             rd << 7 | 0b1101111;
+    };
+    auto rd = bits(11, 7), rs2 = bits(6, 2);
+    auto rd_prime = bits(4, 2) + 8, rs1_prime = bits(9, 7) + 8;
+    auto imm6 = sign_extend(bits(12, 12) << 5 | bits(6, 2), 6);
+    auto shamt = bits(6, 2);
+    auto jump_offset = sign_extend(bits(12, 12) << 11 | bits(11, 11) << 4 | bits(10, 9) << 8 | bits(8, 8) << 10 |
+                                   bits(7, 7) << 6 | bits(6, 6) << 7 | bits(5, 3) << 1 | bits(2, 2) << 5, 12);
+    auto branch_offset = sign_extend(bits(12, 12) << 8 | bits(11, 10) << 3 | bits(6, 5) << 6 | bits(4, 3) << 1 |
+                                     bits(2, 2) << 5, 9);
+    auto word_offset = bits(12, 10) << 3 | bits(6, 6) << 2 | bits(5, 5) << 6; // c.lw and c.sw
+    switch (bits(1, 0) << 3 | bits(15, 13)) {
+      case 0b00000: { // c.addi4spn
+        auto imm = bits(12, 11) << 4 | bits(10, 7) << 6 | bits(6, 6) << 2 | bits(5, 5) << 3;
+        return imm == 0 ? 0 : i_type(imm, 2, 0b000, rd_prime, 0b0010011);
+      }
+      case 0b00010: // c.lw
+        return i_type(word_offset, rs1_prime, 0b010, rd_prime, 0b0000011);
+      case 0b00011: // c.flw
+        return i_type(word_offset, rs1_prime, 0b010, rd_prime, 0b0000111);
+      case 0b00110: // c.sw
+        return s_type(word_offset, rd_prime, rs1_prime, 0b0100011);
+      case 0b00111: // c.fsw
+        return s_type(word_offset, rd_prime, rs1_prime, 0b0100111);
+      case 0b01000: // c.addi, c.nop
+        return i_type(imm6, rd, 0b000, rd, 0b0010011);
+      case 0b01001: // c.jal
+        return j_type(jump_offset, 1);
+      case 0b01010: // c.li
+        return i_type(imm6, 0, 0b000, rd, 0b0010011);
+      case 0b01011:
+        if (rd == 2) { // c.addi16sp
+          auto imm = sign_extend(bits(12, 12) << 9 | bits(6, 6) << 4 | bits(5, 5) << 6 | bits(4, 3) << 7 |
+                                 bits(2, 2) << 5, 10);
+          return imm == 0 ? 0 : i_type(imm, 2, 0b000, 2, 0b0010011);
         }
-      case 0b0110011:
-        switch (funct3) {
-          case 0b000:
-            return funct7 == 0b0000000 ? ADD : funct7 == 0b0100000 ? SUB : UNKNOWN;
-          case 0b001:
-            return funct7 == 0b0000000 ? SLL : UNKNOWN;
-          case 0b010:
-            return funct7 == 0b0000000 ? SLT : UNKNOWN;
-          case 0b011:
-            return funct7 == 0b0000000 ? SLTU : UNKNOWN;
-          case 0b100:
-            return funct7 == 0b0000000 ? XOR : UNKNOWN;
-          case 0b101:
-            return funct7 == 0b0000000 ? SRL : funct7 == 0b0100000 ? SRA : UNKNOWN;
-          case 0b110:
-            return funct7 == 0b0000000 ? OR : UNKNOWN;
-          case 0b111:
-            return funct7 == 0b0000000 ? AND : UNKNOWN;
+        return imm6 == 0 ? 0 : (imm6 << 12) | rd << 7 | 0b0110111; // c.lui
+      case 0b01100:
+        switch (bits(11, 10)) {
+          case 0b00: // c.srli
+            return bits(12, 12) ? 0 : i_type(shamt, rs1_prime, 0b101, rs1_prime, 0b0010011);
+          case 0b01: // c.srai
+            return bits(12, 12) ? 0 : i_type(0b0100000 << 5 | shamt, rs1_prime, 0b101, rs1_prime, 0b0010011);
+          case 0b10: // c.andi
+            return i_type(imm6, rs1_prime, 0b111, rs1_prime, 0b0010011);
           default:
-            return UNKNOWN;
+            if (bits(12, 12)) {
+              return 0;
+            }
+            switch (bits(6, 5)) {
+              case 0b00: // c.sub
+                return r_type(0b0100000, rd_prime, rs1_prime, 0b000, rs1_prime);
+              case 0b01: // c.xor
+                return r_type(0, rd_prime, rs1_prime, 0b100, rs1_prime);
+              case 0b10: // c.or
+                return r_type(0, rd_prime, rs1_prime, 0b110, rs1_prime);
+              default: // c.and
+                return r_type(0, rd_prime, rs1_prime, 0b111, rs1_prime);
+            }
         }
+      case 0b01101: // c.j
+        return j_type(jump_offset, 0);
+      case 0b01110: // c.beqz
+        return b_type(branch_offset, rs1_prime, 0b000);
+      case 0b01111: // c.bnez
+        return b_type(branch_offset, rs1_prime, 0b001);
+      case 0b10000: // c.slli
+        return bits(12, 12) ? 0 : i_type(shamt, rd, 0b001, rd, 0b0010011);
+      case 0b10010: // c.lwsp
+        return rd == 0 ? 0 : i_type(bits(12, 12) << 5 | bits(6, 4) << 2 | bits(3, 2) << 6, 2, 0b010, rd, 0b0000011);
+      case 0b10011: // c.flwsp
+        return i_type(bits(12, 12) << 5 | bits(6, 4) << 2 | bits(3, 2) << 6, 2, 0b010, rd, 0b0000111);
+      case 0b10100:
+        if (bits(12, 12) == 0) {
+          if (rs2 == 0) { // c.jr
+            return rd == 0 ? 0 : i_type(0, rd, 0b000, 0, 0b1100111);
+          }
+          return r_type(0, rs2, 0, 0b000, rd); // c.mv
+        }
+        if (rs2 == 0) { // c.jalr, or c.ebreak when rd is 0
+          return rd == 0 ? 0 : i_type(0, rd, 0b000, 1, 0b1100111);
+        }
+        return r_type(0, rs2, rd, 0b000, rd); // c.add
+      case 0b10110: // c.swsp
+        return s_type(bits(12, 9) << 2 | bits(8, 7) << 6, rs2, 2, 0b0100011);
+      case 0b10111: // c.fswsp
+        return s_type(bits(12, 9) << 2 | bits(8, 7) << 6, rs2, 2, 0b0100111);
       default:
-        return UNKNOWN;
+        return 0;
     }
   }
 
-  OpType get_op_type(Op op) {
-    switch (op) {
-      case LUI:
-      case AUIPC:
-        return U;
-      case JAL:
-        return J;
-      case JALR:
-      case LB:
-      case LH:
-      case LW:
-      case LBU:
-      case LHU:
-      case ADDI:
-      case SLTI:
-      case SLTIU:
-      case XORI:
-      case ORI:
-      case ANDI:
-        return I1;
-      case SLLI:
-      case SRLI:
-      case SRAI:
-        return I2;
-      case BEQ:
-      case BNE:
-      case BLT:
-      case BGE:
-      case BLTU:
-      case BGEU:
-        return B;
-      case SB:
-      case SH:
-      case SW:
-        return S;
-      case ADD:
-      case SUB:
-      case SLL:
-      case SLT:
-      case SLTU:
-      case XOR:
-      case SRL:
-      case SRA:
-      case OR:
-      case AND:
-        return R;
-      default:
-        throw std::invalid_argument("Invalid instruction type.");
+  // f registers are numbered from FLOAT_REGISTER_BASE after decoding, so that they are renamed with the x registers.
+  // The rounding mode field goes to immediate, except for loads and stores.
+  void place_float_registers(DecodedInstruction &inst, Word code) {
+    auto op = inst.op;
+    if (op == FLW) {
+      inst.rd += FLOAT_REGISTER_BASE;
+      return;
+    }
+    if (op == FSW) {
+      inst.rs2 += FLOAT_REGISTER_BASE;
+      return;
+    }
+    inst.immediate = static_cast<int>(to_unsigned(code.range<14, 12>()));
+    if (get_op_type(op) == R4) {
+      inst.immediate |= static_cast<int>(to_unsigned(code.range<31, 27>()) + FLOAT_REGISTER_BASE) << 3;
+    }
+    bool integer_result = op == FCVTWS || op == FCVTWUS || op == FMVXW || op == FEQ || op == FLT || op == FLE ||
+                          op == FCLASS;
+    bool integer_source = op == FCVTSW || op == FCVTSWU || op == FMVWX;
+    bool unary = integer_source || op == FSQRT || op == FCVTWS || op == FCVTWUS || op == FMVXW || op == FCLASS;
+    if (!integer_result) {
+      inst.rd += FLOAT_REGISTER_BASE;
+    }
+    if (!integer_source) {
+      inst.rs1 += FLOAT_REGISTER_BASE;
     }
+    inst.rs2 = unary ? 0 : inst.rs2 + FLOAT_REGISTER_BASE; // the rs2 field of a unary instruction selects a variant
   }
 
-  bool is_branch(Op op) {
-    switch (op) {
-      case BEQ:
-      case BNE:
-      case BLT:
-      case BGE:
-      case BLTU:
-      case BGEU:
-        return true;
-      default:
-        return false;
-    }
+  // The third source register of a decoded instruction, x0 unless it is a fused multiply-add.
+  // It is not a field of its own, so that the front end does not carry it for every instruction.
+  unsigned int rs3(Op op, unsigned int immediate) {
+    return get_op_type(op) == R4 ? immediate >> 3 : 0;
   }
 
-  bool is_load(Op op) {
-    switch (op) {
-      case LB:
-      case LH:
-      case LW:
-      case LBU:
-      case LHU:
-        return true;
-      default:
-        return false;
+  // Decode all fields of an instruction. Unknown instructions become nops.
+  // code holds the 32 bits at pc; if the low half is a compressed instruction, the high half is ignored.
+  DecodedInstruction decode_instruction(Word code) {
+    bool compressed = is_compressed(to_unsigned(code.range<15, 0>()));
+    if (compressed) {
+      code = expand_compressed(to_unsigned(code.range<15, 0>()));
+    }
+    Op op = decode(code);
+    if (op == UNKNOWN) {
+      code = NO_OPERATION;
+      op = ADDI;
+    }
+    DecodedInstruction inst{op, 0, 0, 0, 0, code == TERMINATION, compressed};
+    switch (get_op_type(op)) {
+      case R:
+        inst.rs1 = to_unsigned(code.range<19, 15>());
+        inst.rs2 = to_unsigned(code.range<24, 20>());
+        inst.rd = to_unsigned(code.range<11, 7>());
+        break;
+      case I1:
+        inst.rs1 = to_unsigned(code.range<19, 15>());
+        inst.rd = to_unsigned(code.range<11, 7>());
+        inst.immediate = to_signed(code.range<31, 20>());
+        break;
+      case I2:
+        inst.rs1 = to_unsigned(code.range<19, 15>());
+        inst.rd = to_unsigned(code.range<11, 7>());
+        inst.immediate = to_unsigned(code.range<24, 20>()); // shift amount
+        break;
+      case S:
+        inst.rs1 = to_unsigned(code.range<19, 15>());
+        inst.rs2 = to_unsigned(code.range<24, 20>());
+        inst.immediate = to_signed(Bit(code.range<31, 25>(), code.range<11, 7>()));
+        break;
+      case B:
+        inst.rs1 = to_unsigned(code.range<19, 15>());
+        inst.rs2 = to_unsigned(code.range<24, 20>());
+        inst.immediate = to_signed(
+          Bit(code.range<31, 31>(), code.range<7, 7>(), code.range<30, 25>(), code.range<11, 8>(), Bit<1>()));
+        break;
+      case U:
+        inst.rd = to_unsigned(code.range<11, 7>());
+        inst.immediate = to_signed(Bit(code.range<31, 12>(), Bit<12>()));
+        break;
+      case J:
+        inst.rd = to_unsigned(code.range<11, 7>());
+        inst.immediate = to_signed(
+          Bit(code.range<31, 31>(), code.range<19, 12>(), code.range<20, 20>(), code.range<30, 21>(), Bit<1>()));
+        break;
+      case R4:
+        inst.rs1 = to_unsigned(code.range<19, 15>());
+        inst.rs2 = to_unsigned(code.range<24, 20>());
+        inst.rd = to_unsigned(code.range<11, 7>());
+        break;
+    }
+    if (is_floating_point(op)) {
+      place_float_registers(inst, code);
     }
+    return inst;
   }
 
-  bool is_store(Op op) {
+  // Idioms the reorder buffer resolves at rename, without an execution unit.
+  enum Elimination {
+    EXECUTED, // not an idiom
+    MOVE, // addi rd, rs1, 0: rd takes the value of rs1
+    CONSTANT, // addi rd, x0, imm, lui, and lui fused with addi: rd = immediate
+    ZERO // xor rd, rs, rs and sub rd, rs, rs: rd = 0, which is also their immediate
+  };
+
+  Elimination eliminate(Op op, unsigned int rs1, unsigned int rs2, int immediate) {
     switch (op) {
-      case SB:
-      case SH:
-      case SW:
-        return true;
+      case ADDI:
+        return rs1 == 0 ? CONSTANT : immediate == 0 ? MOVE : EXECUTED;
+      case LUI:
+      case LUI_ADDI:
+        return CONSTANT;
+      case XOR:
+      case SUB:
+        return rs1 == rs2 ? ZERO : EXECUTED;
       default:
-        return false;
+        return EXECUTED;
     }
   }
 
-  memory::MemoryAccessMode get_memory_access_mode(Op op) {
-    switch (op) {
-      case LB:
-      case SB:
-        return memory::BYTE;
-      case LH:
-      case SH:
-        return memory::HALF_WORD;
-      case LW:
-      case SW:
-        return memory::WORD;
-      case LBU:
-        return memory::BYTE_UNSIGNED;
-      case LHU:
-        return memory::HALF_WORD_UNSIGNED;
-      default:
-        throw std::invalid_argument("Invalid memory access mode.");
+  // Merge second into first if the two form one of the idioms below, and return whether they did.
+  // Both must write the same register, which second reads, so only the value of second is visible.
+  //   lui rd, hi; addi rd, rd, lo         -> LUI_ADDI: rd = immediate
+  //   auipc rd, hi; jalr rd, lo(rd)       -> AUIPC_JALR: a jal from the auipc, linking past the jalr
+  //   slli rd, rs1, k; add rd, rd, rs2    -> SLLI_ADD: rd = (rs1 << immediate) + rs2
+  //   slli rd, rs1, k; srli rd, rd, m     -> SLLI_SRLI: immediate holds k, and m above it
+  bool fuse(DecodedInstruction &first, const DecodedInstruction &second) {
+    auto rd = first.rd;
+    if (rd == 0 || second.rd != rd || first.terminate || second.terminate) {
+      return false;
+    }
+    if (first.op == LUI && second.op == ADDI && second.rs1 == rd) {
+      first.op = LUI_ADDI;
+      first.immediate += second.immediate;
+    } else if (first.op == AUIPC && second.op == JALR && second.rs1 == rd) {
+      first.op = AUIPC_JALR;
+      first.immediate = (first.immediate + second.immediate) & ~1;
+    } else if (first.op == SLLI && second.op == ADD && (second.rs1 == rd) != (second.rs2 == rd)) {
+      first.op = SLLI_ADD;
+      first.rs2 = second.rs1 == rd ? second.rs2 : second.rs1;
+    } else if (first.op == SLLI && second.op == SRLI && second.rs1 == rd) {
+      first.op = SLLI_SRLI;
+      first.immediate |= second.immediate << 5;
+    } else {
+      return false;
     }
+    first.compressed = second.compressed;
+    return true;
   }
 }
 #endif //RISC_V_INSTRUCTIONS_HPP
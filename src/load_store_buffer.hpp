@@ -0,0 +1,236 @@
+#ifndef RISC_V_LOAD_STORE_BUFFER_HPP
+#define RISC_V_LOAD_STORE_BUFFER_HPP
+
+#include <span>
+#include "bundles.hpp"
+#include "config.hpp"
+#include "trace.hpp"
+
+struct LoadStoreBufferInput {
+  IssueSlots issued;
+  ResultBuses buses;
+  ThreadMaskWire flushing;
+  FlagWire store_commit;
+  InstPosWire store_tag;
+  FlagWire runahead;
+  FlagWire memory_load_finished;
+  FlagWire memory_store_finished;
+  DataWire memory_data;
+  FlagWire memory_poisoned; // in runahead, the load missed in data cache
+};
+
+struct LoadStoreBufferOutput {
+  ResultBus load_bus;
+  StationCount free_count; // free entries at the end of last cycle
+  Flag load;
+  Flag store;
+  Data addr;
+  MemoryAccessModeCode memory_mode;
+  AtomicCode atomic; // the load is a memory::AtomicOperation
+  Data store_data;
+  ThreadIndex memory_thread; // of the load or store
+  Flag store_done; // the committed store has been written to memory
+};
+
+struct MemoryInstruction {
+  Flag valid;
+  InstPos tag;
+  ThreadIndex thread;
+  OpCode opcode;
+  std::array<PendingData, 2> operands;
+  Data immediate;
+};
+
+struct LoadStoreBufferData {
+  std::array<MemoryInstruction, MAX_LSB_ENTRIES> entries;
+  LoadStorePos head, tail;
+  LoadStorePos mem_inst_pos; // the entry being served by memory
+};
+
+// Loads and stores in program order. A load goes to data cache when no older store of its thread is waiting;
+// a store goes only after the reorder buffer commits it. An atomic waits for the reorder buffer like a store,
+// and goes to data cache as a load that also writes, whose value is broadcast.
+// In runahead, stores are dropped, since nothing they write may last, and a load whose address is poisoned
+// does not go to data cache: it is broadcast poisoned at once, and so is an atomic.
+// A flush drops the entries of the flushing threads, and gives back the youngest of them at once.
+struct LoadStoreBuffer : dark::Module<LoadStoreBufferInput, LoadStoreBufferOutput, LoadStoreBufferData> {
+  const unsigned int core; // index of the core among those sharing memory
+
+  explicit LoadStoreBuffer(unsigned int core) : core(core) {}
+
+  // Positions run over twice the config.lsb_entries entries in use, to tell a full buffer from an empty one.
+  // They wrap by a subtraction, which costs less than dividing by a size known only at run time.
+  static unsigned int advance(unsigned int pos, unsigned int steps) { // steps at most twice the entries
+    pos += steps;
+    return pos >= config.lsb_entries * 2 ? pos - config.lsb_entries * 2 : pos;
+  }
+
+  static unsigned int index_of(unsigned int pos) {
+    return pos >= config.lsb_entries ? pos - config.lsb_entries : pos;
+  }
+
+  std::span<MemoryInstruction> in_use() {
+    return {entries.data(), config.lsb_entries};
+  }
+
+  // Whether the entry is valid, and its thread is flushing.
+  bool dropped(const MemoryInstruction &entry) {
+    return entry.valid == true && flushes(flushing, to_unsigned(entry.thread));
+  }
+
+  bool alive(const MemoryInstruction &entry) {
+    return entry.valid == true && !dropped(entry);
+  }
+
+  static bool operands_ready(const MemoryInstruction &entry) {
+    return entry.operands[0].pending == false && entry.operands[1].pending == false;
+  }
+
+  void request(const MemoryInstruction &entry, unsigned int pos) {
+    auto op = static_cast<Op>(to_unsigned(entry.opcode));
+    (is_store(op) ? store : load).assign(true);
+    auto address = to_unsigned(entry.operands[0].data) + to_unsigned(entry.immediate);
+    addr.assign(address);
+    if (trace::tracker) {
+      trace::tracker->access(core, to_unsigned(entry.tag), address);
+    }
+    memory_mode.assign(get_memory_access_mode(op));
+    atomic.assign(get_atomic_operation(op));
+    store_data.assign(entry.operands[1].data);
+    memory_thread.assign(entry.thread);
+    mem_inst_pos.assign(pos);
+  }
+
+  void broadcast(MemoryInstruction &entry, unsigned int value, bool poisoned) {
+    load_bus.valid.assign(true);
+    load_bus.tag.assign(entry.tag);
+    load_bus.value.assign(value);
+    load_bus.poisoned.assign(poisoned);
+    entry.valid.assign(false);
+  }
+
+  // Send the oldest load whose address is known, or the committed store or atomic at head, to data cache.
+  // The entries of a thread after its first store or atomic wait. Return whether a load or an atomic was broadcast
+  // without data cache.
+  bool execute() {
+    std::array<bool, MAX_THREADS> blocked{}, waiting{}; // waiting: an older load of the thread waits for its address
+    for (auto pos = to_unsigned(head); pos != tail; pos = advance(pos, 1)) {
+      MemoryInstruction &entry = entries[index_of(pos)];
+      auto thread = to_unsigned(entry.thread);
+      if (!alive(entry) || blocked[thread]) {
+        continue;
+      }
+      auto op = static_cast<Op>(to_unsigned(entry.opcode));
+      if (is_store(op) || is_atomic(op)) {
+        if (runahead == true && is_atomic(op)) {
+          broadcast(entry, 0, true);
+          return true;
+        }
+        if (runahead == true) {
+          continue;
+        }
+        if (!waiting[thread] && store_commit == true && store_tag == entry.tag && operands_ready(entry)) {
+          request(entry, index_of(pos));
+          return false;
+        }
+        blocked[thread] = true;
+        continue;
+      }
+      if (operands_ready(entry)) {
+        if (runahead == true && entry.operands[0].poisoned == true) {
+          broadcast(entry, 0, true);
+          return true;
+        }
+        request(entry, index_of(pos));
+        return false;
+      }
+      waiting[thread] = true;
+    }
+    return false;
+  }
+
+  void drop_stores() {
+    for (auto &entry: in_use()) {
+      if (alive(entry) && is_store(static_cast<Op>(to_unsigned(entry.opcode)))) {
+        entry.valid.assign(false);
+      }
+    }
+  }
+
+  // Put newly issued loads and stores at tail.
+  unsigned int insert(unsigned int tail) {
+    unsigned int count = 0;
+    for (auto &slot: issued) {
+      if (slot.valid == false || !is_memory_access(static_cast<Op>(to_unsigned(slot.opcode))) ||
+          flushes(flushing, to_unsigned(slot.thread))) {
+        continue;
+      }
+      MemoryInstruction &entry = entries[index_of(advance(tail, count++))];
+      entry.valid.assign(true);
+      entry.tag.assign(slot.tag);
+      entry.thread.assign(slot.thread);
+      entry.opcode.assign(slot.opcode);
+      listen(entry.operands[0], slot.operands[0], buses);
+      listen(entry.operands[1], slot.operands[1], buses);
+      entry.immediate.assign(slot.immediate);
+    }
+    return count;
+  }
+
+  void work() override {
+    MemoryInstruction &served = entries[to_unsigned(mem_inst_pos)];
+    bool cancelled = (load == true || store == true) && flushes(flushing, to_unsigned(served.thread));
+    bool finished = memory_load_finished || memory_store_finished, broadcasted = false;
+    store_done.assign(memory_store_finished == true && !cancelled);
+    if (cancelled) { // data cache drops the answer
+      load.assign(false);
+      store.assign(false);
+    } else if (memory_load_finished) {
+      auto value = to_unsigned(memory_data);
+      if (trace::tracker) {
+        value = trace::tracker->loaded(core, to_unsigned(served.thread), to_unsigned(served.tag), value);
+      }
+      broadcast(served, value, static_cast<bool>(memory_poisoned));
+      broadcasted = true;
+      load.assign(false);
+    } else if (memory_store_finished) {
+      served.valid.assign(false);
+      store.assign(false);
+    }
+    if (!finished && load == false && store == false) {
+      broadcasted = execute();
+    }
+    if (!broadcasted) {
+      load_bus.valid.assign(false);
+    }
+    if (runahead == true) {
+      drop_stores();
+    }
+    for (auto &entry: in_use()) {
+      if (alive(entry)) {
+        listen(entry.operands[0], buses);
+        listen(entry.operands[1], buses);
+      }
+    }
+    auto new_head = to_unsigned(head), new_tail = to_unsigned(tail);
+    while (new_head != new_tail && !alive(entries[index_of(new_head)])) { // skip finished and flushed entries
+      new_head = advance(new_head, 1);
+    }
+    // give back flushed entries at tail
+    while (new_tail != new_head && dropped(entries[index_of(advance(new_tail, config.lsb_entries * 2 - 1))])) {
+      new_tail = advance(new_tail, config.lsb_entries * 2 - 1);
+    }
+    auto inserted = insert(new_tail);
+    for (unsigned int i = 0; i < config.lsb_entries; i++) { // entries being refilled are not dropped
+      if (dropped(entries[i]) && index_of(i + config.lsb_entries - index_of(new_tail)) >= inserted) {
+        entries[i].valid.assign(false);
+      }
+    }
+    new_tail = advance(new_tail, inserted);
+    head.assign(new_head);
+    tail.assign(new_tail);
+    free_count.assign(config.lsb_entries - advance(new_tail, config.lsb_entries * 2 - new_head));
+  }
+};
+
+#endif //RISC_V_LOAD_STORE_BUFFER_HPP
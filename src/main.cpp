@@ -1,31 +1,144 @@
-#include "processor.hpp"
-#include "memory.hpp"
-#include "template/cpu.h"
+#include "system.hpp"
+#include "sampling.hpp"
+#include "checkpoint.hpp"
+#include "sweep.hpp"
+#include "explore.hpp"
+#include "replay.hpp"
 
-int main() {
+// The counters of one core. Those of the front ends are summed over its threads.
+void print_statistics(const Statistics &core) {
+  FrontEndStatistics front_end{};
+  for (unsigned int thread = 0; thread < config.smt; thread++) {
+    const FrontEndStatistics &thread_front_end = core.front_ends[thread];
+    front_end.frontend_redirects += thread_front_end.frontend_redirects;
+    front_end.fetched_instructions += thread_front_end.fetched_instructions;
+    front_end.delivery_cycles += thread_front_end.delivery_cycles;
+    front_end.trace_lookups += thread_front_end.trace_lookups;
+    front_end.trace_hits += thread_front_end.trace_hits;
+    front_end.trace_instructions += thread_front_end.trace_instructions;
+    front_end.tlb_misses += thread_front_end.tlb_misses;
+    front_end.tlb_walk_cycles += thread_front_end.tlb_walk_cycles;
+    front_end.page_faults += thread_front_end.page_faults;
+  }
+  if (config.smt > 1) {
+    std::cerr << "committed by thread:";
+    for (unsigned int thread = 0; thread < config.smt; thread++) {
+      std::cerr << " " << core.thread_committed[thread];
+    }
+    std::cerr << std::endl;
+  }
+  std::cerr << "arbiter grants: fetch " << core.fetch_grants << ", data " << core.data_grants << std::endl;
+  std::cerr << "memory wait cycles: fetch " << core.fetch_wait_cycles << ", data " << core.data_wait_cycles
+            << std::endl;
+  std::cerr << "front end redirects: " << front_end.frontend_redirects << std::endl;
+  std::cerr << "fetch buffer empty cycles: " << core.fetch_buffer_empty_cycles << std::endl;
+  std::cerr << "issue stalls: instruction buffer " << core.issue_stall_rob << ", reservation station "
+            << core.issue_stall_rs << ", load/store buffer " << core.issue_stall_lsb << std::endl;
+  std::cerr << "multiply/divide operations: " << core.multiply_operations << "/" << core.divide_operations
+            << ", divider busy cycles " << core.divider_busy_cycles << std::endl;
+  std::cerr << "floating-point operations: " << core.float_operations << ", divide/sqrt "
+            << core.float_divide_operations << std::endl;
+  std::cerr << "fused pairs: lui+addi " << core.fused_lui_addi << ", auipc+jalr " << core.fused_auipc_jalr
+            << ", slli+add " << core.fused_slli_add << ", slli+srli " << core.fused_slli_srli << std::endl;
+  std::cerr << "eliminated at rename: moves " << core.eliminated_moves << ", constants " << core.eliminated_constants
+            << ", zero idioms " << core.eliminated_zeros << std::endl;
+  std::cerr << "value predicted loads: " << core.predicted_loads << "/" << core.committed_loads << ", mispredicted "
+            << core.value_mispredicts << std::endl;
+  std::cerr << "data cache hits: " << core.data_cache_hits << "/" << core.data_cache_hits + core.data_cache_misses
+            << ", lines dropped by snoops " << core.snoop_invalidations << std::endl;
+  std::cerr << "atomics: " << core.atomic_operations << ", failed sc " << core.failed_store_conditionals << std::endl;
+  std::cerr << "runahead: " << core.runahead_periods << " periods, " << core.runahead_cycles << " cycles, "
+            << core.runahead_instructions << " instructions thrown away" << std::endl;
+  // a prefetched line a load hits saves it one memory access; memory serves one access at a time,
+  // so the fills themselves may still delay later ones
+  std::cerr << "prefetches: " << core.prefetches << ", useful " << core.useful_prefetches << " (at most "
+            << core.useful_prefetches * config.memory_latency << " cycles saved)" << std::endl;
+  if (config.core_model == IN_ORDER_CORE) {
+    std::cerr << "in-order stalls: load-use " << core.load_use_stalls << ", memory " << core.memory_stalls
+              << ", execute " << core.execute_stalls << std::endl;
+  }
+  std::cerr << "TLB misses: instruction " << front_end.tlb_misses << " (" << front_end.tlb_walk_cycles
+            << " walk cycles), data " << core.dtlb_misses << " (" << core.dtlb_walk_cycles << " walk cycles)"
+            << std::endl;
+  std::cerr << "page faults: instruction " << front_end.page_faults << ", data " << core.data_page_faults << std::endl;
+  std::cerr << "trace cache hits: " << front_end.trace_hits << "/" << front_end.trace_lookups << std::endl;
+  std::cerr << "delivered instructions per cycle: "
+            << (front_end.delivery_cycles ? 1.0 * front_end.fetched_instructions / front_end.delivery_cycles : 0)
+            << " (" << front_end.trace_instructions << "/" << front_end.fetched_instructions << " from trace cache)"
+            << std::endl;
+}
+
+// What main prints at the end of a run: the return value to stdout, and the counters to stderr.
+void print_result(const RunResult &result) {
+  int committed = 0, correct = 0, predicted = 0;
+  for (unsigned int core = 0; core < config.cores; core++) {
+    committed += result.statistics[core].total_committed;
+    correct += result.statistics[core].correct_predict;
+    predicted += result.statistics[core].total_predict;
+  }
+  std::cout << result.return_value << std::endl;
+  std::cerr << committed << "/" << result.cycles << std::endl;
+  std::cerr << correct << "/" << predicted << std::endl;
+  if (config.print_statistics) {
+    std::cerr << "arbiter conflicts: " << result.arbiter_conflicts << std::endl;
+    for (unsigned int core = 0; core < config.cores; core++) {
+      if (config.cores > 1) {
+        std::cerr << "core " << core << ":" << std::endl;
+      }
+      print_statistics(result.statistics[core]);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
 //  freopen("../testcases/magic.data", "r", stdin);
-  memory::load_instructions();
-  dark::CPU cpu;
-  ProcessorModule processor;
-  Memory memory;
-  cpu.add_module(&processor);
-  cpu.add_module(&memory);
-  memory.load = [&]() -> auto & { return processor.load; };
-  memory.store = [&]() -> auto & { return processor.store; };
-  memory.addr = [&]() -> auto & { return processor.addr; };
-  memory.mode = [&]() -> auto & { return processor.memory_mode; };
-  memory.store_data = [&]() -> auto & { return processor.store_data; };
-  memory.flushing = [&]() -> auto & { return processor.flushing; };
-  processor.memory_load_finished = [&]() { return memory.phase == 1; };
-  processor.memory_store_finished = [&]() { return memory.phase == -1; };
-  processor.memory_busy = [&]() { return memory.phase != 0; };
-  processor.memory_data = [&]() -> auto & { return memory.data_out; };
-  while (processor.should_return == false) {
-    cpu.run_once_shuffle();
-    total_tick++;
-  }
-  std::cout << to_unsigned(processor.return_value) << std::endl;
-  std::cerr << total_committed << "/" << total_tick << std::endl;
-  std::cerr << correct_predict << "/" << total_predict << std::endl;
+  parse_arguments(argc, argv);
+  if (!config.workloads.empty()) {
+    return explore::run() ? 1 : 0;
+  }
+  if (config.replay_path.empty()) { // a replay runs on the code of its trace
+    memory::load_instructions();
+  }
+  if (config.sample) {
+    std::cout << sampling::run() << std::endl;
+    return 0;
+  }
+  if (!config.variants.empty() && config.threads == 0) { // the children of a sweep share the host
+    config.threads = 1;
+  }
+  System system;
+  std::unique_ptr<trace::Tracker> tracker;
+  if (!config.trace_path.empty()) {
+    tracker = std::make_unique<trace::Writer>(config.trace_path);
+  } else if (!config.replay_path.empty()) {
+    tracker = std::make_unique<replay::Feed>(config.replay_path);
+  }
+  trace::tracker = tracker.get();
+  checkpoint::Series checkpoints;
+  if (!config.restore_path.empty()) {
+    checkpoints.load(system, config.restore_path);
+  }
+  if (!config.variants.empty()) {
+    auto results = sweep::run(system);
+    for (size_t i = 0; i < results.size(); i++) {
+      std::cerr << "variant " << config.variants[i] << ":" << std::endl;
+      print_result(results[i]);
+    }
+    return 0;
+  }
+  while (!system.halted()) {
+    system.run_cycle();
+    if (tracker) {
+      tracker->end_cycle();
+    }
+    if (config.checkpoint_every && total_tick % config.checkpoint_every == 0) {
+      checkpoints.save(system, config.checkpoint_path + "." + std::to_string(total_tick));
+    }
+  }
+  auto result = system.result();
+  if (tracker) {
+    tracker->finish(result.return_value);
+  }
+  print_result(result);
   return 0;
-}
\ No newline at end of file
+}
@@ -7,16 +7,18 @@
 
 #include <array>
 #include <iostream>
-#include "constants.hpp"
+#include <unordered_map>
+#include "config.hpp"
 
 namespace memory {
-  std::unordered_map<unsigned int, unsigned char> memory;
+  using Image = std::unordered_map<unsigned int, unsigned char>; // bytes by address; absent ones are 0
+  Image memory;
 
   // Load instructions from input stream into our memory.
-  void load_instructions() {
+  void load_instructions(std::istream &in = std::cin) {
     unsigned int current_pos = 0;
     std::string str;
-    while (std::cin >> str) {
+    while (in >> str) {
       if (str[0] == '@') {
         current_pos = std::stoul(str.substr(1), nullptr, 16);
       } else {
@@ -34,37 +36,99 @@ namespace memory {
     WORD
   };
 
-  Word load_data(unsigned int addr, MemoryAccessMode mode = WORD) {
+  Word load_data(unsigned int addr, MemoryAccessMode mode = WORD, Image &image = memory) {
     if (mode == BYTE || mode == BYTE_UNSIGNED) {
       Byte ret;
-      ret.set<7, 0>(memory[addr]);
+      ret.set<7, 0>(image[addr]);
       return mode == BYTE ? to_signed(ret) : to_unsigned(ret);
     }
     if (mode == HALF_WORD || mode == HALF_WORD_UNSIGNED) {
       HalfWord ret;
-      ret.set<7, 0>(memory[addr]);
-      ret.set<15, 8>(memory[addr + 1]);
+      ret.set<7, 0>(image[addr]);
+      ret.set<15, 8>(image[addr + 1]);
       return mode == HALF_WORD ? to_signed(ret) : to_unsigned(ret);
     }
     Word ret;
-    ret.set<7, 0>(memory[addr]);
-    ret.set<15, 8>(memory[addr + 1]);
-    ret.set<23, 16>(memory[addr + 2]);
-    ret.set<31, 24>(memory[addr + 3]);
+    ret.set<7, 0>(image[addr]);
+    ret.set<15, 8>(image[addr + 1]);
+    ret.set<23, 16>(image[addr + 2]);
+    ret.set<31, 24>(image[addr + 3]);
     return ret;
   }
 
-  void store_data(unsigned int addr, const Word &data, MemoryAccessMode mode = WORD) {
-    memory[addr] = to_unsigned(data.range<7, 0>());
+  void store_data(unsigned int addr, const Word &data, MemoryAccessMode mode = WORD, Image &image = memory) {
+    image[addr] = to_unsigned(data.range<7, 0>());
     if (mode == BYTE || mode == BYTE_UNSIGNED) {
       return;
     }
-    memory[addr + 1] = to_unsigned(data.range<15, 8>());
+    image[addr + 1] = to_unsigned(data.range<15, 8>());
     if (mode == HALF_WORD || mode == HALF_WORD_UNSIGNED) {
       return;
     }
-    memory[addr + 2] = to_unsigned(data.range<23, 16>());
-    memory[addr + 3] = to_unsigned(data.range<31, 24>());
+    image[addr + 2] = to_unsigned(data.range<23, 16>());
+    image[addr + 3] = to_unsigned(data.range<31, 24>());
+  }
+
+  // Word accesses of the A extension, done by memory in one access so that no other one comes between
+  // the read and the write.
+  enum AtomicOperation {
+    NOT_ATOMIC,
+    LOAD_RESERVED,
+    STORE_CONDITIONAL,
+    AMO_SWAP,
+    AMO_ADD,
+    AMO_XOR,
+    AMO_AND,
+    AMO_OR,
+    AMO_MIN,
+    AMO_MAX,
+    AMO_MINU,
+    AMO_MAXU
+  };
+
+  // Do an atomic access and return the value it gives rd: the old value, or for sc whether it failed.
+  unsigned int atomic_access(unsigned int addr, unsigned int value, AtomicOperation op, bool reservation_lost,
+                             Image &image = memory) {
+    if (op == STORE_CONDITIONAL) {
+      if (!reservation_lost) {
+        store_data(addr, value, WORD, image);
+      }
+      return reservation_lost;
+    }
+    auto old = to_unsigned(load_data(addr, WORD, image));
+    auto signed_old = static_cast<int>(old), signed_value = static_cast<int>(value);
+    switch (op) {
+      case AMO_SWAP:
+        break;
+      case AMO_ADD:
+        value += old;
+        break;
+      case AMO_XOR:
+        value ^= old;
+        break;
+      case AMO_AND:
+        value &= old;
+        break;
+      case AMO_OR:
+        value |= old;
+        break;
+      case AMO_MIN:
+        value = signed_old < signed_value ? old : value;
+        break;
+      case AMO_MAX:
+        value = signed_old > signed_value ? old : value;
+        break;
+      case AMO_MINU:
+        value = old < value ? old : value;
+        break;
+      case AMO_MAXU:
+        value = old > value ? old : value;
+        break;
+      default: // lr only reads
+        return old;
+    }
+    store_data(addr, value, WORD, image);
+    return old;
   }
 }
 
@@ -75,11 +139,15 @@ struct MemoryInput {
   DataWire store_data;
   MemoryAccessModeWire mode;
   FlagWire flushing;
+  FlagWire fetch; // the load reads a whole block, for instruction fetch or a data cache line
+  AtomicCodeWire atomic; // the load is a memory::AtomicOperation, which may also write
+  FlagWire reservation_lost; // for sc: the reservation is gone, so nothing is written
 };
 
 struct MemoryOutput {
   Data data_out;
-  Data phase; // need three phases to complete a memory access
+  std::array<Data, FETCH_BLOCK_WORDS> block_out;
+  Data phase; // counts down config.memory_latency cycles to complete a memory access
 };
 
 struct Memory : public dark::Module<MemoryInput, MemoryOutput> {
@@ -95,16 +163,26 @@ struct Memory : public dark::Module<MemoryInput, MemoryOutput> {
       phase.assign(phase + 1);
     }
     if (phase == 2) {
-      data_out.assign(memory::load_data(to_unsigned(addr), static_cast<memory::MemoryAccessMode>(to_unsigned(mode))));
+      if (fetch) {
+        for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+          block_out[i].assign(memory::load_data(to_unsigned(addr) + i * 4));
+        }
+      } else if (atomic != memory::NOT_ATOMIC) {
+        data_out.assign(memory::atomic_access(to_unsigned(addr), to_unsigned(store_data),
+                                              static_cast<memory::AtomicOperation>(to_unsigned(atomic)),
+                                              static_cast<bool>(reservation_lost)));
+      } else {
+        data_out.assign(memory::load_data(to_unsigned(addr), static_cast<memory::MemoryAccessMode>(to_unsigned(mode))));
+      }
     }
     if (phase == -2) {
       memory::store_data(to_unsigned(addr), store_data, static_cast<memory::MemoryAccessMode>(to_unsigned(mode)));
     }
     if (phase == 0) {
       if (store) {
-        phase.assign(-5);
+        phase.assign(-static_cast<int>(config.memory_latency));
       } else if (load) {
-        phase.assign(5);
+        phase.assign(config.memory_latency);
       }
     }
   }
@@ -0,0 +1,78 @@
+#ifndef RISC_V_MULTIPLIER_HPP
+#define RISC_V_MULTIPLIER_HPP
+
+#include "alu.hpp"
+#include "bundles.hpp"
+#include "config.hpp"
+
+struct MultiplierInput {
+  UnitRequestWire request;
+  ThreadMaskWire flushing;
+};
+
+struct MultiplierOutput {
+  ResultBus bus;
+};
+
+struct MultiplyStage {
+  Flag valid;
+  InstPos tag;
+  ThreadIndex thread;
+  Data value;
+};
+
+struct MultiplierData {
+  std::array<MultiplyStage, MAX_MULTIPLY_LATENCY - 1> stages;
+};
+
+// A pipelined multiplier. It takes one instruction every cycle, and its result is
+// broadcast config.multiply_latency cycles after the request arrives. A flush drops the stages of its threads.
+struct Multiplier : dark::Module<MultiplierInput, MultiplierOutput, MultiplierData> {
+  Statistics &statistics; // of the core
+
+  explicit Multiplier(Statistics &statistics) : statistics(statistics) {}
+
+  bool alive(const MultiplyStage &stage) {
+    return stage.valid == true && !flushes(flushing, to_unsigned(stage.thread));
+  }
+
+  void work() override {
+    unsigned int value = 0;
+    bool accepted = request.valid == true && !flushes(flushing, to_unsigned(request.thread));
+    if (accepted) {
+      auto op = static_cast<Op>(to_unsigned(request.opcode));
+      value = execute_multiply_divide(op, to_signed(request.rs1), to_signed(request.rs2));
+      statistics.multiply_operations++;
+    }
+    auto depth = config.multiply_latency - 1;
+    if (depth == 0) {
+      bus.valid.assign(accepted);
+      bus.tag.assign(request.tag);
+      bus.value.assign(value);
+      return;
+    }
+    bool busy = accepted;
+    for (unsigned int i = 0; i < depth && !busy; i++) {
+      busy = stages[i].valid == true;
+    }
+    if (!busy) { // the stages of an empty pipeline keep their values, which nothing reads
+      bus.valid.assign(false);
+      return;
+    }
+    bus.valid.assign(alive(stages[depth - 1]));
+    bus.tag.assign(stages[depth - 1].tag);
+    bus.value.assign(stages[depth - 1].value);
+    for (auto i = depth - 1; i > 0; i--) {
+      stages[i].valid.assign(alive(stages[i - 1]));
+      stages[i].tag.assign(stages[i - 1].tag);
+      stages[i].thread.assign(stages[i - 1].thread);
+      stages[i].value.assign(stages[i - 1].value);
+    }
+    stages[0].valid.assign(accepted);
+    stages[0].tag.assign(request.tag);
+    stages[0].thread.assign(request.thread);
+    stages[0].value.assign(value);
+  }
+};
+
+#endif //RISC_V_MULTIPLIER_HPP
@@ -0,0 +1,149 @@
+#ifndef RISC_V_REGISTER_FILE_HPP
+#define RISC_V_REGISTER_FILE_HPP
+
+#include "bundles.hpp"
+
+struct RegisterFile {
+  Data data;
+  InstPos pending_inst;
+  Flag pending; // for register 0, data is always 0 and pending is always false.
+  Flag poisoned; // written in runahead with a value that is not real
+};
+
+struct RegisterFileWire {
+  DataWire data;
+  InstPosWire pending_inst;
+  FlagWire pending;
+  FlagWire poisoned;
+};
+
+struct RegisterFileInput {
+  IssueSlots issued;
+  std::array<CommitSlotWire, MAX_COMMIT_WIDTH> committed;
+  FlagWire flushing; // of this thread
+  FlagWire runahead;
+};
+
+struct RegisterFileOutput {
+  std::array<RegisterFile, REGISTER_COUNT> register_files;
+};
+
+struct RegisterFileData {
+  std::array<Data, REGISTER_COUNT> checkpoint; // architectural values when runahead started
+  Flag in_runahead;
+};
+
+// Architectural registers of one hardware thread, and which instruction in reorder buffer will write each of them.
+// Renames and commits of the other threads of the core are ignored.
+// Renames and commits arrive one cycle after the reorder buffer makes them;
+// the reorder buffer covers that cycle from its own outputs.
+// When runahead starts, the values are copied to checkpoint, and instructions retired in runahead
+// write the registers as usual. When it ends, with a flush, the checkpoint is copied back.
+struct RegisterFileModule : dark::Module<RegisterFileInput, RegisterFileOutput, RegisterFileData> {
+  const unsigned int thread;
+
+  explicit RegisterFileModule(unsigned int thread) : thread(thread) {}
+
+  // Set the architectural values. Called before the first cycle.
+  void start_at(const std::array<unsigned int, REGISTER_COUNT> &values) {
+    for (unsigned int i = 1; i < REGISTER_COUNT; i++) {
+      register_files[i].data.assign(values[i]);
+    }
+    sync();
+  }
+
+  void restore() {
+    for (unsigned int i = 1; i < REGISTER_COUNT; i++) {
+      register_files[i].data.assign(checkpoint[i]);
+      register_files[i].poisoned.assign(false);
+      register_files[i].pending.assign(false);
+    }
+    in_runahead.assign(false);
+  }
+
+  struct Write {
+    unsigned int reg, value;
+    bool poisoned, released;
+  };
+
+  struct Rename {
+    unsigned int reg, tag;
+  };
+
+  // The entry of reg in list, added if there is none: a register written or renamed twice in one cycle
+  // takes the later slot, and is assigned once.
+  template<typename Entry, std::size_t size>
+  static Entry &entry_of(std::array<Entry, size> &list, unsigned int &count, unsigned int reg) {
+    for (unsigned int i = 0; i < count; i++) {
+      if (list[i].reg == reg) return list[i];
+    }
+    list[count] = Entry{};
+    list[count].reg = reg;
+    return list[count++];
+  }
+
+  // Only the registers named in the slots are assigned; all of them only on a flush or when runahead starts.
+  void work() override {
+    if (runahead == false && in_runahead == true) {
+      restore();
+      return;
+    }
+    std::array<Write, MAX_COMMIT_WIDTH> writes;
+    std::array<Rename, MAX_ISSUE_WIDTH> renames;
+    unsigned int write_count = 0, rename_count = 0;
+    bool flush = flushing == true;
+    bool checkpointing = runahead == true && in_runahead == false; // the commits of this cycle are still real
+    for (auto &slot: committed) {
+      auto reg_pos = to_unsigned(slot.destination);
+      if (slot.valid == true && slot.thread == thread && reg_pos) {
+        auto &write = entry_of(writes, write_count, reg_pos);
+        write.value = to_unsigned(slot.value);
+        write.poisoned = static_cast<bool>(slot.poisoned);
+        if (register_files[reg_pos].pending == true && register_files[reg_pos].pending_inst == slot.tag) {
+          write.released = true;
+        }
+      }
+    }
+    if (!flush) {
+      for (auto &slot: issued) {
+        auto reg_pos = to_unsigned(slot.destination);
+        if (slot.valid == true && slot.thread == thread && reg_pos) {
+          entry_of(renames, rename_count, reg_pos).tag = to_unsigned(slot.tag);
+        }
+      }
+    }
+    for (unsigned int i = 0; i < write_count; i++) {
+      register_files[writes[i].reg].data.assign(writes[i].value);
+      register_files[writes[i].reg].poisoned.assign(writes[i].poisoned);
+    }
+    for (unsigned int i = 0; i < rename_count; i++) {
+      register_files[renames[i].reg].pending_inst.assign(renames[i].tag);
+      register_files[renames[i].reg].pending.assign(true);
+    }
+    if (flush) { // nothing is renamed
+      for (unsigned int i = 1; i < REGISTER_COUNT; i++) {
+        register_files[i].pending.assign(false);
+      }
+    } else {
+      for (unsigned int i = 0; i < write_count; i++) {
+        auto renamed = std::any_of(renames.begin(), renames.begin() + rename_count,
+                                   [&](const Rename &rename) { return rename.reg == writes[i].reg; });
+        if (writes[i].released && !renamed) {
+          register_files[writes[i].reg].pending.assign(false);
+        }
+      }
+    }
+    if (checkpointing) {
+      for (unsigned int i = 1; i < REGISTER_COUNT; i++) {
+        auto value = to_unsigned(register_files[i].data);
+        for (unsigned int j = 0; j < write_count; j++) {
+          if (writes[j].reg == i) value = writes[j].value;
+        }
+        checkpoint[i].assign(value);
+      }
+      in_runahead.assign(true);
+    }
+  }
+};
+
+#endif //RISC_V_REGISTER_FILE_HPP
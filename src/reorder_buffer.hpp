@@ -0,0 +1,862 @@
+#ifndef RISC_V_REORDER_BUFFER_HPP
+#define RISC_V_REORDER_BUFFER_HPP
+
+#include <span>
+#include "bundles.hpp"
+#include "register_file.hpp"
+#include "csr.hpp"
+#include "value_predictor.hpp"
+#include "config.hpp"
+#include "trace.hpp"
+
+// Fetch buffers, register files and the per-thread outputs are indexed by hardware thread.
+struct ReorderBufferInput {
+  // the instructions at fetch_head, fetch_head + 1, ...
+  std::array<std::array<FetchedInstructionWire, MAX_ISSUE_WIDTH>, MAX_THREADS> fetched;
+  std::array<FetchBufferPosWire, MAX_THREADS> fetch_tail;
+  std::array<std::array<RegisterFileWire, REGISTER_COUNT>, MAX_THREADS> register_files;
+  ResultBuses buses;
+  StationCountWire rs_free;
+  StationCountWire lsb_free;
+  FlagWire store_done; // the store asked for by store_commit has been written to memory
+  FlagWire load_missing; // data cache is filling the line of a load
+};
+
+struct ReorderBufferOutput {
+  std::array<IssueSlot, MAX_ISSUE_WIDTH> issued; // all of one thread
+  std::array<CommitSlot, MAX_COMMIT_WIDTH> committed; // all of one thread
+  Flag should_return; // the first thread halted
+  Return return_value;
+  ThreadMask flushing;
+  std::array<Data, MAX_THREADS> flush_pc; // pc to flush to
+  std::array<FetchBufferPos, MAX_THREADS> fetch_head;
+  std::array<BranchUpdate, MAX_THREADS> branch_update;
+  Flag store_commit; // the store or atomic at head of its thread may go to memory
+  InstPos store_tag;
+  std::array<FloatFlags, MAX_THREADS> fflags; // accrued by committed floating-point instructions
+  std::array<RoundingMode, MAX_THREADS> frm;
+  std::array<Data, MAX_THREADS> satp;
+  Flag runahead;
+};
+
+struct Instruction {
+  Flag valid;
+  ThreadIndex thread;
+  Flag ready;
+  OpCode opcode;
+  RegPos destination;
+  Data result; // for branch, result stores whether to jump
+  Data target; // for jalr, where to jump
+  Data immediate;
+  Data pc; // pc of this instruction
+  Flag predict; // whether the front end followed the taken path of this branch
+  Flag terminate; // for halt instruction
+  Flag compressed;
+  FloatFlags flags; // floating-point exceptions, accrued to fflags when committed
+  Flag alias; // an eliminated move, waiting for instruction source to broadcast the value it copies
+  InstPos source;
+  Flag value_predicted; // a load whose consumers were given a predicted value, kept in result until it is ready
+  Flag value_mispredicted; // ... and whose real value turned out different
+  Flag poisoned; // in runahead, the result depends on a load that missed
+};
+
+// An operand found at rename: its value, or the position of the instruction that will broadcast it.
+struct RenamedOperand {
+  bool pending;
+  unsigned int data;
+  bool poisoned;
+};
+
+struct ReorderBufferData {
+  std::array<Instruction, MAX_ROB_ENTRIES> instruction_buffer;
+  // the positions each thread holds, in program order, from head to tail
+  std::array<std::array<InstPos, MAX_ROB_ENTRIES>, MAX_THREADS> order;
+  std::array<OrderPos, MAX_THREADS> head, tail;
+  std::array<InstPos, MAX_THREADS> next_free; // where each thread looks for a free entry first
+  ThreadIndex issue_thread, commit_thread; // the threads that renamed and retired last, for round robin
+  ValuePredictor value_predictor;
+  Data runahead_pc; // of the load runahead started at
+};
+
+// Rename instructions from fetch buffer, send them to reservation station or load/store buffer,
+// and retire them in program order: config.issue_width and config.commit_width of them per cycle at most,
+// in config.rob_entries entries.
+// With value prediction, a load the predictor is sure of gives its predicted value to its consumers at once.
+// The value is checked when the load is broadcast, and a wrong one flushes everything after the load at commit.
+// The register file applies issued and committed one cycle later, so reading a register
+// must also look at those two bundles.
+// With runahead, a load at head that waits for a line fill, while a full buffer stops issue, starts runahead:
+// the load is answered with a poisoned value, and instructions after it keep executing and retiring,
+// so that the loads among them find their lines missing and prefetch them. When the fill is done,
+// everything is flushed, and execution resumes at the load with the registers of the checkpoint.
+// With several hardware threads (config.smt), each has its own fetch unit, register file, csrs and program order,
+// and the threads share the buffer and the back end. One thread renames in a cycle, chosen by config.fetch_policy,
+// and one retires, in turn. Each thread has an equal share of the buffer, or all threads take entries from one pool
+// with config.shared_rob. A flush only drops the instructions of its thread, and the other threads go on.
+struct ReorderBuffer : dark::Module<ReorderBufferInput, ReorderBufferOutput, ReorderBufferData> {
+  const unsigned int core; // index of the core among those sharing memory
+  Statistics &statistics; // of the core
+
+  ReorderBuffer(unsigned int core, Statistics &statistics) : core(core), statistics(statistics) {}
+
+  // Index of thread among all hardware threads, read with mhartid.
+  unsigned int hart(unsigned int thread) const {
+    return core * config.smt + thread;
+  }
+
+  bool is_flushing(unsigned int thread) {
+    return flushes(flushing, thread);
+  }
+
+  // The entries of instruction buffer in use. The others are never taken.
+  std::span<Instruction> in_use() {
+    return {instruction_buffer.data(), config.rob_entries};
+  }
+
+  // The entries of instruction buffer a thread may take.
+  static unsigned int share_size() {
+    return config.shared_rob ? config.rob_entries : config.rob_entries / config.smt;
+  }
+
+  static unsigned int share_base(unsigned int thread) {
+    return config.shared_rob ? 0 : thread * share_size();
+  }
+
+  // Number of instructions thread holds in instruction buffer.
+  unsigned int held(unsigned int thread) {
+    return (to_unsigned(tail[thread]) - to_unsigned(head[thread])) % (MAX_ROB_ENTRIES * 2);
+  }
+
+  // Position of the k-th oldest instruction of thread.
+  unsigned int oldest(unsigned int thread, unsigned int k) {
+    return to_unsigned(order[thread][(to_unsigned(head[thread]) + k) % MAX_ROB_ENTRIES]);
+  }
+
+  // Position the k-th instruction thread renames in this cycle takes,
+  // or MAX_ROB_ENTRIES when its share has no room for it.
+  unsigned int free_position(unsigned int thread, unsigned int k) {
+    auto base = share_base(thread), size = share_size();
+    auto start = to_unsigned(next_free[thread]) - base;
+    for (unsigned int i = 0; i < size; i++) {
+      auto pos = base + (start + i) % size;
+      if (instruction_buffer[pos].valid == false && k-- == 0) {
+        return pos;
+      }
+    }
+    return MAX_ROB_ENTRIES;
+  }
+
+  // Find the value of instruction tag, or the position to wait for.
+  // An eliminated move that is still waiting stands for the instruction it copies.
+  RenamedOperand resolve(unsigned int tag) {
+    if (instruction_buffer[tag].ready == false && instruction_buffer[tag].alias == true) {
+      tag = to_unsigned(instruction_buffer[tag].source);
+    }
+    unsigned int value;
+    bool poisoned;
+    if (instruction_buffer[tag].ready == true) {
+      return {false, to_unsigned(instruction_buffer[tag].result), static_cast<bool>(instruction_buffer[tag].poisoned)};
+    }
+    if (read_buses(buses, tag, value, poisoned)) {
+      return {false, value, poisoned};
+    }
+    if (instruction_buffer[tag].value_predicted == true) {
+      return {false, to_unsigned(instruction_buffer[tag].result), static_cast<bool>(instruction_buffer[tag].poisoned)};
+    }
+    return {true, tag, false};
+  }
+
+  // The value predicted for the k-th instruction thread issues in this cycle, if it is a load the predictor is sure of.
+  bool predict_load(unsigned int thread, unsigned int k, unsigned int &value) {
+    const FetchedInstructionWire &inst = fetched[thread][k];
+    if (!config.value_prediction || !is_load(static_cast<Op>(to_unsigned(inst.opcode)))) {
+      return false;
+    }
+    auto pc = to_unsigned(inst.pc);
+    unsigned int in_flight = 0; // older instances the predictor has not learned yet
+    for (auto &older: in_use()) {
+      in_flight += older.valid == true && older.thread == thread && older.pc == pc;
+    }
+    for (unsigned int j = 0; j < k; j++) {
+      in_flight += fetched[thread][j].pc == pc;
+    }
+    return value_predictor.predict(pc, in_flight, value);
+  }
+
+  Elimination elimination_of(const FetchedInstructionWire &inst) {
+    if (!config.elimination) {
+      return EXECUTED;
+    }
+    return eliminate(static_cast<Op>(to_unsigned(inst.opcode)), to_unsigned(inst.rs1), to_unsigned(inst.rs2),
+                     to_signed(inst.immediate));
+  }
+
+  // Read register reg_pos of thread for the k-th instruction issued in this cycle.
+  RenamedOperand read_register(unsigned int thread, unsigned int k, unsigned int reg_pos) {
+    if (reg_pos == 0) {
+      return {false, 0, false};
+    }
+    for (auto j = k; j-- > 0;) { // renamed earlier in this cycle
+      const FetchedInstructionWire &earlier = fetched[thread][j];
+      if (earlier.rd == reg_pos) {
+        switch (elimination_of(earlier)) {
+          case EXECUTED: {
+            unsigned int value;
+            if (predict_load(thread, j, value)) {
+              return {false, value, false};
+            }
+            return {true, free_position(thread, j), false};
+          }
+          case MOVE:
+            return read_register(thread, j, to_unsigned(earlier.rs1));
+          default:
+            return {false, to_unsigned(earlier.immediate), false};
+        }
+      }
+    }
+    for (auto j = MAX_ISSUE_WIDTH; j-- > 0;) { // renamed in last cycle
+      if (issued[j].valid == true && issued[j].thread == thread && issued[j].destination == reg_pos) {
+        return resolve(to_unsigned(issued[j].tag));
+      }
+    }
+    const RegisterFileWire &reg = register_files[thread][reg_pos];
+    for (auto j = MAX_COMMIT_WIDTH; j-- > 0;) { // committed in last cycle
+      const CommitSlot &slot = committed[j];
+      if (slot.valid == true && slot.thread == thread && slot.destination == reg_pos &&
+          (reg.pending == false || reg.pending_inst == slot.tag)) {
+        return {false, to_unsigned(slot.value), static_cast<bool>(slot.poisoned)};
+      }
+    }
+    if (reg.pending == true) {
+      return resolve(to_unsigned(reg.pending_inst));
+    }
+    return {false, to_unsigned(reg.data), static_cast<bool>(reg.poisoned)};
+  }
+
+  void fill_pending_data(PendingData &operand, unsigned int thread, unsigned int k, unsigned int reg_pos) {
+    auto value = read_register(thread, k, reg_pos);
+    operand.pending.assign(value.pending);
+    operand.data.assign(value.data);
+    operand.poisoned.assign(value.poisoned);
+  }
+
+  bool drained(unsigned int thread) {
+    return head[thread] == tail[thread];
+  }
+
+  // Value of register reg_pos of thread, when the thread has drained.
+  unsigned int drained_register(unsigned int thread, unsigned int reg_pos) {
+    if (reg_pos == 0) {
+      return 0;
+    }
+    for (auto j = MAX_COMMIT_WIDTH; j-- > 0;) {
+      if (committed[j].valid == true && committed[j].thread == thread && committed[j].destination == reg_pos) {
+        return to_unsigned(committed[j].value);
+      }
+    }
+    return to_unsigned(register_files[thread][reg_pos].data);
+  }
+
+  // Set the csrs of the first thread. Called before the first cycle.
+  void start_at(unsigned int flags, unsigned int rounding, unsigned int page_table) {
+    fflags[0].assign(flags);
+    frm[0].assign(rounding);
+    satp[0].assign(page_table);
+    sync();
+  }
+
+  unsigned int read_csr(unsigned int thread, unsigned int address) {
+    switch (address) {
+      case csr::FFLAGS:
+        return to_unsigned(fflags[thread]);
+      case csr::FRM:
+        return to_unsigned(frm[thread]);
+      case csr::FCSR:
+        return to_unsigned(frm[thread]) << 5 | to_unsigned(fflags[thread]);
+      case csr::SATP:
+        return to_unsigned(satp[thread]);
+      case csr::MHARTID:
+        return hart(thread);
+      default:
+        return csr::read_csr(hart(thread), address);
+    }
+  }
+
+  // Do a csr instruction of thread and return the old value. rs1 is the register field, or the immediate
+  // for the I forms. Only fflags, frm, fcsr and satp are writable; writes to other csrs are ignored.
+  unsigned int access_csr(unsigned int thread, Op op, unsigned int address, unsigned int rs1) {
+    address &= 0xfff;
+    auto old = read_csr(thread, address);
+    bool immediate = op == CSRRWI || op == CSRRSI || op == CSRRCI;
+    auto operand = immediate ? rs1 : drained_register(thread, rs1);
+    if (rs1 == 0 && op != CSRRW && op != CSRRWI) { // csrrs and csrrc with x0 only read
+      return old;
+    }
+    auto value = op == CSRRW || op == CSRRWI ? operand : op == CSRRS || op == CSRRSI ? old | operand : old & ~operand;
+    if (address == csr::FFLAGS || address == csr::FCSR) {
+      fflags[thread].assign(value & 0b11111);
+    }
+    if (address == csr::FRM || address == csr::FCSR) {
+      frm[thread].assign((address == csr::FRM ? value : value >> 5) & 0b111);
+    }
+    if (address == csr::SATP) {
+      satp[thread].assign(value);
+    }
+    return old;
+  }
+
+  void count_eliminated(Elimination elimination) {
+    switch (elimination) {
+      case MOVE:
+        statistics.eliminated_moves++;
+        break;
+      case CONSTANT:
+        statistics.eliminated_constants++;
+        break;
+      case ZERO:
+        statistics.eliminated_zeros++;
+        break;
+      default:
+        break;
+    }
+  }
+
+  unsigned int fetch_available(unsigned int thread) {
+    return (to_unsigned(fetch_tail[thread]) - to_unsigned(fetch_head[thread])) % (FETCH_BUFFER_SIZE * 2);
+  }
+
+  // Whether thread has renamed its halt instruction. A thread other than the first stops there for good,
+  // so that it leaves the back end to the others.
+  bool stopped(unsigned int thread) {
+    if (thread == 0) {
+      return false;
+    }
+    for (auto &inst: in_use()) {
+      if (inst.valid == true && inst.thread == thread && inst.terminate == true) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Instructions of thread waiting to execute, for the ICOUNT policy.
+  unsigned int waiting_count(unsigned int thread) {
+    unsigned int count = 0;
+    for (auto &inst: in_use()) {
+      count += inst.valid == true && inst.thread == thread && inst.ready == false;
+    }
+    return count;
+  }
+
+  // The thread to rename in this cycle, among those with an instruction in fetch buffer and room in instruction buffer,
+  // or config.smt when there is none. Ties go to the thread after the one that renamed last.
+  unsigned int issue_thread_of_cycle() {
+    unsigned int picked = config.smt, fewest = MAX_ROB_ENTRIES + 1;
+    bool waiting = false; // a thread has instructions but no room
+    for (unsigned int i = 1; i <= config.smt; i++) {
+      auto thread = (to_unsigned(issue_thread) + i) % config.smt;
+      if (is_flushing(thread) || fetch_available(thread) == 0 || stopped(thread)) {
+        continue;
+      }
+      if (free_position(thread, 0) == MAX_ROB_ENTRIES) {
+        waiting = true;
+        continue;
+      }
+      auto count = config.fetch_policy == FETCH_ICOUNT ? waiting_count(thread) : 0;
+      if (count < fewest) {
+        picked = thread;
+        fewest = count;
+      }
+    }
+    if (picked == config.smt) {
+      (waiting ? statistics.issue_stall_rob : statistics.fetch_buffer_empty_cycles)++;
+    }
+    return picked;
+  }
+
+  // Take instructions of one thread from its fetch buffer in order until one of the buffers is full.
+  // A csr access waits until all older instructions of its thread have retired, and is done right here;
+  // nothing else issues with it. In runahead it waits for runahead to end.
+  // Moves and constants (see instructions::eliminate) take an entry but no station: a constant is ready at once,
+  // and a move copies its source, or waits for the same broadcast as the source.
+  void issue() {
+    auto thread = issue_thread_of_cycle();
+    auto available = thread < config.smt ? fetch_available(thread) : 0;
+    unsigned int rs_available = to_unsigned(rs_free), lsb_available = to_unsigned(lsb_free);
+    for (auto &slot: issued) { // the bundle still on its way to reservation station and load/store buffer
+      if (slot.valid == true && slot.eliminated == false) {
+        auto op = static_cast<Op>(to_unsigned(slot.opcode));
+        if (!is_csr_access(op)) {
+          (is_memory_access(op) ? lsb_available : rs_available)--;
+        }
+      }
+    }
+    unsigned int count = 0, last_pos = 0;
+    for (; count < config.issue_width && count < available; count++) {
+      auto inst_pos = free_position(thread, count);
+      if (inst_pos == MAX_ROB_ENTRIES) {
+        statistics.issue_stall_rob++;
+        break;
+      }
+      Instruction &inst = instruction_buffer[inst_pos];
+      const FetchedInstructionWire &source = fetched[thread][count];
+      auto op = static_cast<Op>(to_unsigned(source.opcode));
+      auto elimination = elimination_of(source);
+      if (is_csr_access(op)) {
+        if (count > 0 || !drained(thread) || runahead == true) {
+          break;
+        }
+      } else if (elimination == EXECUTED) {
+        unsigned int &station_available = is_memory_access(op) ? lsb_available : rs_available;
+        if (station_available == 0) {
+          (is_memory_access(op) ? statistics.issue_stall_lsb : statistics.issue_stall_rs)++;
+          break;
+        }
+        station_available--;
+      }
+      RenamedOperand value{false, to_unsigned(source.immediate), false}; // result of an eliminated instruction
+      if (elimination == MOVE) {
+        value = read_register(thread, count, to_unsigned(source.rs1));
+      }
+      bool eliminated = elimination != EXECUTED;
+      unsigned int predicted_value = 0;
+      bool value_predicted = predict_load(thread, count, predicted_value);
+      inst.valid.assign(true);
+      inst.thread.assign(thread);
+      // a store only waits to be committed
+      inst.ready.assign(is_store(op) || is_csr_access(op) || (eliminated && !value.pending));
+      inst.alias.assign(eliminated && value.pending);
+      inst.source.assign(value.data % MAX_ROB_ENTRIES);
+      inst.value_predicted.assign(value_predicted);
+      inst.value_mispredicted.assign(false);
+      inst.poisoned.assign(eliminated && !value.pending && value.poisoned);
+      inst.opcode.assign(source.opcode);
+      inst.destination.assign(source.rd);
+      inst.immediate.assign(source.immediate);
+      inst.pc.assign(source.pc);
+      inst.predict.assign(source.predict);
+      inst.terminate.assign(source.terminate);
+      inst.compressed.assign(source.compressed);
+      inst.flags.assign(0);
+      IssueSlot &slot = issued[count];
+      slot.valid.assign(true);
+      slot.tag.assign(inst_pos);
+      slot.thread.assign(thread);
+      slot.opcode.assign(source.opcode);
+      slot.destination.assign(source.rd);
+      fill_pending_data(slot.operands[0], thread, count, to_unsigned(source.rs1));
+      fill_pending_data(slot.operands[1], thread, count, to_unsigned(source.rs2));
+      fill_pending_data(slot.operands[2], thread, count, rs3(op, to_unsigned(source.immediate)));
+      slot.immediate.assign(source.immediate);
+      slot.pc.assign(source.pc);
+      slot.compressed.assign(source.compressed);
+      slot.eliminated.assign(eliminated);
+      if (eliminated && !value.pending) {
+        inst.result.assign(value.data);
+      } else if (value_predicted) {
+        inst.result.assign(predicted_value);
+      }
+      count_eliminated(elimination);
+      order[thread][(to_unsigned(tail[thread]) + count) % MAX_ROB_ENTRIES].assign(inst_pos);
+      last_pos = inst_pos;
+      if (trace::tracker) {
+        trace::tracker->issue(core, hart(thread), to_unsigned(fetch_head[thread]) + count, inst_pos);
+      }
+      if (is_csr_access(op)) {
+        inst.result.assign(access_csr(thread, op, to_unsigned(source.immediate), to_unsigned(source.rs1)));
+        count++;
+        break;
+      }
+      if (source.terminate == true && thread != 0) { // see stopped
+        count++;
+        break;
+      }
+    }
+    clear_slots(issued, count);
+    if (count > 0) {
+      fetch_head[thread].assign(fetch_head[thread] + count);
+      tail[thread].assign((to_unsigned(tail[thread]) + count) % (MAX_ROB_ENTRIES * 2));
+      next_free[thread].assign(share_base(thread) + (last_pos - share_base(thread) + 1) % share_size());
+      issue_thread.assign(thread);
+    }
+    statistics.issued_instructions += static_cast<int>(count);
+  }
+
+  void report_branch(unsigned int thread, const Instruction &inst, bool taken, bool mispredicted) {
+    auto op = static_cast<Op>(to_unsigned(inst.opcode));
+    BranchUpdate &update = branch_update[thread];
+    update.valid.assign(true);
+    // A fused auipc and jalr is predicted at the jalr, so that the fetch stage decodes both in one run.
+    update.pc.assign(op == AUIPC_JALR ? inst.pc + 4 : inst.pc);
+    update.target.assign(inst.pc + inst.immediate);
+    update.taken.assign(taken);
+    update.jump.assign(!is_branch(op));
+    update.mispredicted.assign(mispredicted);
+  }
+
+  void count_committed(unsigned int thread) {
+    statistics.total_committed++;
+    statistics.thread_committed[thread]++;
+  }
+
+  // A fused pair retires as two instructions.
+  void count_fused(unsigned int thread, Op op) {
+    count_committed(thread);
+    switch (op) {
+      case LUI_ADDI:
+        statistics.fused_lui_addi++;
+        break;
+      case AUIPC_JALR:
+        statistics.fused_auipc_jalr++;
+        break;
+      case SLLI_ADD:
+        statistics.fused_slli_add++;
+        break;
+      default:
+        statistics.fused_slli_srli++;
+    }
+  }
+
+  // Value of a0 of the first thread before its k-th instruction committed in this cycle.
+  unsigned int return_register(unsigned int k) {
+    constexpr unsigned int A0 = 10;
+    auto value = to_unsigned(register_files[0][A0].data);
+    for (auto &slot: committed) {
+      if (slot.valid == true && slot.thread == 0 && slot.destination == A0) {
+        value = to_unsigned(slot.value);
+      }
+    }
+    for (unsigned int j = 0; j < k; j++) {
+      const Instruction &inst = instruction_buffer[oldest(0, j)];
+      if (inst.destination == A0) {
+        value = to_unsigned(inst.result);
+      }
+    }
+    return value;
+  }
+
+  // Whether the oldest instruction of thread may retire in this cycle. Only one store or atomic at a time
+  // is let go to memory: store_commit stays up for it, while the other threads retire, until it is done.
+  bool can_commit(unsigned int thread) {
+    if (is_flushing(thread) || drained(thread)) {
+      return false;
+    }
+    auto inst_pos = oldest(thread, 0);
+    const Instruction &inst = instruction_buffer[inst_pos];
+    auto op = static_cast<Op>(to_unsigned(inst.opcode));
+    if (store_commit == true && store_tag == inst_pos) {
+      return is_store(op) ? store_done == true : inst.ready == true;
+    }
+    if (inst.terminate == true && thread != 0) { // see stopped
+      return false;
+    }
+    if (is_store(op) || (is_atomic(op) && inst.ready == false)) {
+      return store_commit == false;
+    }
+    return inst.ready == true;
+  }
+
+  // The thread to retire in this cycle, or config.smt when none may. The thread whose store or atomic is done
+  // goes first, since store_done lasts one cycle; the others take turns.
+  unsigned int commit_thread_of_cycle() {
+    if (store_commit == true) {
+      auto thread = to_unsigned(instruction_buffer[to_unsigned(store_tag)].thread);
+      if (can_commit(thread)) {
+        return thread;
+      }
+    }
+    for (unsigned int i = 1; i <= config.smt; i++) {
+      auto thread = (to_unsigned(commit_thread) + i) % config.smt;
+      if (can_commit(thread)) {
+        return thread;
+      }
+    }
+    return config.smt;
+  }
+
+  // Commit ready instructions of one thread in order.
+  // For branch inst: if mispredicted, flush and stop. Only one branch or jal is reported in a cycle
+  // For store inst: let load/store buffer write it, and wait until that is done
+  // For atomic inst: let load/store buffer send it to memory, and wait for the value it broadcasts
+  // For jalr: flush to its target
+  // For load inst: train the value predictor; if its predicted value was wrong, flush after it
+  // Return whether a flush is started.
+  bool commit() {
+    auto thread = commit_thread_of_cycle();
+    auto count_limit = thread < config.smt ? std::min(config.commit_width, held(thread)) : 0;
+    // store_commit belongs to another thread until its store or atomic is done
+    bool owns_store_commit = store_commit == false || instruction_buffer[to_unsigned(store_tag)].thread == thread;
+    unsigned int count = 0, accrued = 0, trained = VALUE_PREDICTOR_SIZE; // the predictor entry trained in this cycle
+    bool reported = false, ask_store = false, flushed = false;
+    for (; count < count_limit; count++) {
+      auto inst_pos = oldest(thread, count);
+      Instruction &inst = instruction_buffer[inst_pos];
+      auto op = static_cast<Op>(to_unsigned(inst.opcode));
+      if (inst.ready == false && is_atomic(op)) {
+        ask_store = owns_store_commit;
+        if (owns_store_commit) {
+          store_tag.assign(inst_pos);
+        }
+        break;
+      }
+      if (inst.ready == false) {
+        break;
+      }
+      if ((is_branch(op) || is_direct_jump(op)) && reported) {
+        break;
+      }
+      if (is_load(op) && config.value_prediction && ValuePredictor::index_of(to_unsigned(inst.pc)) == trained) {
+        break;
+      }
+      if (is_store(op) && !(store_commit == true && store_tag == inst_pos && store_done == true)) {
+        ask_store = owns_store_commit;
+        if (owns_store_commit) {
+          store_tag.assign(inst_pos);
+        }
+        break;
+      }
+      if (inst.terminate == true) {
+        if (thread == 0) {
+          should_return.assign(true);
+          return_value.assign(return_register(count));
+        }
+        break;
+      }
+      CommitSlot &slot = committed[count];
+      slot.valid.assign(true);
+      slot.tag.assign(inst_pos);
+      slot.thread.assign(thread);
+      slot.destination.assign(inst.destination);
+      slot.value.assign(inst.result);
+      slot.poisoned.assign(false);
+      inst.valid.assign(false);
+      accrued |= to_unsigned(inst.flags);
+      count_committed(thread);
+      if (trace::tracker) {
+        trace::tracker->commit(core, hart(thread), inst_pos, to_unsigned(inst.pc),
+                               is_memory_access(op) ? trace::tracker->address_of(core, inst_pos) : 0,
+                               is_branch(op) && static_cast<bool>(inst.result), op);
+      }
+      if (is_fused(op)) {
+        count_fused(thread, op);
+      }
+      if (is_branch(op)) {
+        statistics.total_predict++;
+        auto result = static_cast<bool>(inst.result);
+        report_branch(thread, inst, result, result != inst.predict);
+        reported = true;
+        if (result != inst.predict) {
+          flush_pc[thread].assign(inst.pc + (result ? to_signed(inst.immediate) : inst.compressed == true ? 2 : 4));
+          flushed = true;
+          count++;
+          break;
+        }
+        statistics.correct_predict++;
+      } else if (is_direct_jump(op)) {
+        report_branch(thread, inst, true, false);
+        reported = true;
+      } else if (op == JALR) {
+        flush_pc[thread].assign(inst.target);
+        flushed = true;
+        count++;
+        break;
+      } else if (is_atomic(op)) {
+        statistics.atomic_operations++;
+      } else if (is_load(op)) {
+        statistics.committed_loads++;
+        if (config.value_prediction) {
+          value_predictor.train(to_unsigned(inst.pc), to_unsigned(inst.result));
+          trained = ValuePredictor::index_of(to_unsigned(inst.pc));
+        }
+        if (inst.value_predicted == true) {
+          statistics.predicted_loads++;
+          if (inst.value_mispredicted == true) {
+            statistics.value_mispredicts++;
+            flush_pc[thread].assign(inst.pc + (inst.compressed == true ? 2 : 4));
+            flushed = true;
+            count++;
+            break;
+          }
+        }
+      }
+    }
+    clear_slots(committed, count);
+    for (unsigned int other = 0; other < config.smt; other++) {
+      if (other != thread || !reported) {
+        branch_update[other].valid.assign(false);
+      }
+    }
+    if (owns_store_commit) {
+      store_commit.assign(ask_store);
+    }
+    if (thread == config.smt) {
+      return false;
+    }
+    if (accrued & ~to_unsigned(fflags[thread])) {
+      fflags[thread].assign(to_unsigned(fflags[thread]) | accrued);
+    }
+    if (flushed) {
+      flushing.assign(1u << thread);
+    }
+    head[thread].assign((to_unsigned(head[thread]) + count) % (MAX_ROB_ENTRIES * 2));
+    commit_thread.assign(thread);
+    return flushed;
+  }
+
+  // Retire ready instructions at head in runahead. Nothing they do may last: the register file takes their results
+  // but restores its checkpoint afterwards, load/store buffer drops stores, and predictors and fflags are untouched.
+  // A mispredicted branch still flushes, so that runahead goes on along the right path; a poisoned one follows
+  // its prediction. A poisoned jalr and the halt instruction wait for runahead to end.
+  // Runahead is only used with one thread. Return whether a flush is started.
+  bool retire_runahead() {
+    unsigned int count = 0;
+    bool flushed = false;
+    for (; count < config.commit_width && count < held(0); count++) {
+      auto inst_pos = oldest(0, count);
+      Instruction &inst = instruction_buffer[inst_pos];
+      auto op = static_cast<Op>(to_unsigned(inst.opcode));
+      if (inst.ready == false || inst.terminate == true || (op == JALR && inst.poisoned == true)) {
+        break;
+      }
+      CommitSlot &slot = committed[count];
+      slot.valid.assign(true);
+      slot.tag.assign(inst_pos);
+      slot.thread.assign(0);
+      slot.destination.assign(inst.destination);
+      slot.value.assign(inst.result);
+      slot.poisoned.assign(inst.poisoned);
+      inst.valid.assign(false);
+      statistics.runahead_instructions++;
+      auto result = static_cast<bool>(inst.result);
+      if (is_branch(op) && inst.poisoned == false && result != inst.predict) {
+        flush_pc[0].assign(inst.pc + (result ? to_signed(inst.immediate) : inst.compressed == true ? 2 : 4));
+        flushed = true;
+      } else if (op == JALR) {
+        flush_pc[0].assign(inst.target);
+        flushed = true;
+      }
+      if (flushed) {
+        flushing.assign(1);
+        count++;
+        break;
+      }
+    }
+    clear_slots(committed, count);
+    branch_update[0].valid.assign(false);
+    store_commit.assign(false);
+    head[0].assign((to_unsigned(head[0]) + count) % (MAX_ROB_ENTRIES * 2));
+    return flushed;
+  }
+
+  // Whether the load at head waits for a line fill, and a full buffer has stopped issue.
+  bool blocked_on_memory() {
+    if (drained(0)) {
+      return false;
+    }
+    const Instruction &inst = instruction_buffer[oldest(0, 0)];
+    bool full = free_position(0, 0) == MAX_ROB_ENTRIES || rs_free == 0 || lsb_free == 0;
+    return load_missing == true && full && inst.ready == false && is_load(static_cast<Op>(to_unsigned(inst.opcode)));
+  }
+
+  // Mark instructions whose results are broadcast in this cycle.
+  void listen_buses() {
+    for (auto &bus: buses) {
+      if (bus.valid == true) {
+        Instruction &inst = instruction_buffer[to_unsigned(bus.tag)];
+        if (inst.valid == true && inst.ready == false) {
+          if (inst.value_predicted == true) {
+            inst.value_mispredicted.assign(bus.value != inst.result);
+          }
+          inst.ready.assign(true);
+          inst.result.assign(bus.value);
+          inst.target.assign(bus.target);
+          inst.flags.assign(bus.flags);
+          inst.poisoned.assign(bus.poisoned);
+        }
+      }
+    }
+    for (auto &inst: in_use()) { // waiting moves copy the value of their source
+      unsigned int value;
+      bool poisoned;
+      if (inst.alias == true && inst.ready == false && inst.valid == true &&
+          read_buses(buses, to_unsigned(inst.source), value, poisoned)) {
+        inst.ready.assign(true);
+        inst.result.assign(value);
+        inst.poisoned.assign(poisoned);
+      }
+    }
+  }
+
+  // Drop the instructions of thread, and start its fetch buffer over.
+  void flush(unsigned int thread) {
+    for (auto &inst: in_use()) {
+      if (inst.valid == true && inst.thread == thread) {
+        inst.valid.assign(false);
+      }
+    }
+    head[thread].assign(0);
+    tail[thread].assign(0);
+    next_free[thread].assign(share_base(thread));
+    fetch_head[thread].assign(0);
+    if (trace::tracker) {
+      trace::tracker->flush(hart(thread));
+    }
+  }
+
+  void work() override {
+    bool any_flushing = false, all_flushing = true;
+    for (unsigned int thread = 0; thread < config.smt; thread++) {
+      if (is_flushing(thread)) {
+        flush(thread);
+        any_flushing = true;
+      } else {
+        all_flushing = false;
+      }
+    }
+    if (all_flushing) { // nothing else happens in this cycle
+      for (auto &slot: issued) {
+        slot.valid.assign(false);
+      }
+      for (auto &slot: committed) {
+        slot.valid.assign(false);
+      }
+      for (auto &update: branch_update) {
+        update.valid.assign(false);
+      }
+      store_commit.assign(false);
+      flushing.assign(0);
+      return;
+    }
+    if (runahead == true && load_missing == false) { // the line is here: go back to the load
+      flush_pc[0].assign(runahead_pc);
+      flushing.assign(1);
+      runahead.assign(false);
+      return;
+    }
+    listen_buses();
+    if (runahead == true) {
+      statistics.runahead_cycles++;
+      if (!retire_runahead()) {
+        issue();
+      }
+      return;
+    }
+    if (config.runahead && blocked_on_memory()) {
+      runahead.assign(true);
+      runahead_pc.assign(instruction_buffer[oldest(0, 0)].pc);
+      statistics.runahead_periods++;
+    }
+    if (commit()) { // the renames of the flushing thread would be dropped, and the others wait a cycle
+      for (auto &slot: issued) {
+        slot.valid.assign(false);
+      }
+      return;
+    }
+    if (any_flushing) {
+      flushing.assign(0);
+    }
+    issue();
+  }
+};
+
+#endif //RISC_V_REORDER_BUFFER_HPP
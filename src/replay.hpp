@@ -0,0 +1,238 @@
+#ifndef RISC_V_REPLAY_HPP
+#define RISC_V_REPLAY_HPP
+
+#include <algorithm>
+#include <deque>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "trace.hpp"
+
+// Trace-driven timing: with --replay, System runs without a program in memory, on the code and the values of
+// a trace written with --trace. The fetch stage of each hart decodes the code the trace has at each pc, and the
+// loads and atomics of the core broadcast the values the trace has for them instead of what data cache holds;
+// everything else, the back end included, runs as it does for a program, and computes the same registers from them.
+// Under the options the trace was written with, the run delivers the same instructions in the same cycles,
+// committed and thrown away alike, so each gets the value of the same record, and the cycles are those of the run
+// that wrote the trace. Under other options the delivered instructions differ once a prediction does: a delivered
+// instruction then takes the values of the committed record it is at, following the path from the last commit
+// or flush, and one off that path, which will be thrown away, keeps what data cache holds. Commits must follow
+// the trace; a program whose path depends on timing, such as one spinning on another hart or reading the cycle
+// counter, may leave it under other options, which stops the run.
+namespace replay {
+  constexpr unsigned int LOOKAHEAD = 1 << 10; // records read ahead of those needed by each hart
+  constexpr unsigned int SLOTS = 1 << 8; // delivered slots kept by serial, more than those in flight
+  constexpr unsigned long long NONE = ~0ull;
+
+  class Feed : public trace::Tracker {
+    // The record a delivered slot was found at.
+    struct Slot {
+      unsigned long long serial = NONE;
+      unsigned long long record = NONE;
+      bool valued = false;
+      unsigned int value = 0;
+    };
+
+    struct Stream {
+      std::deque<trace::Record> records;
+      unsigned long long base = 0; // index of the first record kept
+      std::unordered_map<unsigned int, unsigned int> halves; // the code of the records, by pc
+      unsigned long long sequential = 0; // the record after the last delivered
+      bool in_step = true; // every slot so far was delivered as the trace has it
+      unsigned long long path = 0; // after the last committed record delivered since the last commit or flush
+      bool on_path = true;
+      unsigned long long committed = 0; // after the last committed record
+      std::vector<Slot> slots = std::vector<Slot>(SLOTS);
+      bool upcoming_valued = false; // the next committed record, for the in-order core
+      unsigned int upcoming_value = 0;
+    };
+
+    trace::Reader reader;
+    bool ended = false;
+    unsigned int return_value = 0;
+    std::vector<Stream> streams = std::vector<Stream>(config.cores * config.smt);
+
+    const trace::Record *record_at(Stream &stream, unsigned long long index) {
+      if (index < stream.base || index - stream.base >= stream.records.size()) {
+        return nullptr;
+      }
+      return &stream.records[index - stream.base];
+    }
+
+    // The index of the first committed record at or after index, or NONE if it is not read yet.
+    unsigned long long committed_from(Stream &stream, unsigned long long index) {
+      for (auto record = record_at(stream, index); record; record = record_at(stream, ++index)) {
+        if (!record->squashed) {
+          return index;
+        }
+      }
+      return NONE;
+    }
+
+    // The index after the committed records of a slot of count instructions starting at index.
+    unsigned long long after_slot(Stream &stream, unsigned long long index, unsigned int count) {
+      for (unsigned int i = 1; i < count && index != NONE; i++) {
+        index = committed_from(stream, index + 1);
+      }
+      return index == NONE ? NONE : index + 1;
+    }
+
+    void read_record() {
+      auto record = reader.next();
+      if (record.end) {
+        ended = true;
+        return_value = record.return_value;
+        return;
+      }
+      Stream &stream = streams[record.hart];
+      stream.halves[record.pc] = record.code & 0xffff;
+      if (!is_compressed(record.code & 0xffff)) {
+        stream.halves[record.pc + 2] = record.code >> 16;
+      }
+      stream.records.push_back(record);
+    }
+
+    // Read until each hart has LOOKAHEAD records past those it needs, without keeping too many of one
+    // that runs ahead of another in the trace.
+    void read_ahead() {
+      while (!ended) {
+        bool short_of = false, long_of = false;
+        for (auto &stream: streams) {
+          auto need = std::max(stream.in_step ? stream.sequential : stream.path, stream.committed) + LOOKAHEAD;
+          auto held = stream.base + stream.records.size();
+          short_of |= held < need;
+          long_of |= held > need + (1 << 16);
+        }
+        if (!short_of || long_of) {
+          return;
+        }
+        read_record();
+      }
+    }
+
+    // Find the record of each slot hart delivered in the cycle.
+    void take_deliveries(unsigned int hart) {
+      Stream &stream = streams[hart];
+      for (auto &delivery: harts[hart].deliveries) {
+        auto match = NONE;
+        if (stream.on_path) {
+          auto index = committed_from(stream, stream.path);
+          auto record = index == NONE ? nullptr : record_at(stream, index);
+          stream.on_path = record && record->pc == delivery.pc;
+          if (stream.on_path) {
+            match = index;
+            stream.path = after_slot(stream, index, delivery.count);
+            stream.on_path = stream.path != NONE;
+          }
+        }
+        if (stream.in_step) {
+          auto record = record_at(stream, stream.sequential);
+          stream.in_step = record && record->pc == delivery.pc;
+          if (stream.in_step) {
+            match = stream.sequential;
+            stream.sequential += delivery.count;
+          }
+        }
+        Slot &slot = stream.slots[delivery.serial % SLOTS];
+        auto record = match == NONE ? nullptr : record_at(stream, match);
+        slot.serial = delivery.serial;
+        slot.record = match;
+        slot.valued = record && record->valued;
+        slot.value = record ? record->value : 0;
+      }
+      harts[hart].deliveries.clear();
+    }
+
+    // Check each instruction hart committed in the cycle against the trace.
+    void take_commits(unsigned int hart) {
+      Stream &stream = streams[hart];
+      for (auto &commit: harts[hart].commits) {
+        auto index = committed_from(stream, stream.committed);
+        auto record = index == NONE ? nullptr : record_at(stream, index);
+        if (!record || record->pc != commit.pc) {
+          std::ostringstream message;
+          message << "Replay of hart " << hart << " left the trace at pc 0x" << std::hex << commit.pc;
+          throw std::runtime_error(message.str());
+        }
+        // a slot delivered in step but committed against the trace has different instructions thrown away
+        if (commit.serial != trace::NO_SERIAL) {
+          const Slot &slot = stream.slots[commit.serial % SLOTS];
+          if (slot.serial != commit.serial || slot.record != index) {
+            stream.in_step = false;
+          }
+        }
+        stream.committed = after_slot(stream, index, commit.count);
+        if (stream.committed == NONE) {
+          throw std::runtime_error("Replay of hart " + std::to_string(hart) + " ran past the trace");
+        }
+      }
+      harts[hart].commits.clear();
+      if (harts[hart].flushed) {
+        stream.path = stream.committed;
+        stream.on_path = true;
+        harts[hart].flushed = false;
+      }
+      while (stream.base < stream.committed && !stream.records.empty()) {
+        stream.records.pop_front();
+        stream.base++;
+      }
+      auto next = committed_from(stream, stream.committed);
+      auto record = next == NONE ? nullptr : record_at(stream, next);
+      stream.upcoming_valued = record && record->valued;
+      stream.upcoming_value = record ? record->value : 0;
+    }
+
+  public:
+    // Start a replay of the trace at path, which must have the harts of config.
+    explicit Feed(const std::string &path) : reader(path) {
+      if (reader.harts != config.cores * config.smt) {
+        throw std::runtime_error("Trace " + path + " has " + std::to_string(reader.harts) +
+                                 " harts, and the options give " + std::to_string(config.cores * config.smt));
+      }
+      read_ahead();
+      for (unsigned int hart = 0; hart < streams.size(); hart++) {
+        take_commits(hart);
+      }
+    }
+
+    unsigned int fetched_half(unsigned int hart, unsigned int pc, unsigned int half) override {
+      auto &halves = streams[hart].halves;
+      auto it = halves.find(pc);
+      return it == halves.end() ? half : it->second;
+    }
+
+    unsigned int loaded(unsigned int core, unsigned int thread, unsigned int tag, unsigned int value) override {
+      auto serial = entries[core][tag];
+      const Slot &slot = streams[core * config.smt + thread].slots[serial % SLOTS];
+      return slot.serial == serial && slot.valued ? slot.value : value;
+    }
+
+    unsigned int written_back(unsigned int hart, unsigned int value) override {
+      return streams[hart].upcoming_valued ? streams[hart].upcoming_value : value;
+    }
+
+    void end_cycle() override {
+      for (unsigned int hart = 0; hart < streams.size(); hart++) {
+        take_deliveries(hart);
+        take_commits(hart);
+      }
+      read_ahead();
+    }
+
+    // Check that the program returns what it did in the trace.
+    void finish(unsigned int value) override {
+      end_cycle();
+      while (!ended) {
+        read_record();
+      }
+      if (value != return_value) {
+        throw std::runtime_error("Replay returns " + std::to_string(value) + ", and the trace " +
+                                 std::to_string(return_value));
+      }
+    }
+  };
+}
+
+#endif //RISC_V_REPLAY_HPP
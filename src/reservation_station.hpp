@@ -0,0 +1,195 @@
+#ifndef RISC_V_RESERVATION_STATION_HPP
+#define RISC_V_RESERVATION_STATION_HPP
+
+#include <span>
+#include "alu.hpp"
+#include "bundles.hpp"
+#include "config.hpp"
+
+struct ReservationStationInput {
+  IssueSlots issued;
+  ResultBuses buses;
+  ThreadMaskWire flushing;
+  FlagWire divider_busy;
+};
+
+struct ReservationStationOutput {
+  std::array<ResultBus, MAX_ALUS> alu_buses;
+  UnitRequest multiply_request;
+  UnitRequest divide_request;
+  UnitRequest float_request;
+  UnitRequest float_divide_request;
+  StationCount free_count; // free entries at the end of last cycle
+};
+
+struct StationEntry {
+  Flag valid;
+  InstPos tag;
+  ThreadIndex thread;
+  OpCode opcode;
+  std::array<PendingData, 3> operands;
+  Data immediate;
+  Data pc;
+  Flag compressed;
+};
+
+struct ReservationStationData {
+  std::array<StationEntry, MAX_RS_ENTRIES> entries;
+};
+
+// Instructions other than loads and stores wait here for their operands.
+// Each cycle up to config.alus ready instructions are executed, and each ALU broadcasts on its own bus.
+// Multiplies, divides and floating-point instructions are sent to their own units, one per unit per cycle.
+// In runahead, an ALU result is poisoned if an operand is; the other units do not track poison.
+// A flush drops the entries of the flushing threads; the others go on executing in the same cycle.
+struct ReservationStation : dark::Module<ReservationStationInput, ReservationStationOutput, ReservationStationData> {
+  Statistics &statistics; // of the core
+
+  explicit ReservationStation(Statistics &statistics) : statistics(statistics) {}
+
+  // The entries in use, config.rs_entries of them. The others are never taken.
+  std::span<StationEntry> in_use() {
+    return {entries.data(), config.rs_entries};
+  }
+
+  // Drop the entries of flushing threads. Return how many there were.
+  unsigned int flush() {
+    unsigned int count = 0;
+    for (auto &entry: in_use()) {
+      if (entry.valid == true && flushes(flushing, to_unsigned(entry.thread))) {
+        entry.valid.assign(false);
+        count++;
+      }
+    }
+    return count;
+  }
+
+  static void send(UnitRequest &request, const StationEntry &entry) {
+    request.valid.assign(true);
+    request.tag.assign(entry.tag);
+    request.thread.assign(entry.thread);
+    request.opcode.assign(entry.opcode);
+    request.rs1.assign(entry.operands[0].data);
+    request.rs2.assign(entry.operands[1].data);
+    request.rs3.assign(entry.operands[2].data);
+    request.rounding_mode.assign(to_unsigned(entry.immediate) & 0b111);
+  }
+
+  static bool operands_ready(const StationEntry &entry) {
+    return entry.operands[0].pending == false && entry.operands[1].pending == false &&
+           entry.operands[2].pending == false;
+  }
+
+  // Execute ready instructions, lowest position first. Return how many entries were freed.
+  unsigned int execute() {
+    unsigned int unit = 0;
+    bool multiply_sent = false, divide_sent = false, divide_waiting = false;
+    bool float_sent = false, float_divide_sent = false;
+    bool divider_free = divider_busy == false && divide_request.valid == false; // the last request may not have arrived
+    for (unsigned int i = 0; i < config.rs_entries; i++) {
+      StationEntry &entry = entries[i];
+      if (entry.valid == false || !operands_ready(entry) || flushes(flushing, to_unsigned(entry.thread))) {
+        continue;
+      }
+      auto op = static_cast<Op>(to_unsigned(entry.opcode));
+      if (is_multiply(op)) {
+        if (multiply_sent) {
+          continue;
+        }
+        send(multiply_request, entry);
+        multiply_sent = true;
+      } else if (is_divide(op)) {
+        if (divide_sent || !divider_free) {
+          divide_waiting = !divide_sent;
+          continue;
+        }
+        send(divide_request, entry);
+        divide_sent = true;
+      } else if (is_floating_point(op)) {
+        bool &sent = is_float_divide(op) ? float_divide_sent : float_sent;
+        if (sent) {
+          continue;
+        }
+        send(is_float_divide(op) ? float_divide_request : float_request, entry);
+        sent = true;
+      } else {
+        if (unit == config.alus) {
+          continue;
+        }
+        auto rs1 = to_signed(entry.operands[0].data);
+        auto rs2 = to_signed(entry.operands[1].data);
+        auto imm = to_signed(entry.immediate);
+        ResultBus &bus = alu_buses[unit++];
+        bus.valid.assign(true);
+        bus.tag.assign(entry.tag);
+        bus.value.assign(execute_alu(op, rs1, rs2, imm, to_unsigned(entry.pc), static_cast<bool>(entry.compressed)));
+        bus.target.assign(static_cast<unsigned int>(rs1 + imm));
+        bus.poisoned.assign(entry.operands[0].poisoned == true || entry.operands[1].poisoned == true);
+      }
+      entry.valid.assign(false);
+    }
+    clear_slots(alu_buses, unit);
+    if (!multiply_sent) {
+      multiply_request.valid.assign(false);
+    }
+    if (!divide_sent) {
+      divide_request.valid.assign(false);
+    }
+    if (!float_sent) {
+      float_request.valid.assign(false);
+    }
+    if (!float_divide_sent) {
+      float_divide_request.valid.assign(false);
+    }
+    statistics.divider_busy_cycles += divide_waiting;
+    return unit + multiply_sent + divide_sent + float_sent + float_divide_sent;
+  }
+
+  // Put newly issued instructions into free entries.
+  unsigned int insert() {
+    unsigned int pos = 0, count = 0;
+    for (auto &slot: issued) {
+      auto op = static_cast<Op>(to_unsigned(slot.opcode));
+      if (slot.valid == false || slot.eliminated == true || is_memory_access(op) || is_csr_access(op) ||
+          flushes(flushing, to_unsigned(slot.thread))) {
+        continue;
+      }
+      while (entries[pos].valid == true) {
+        pos++; // the reorder buffer never issues more than free_count
+      }
+      StationEntry &entry = entries[pos++];
+      entry.valid.assign(true);
+      entry.tag.assign(slot.tag);
+      entry.thread.assign(slot.thread);
+      entry.opcode.assign(slot.opcode);
+      listen(entry.operands[0], slot.operands[0], buses);
+      listen(entry.operands[1], slot.operands[1], buses);
+      listen(entry.operands[2], slot.operands[2], buses);
+      entry.immediate.assign(slot.immediate);
+      entry.pc.assign(slot.pc);
+      entry.compressed.assign(slot.compressed);
+      count++;
+    }
+    return count;
+  }
+
+  void work() override {
+    unsigned int used = 0;
+    for (auto &entry: in_use()) {
+      used += static_cast<bool>(entry.valid);
+    }
+    auto dropped = flush();
+    auto executed = execute();
+    for (auto &entry: in_use()) {
+      if (entry.valid == true && !flushes(flushing, to_unsigned(entry.thread))) {
+        listen(entry.operands[0], buses);
+        listen(entry.operands[1], buses);
+        listen(entry.operands[2], buses);
+      }
+    }
+    auto inserted = insert();
+    free_count.assign(config.rs_entries - used - inserted + executed + dropped);
+  }
+};
+
+#endif //RISC_V_RESERVATION_STATION_HPP
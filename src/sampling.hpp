@@ -0,0 +1,279 @@
+#ifndef RISC_V_SAMPLING_HPP
+#define RISC_V_SAMPLING_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "functional.hpp"
+#include "fork_pool.hpp"
+#include "system.hpp"
+
+// Sampled simulation in the manner of SimPoint: the program is cut into intervals of config.sample_interval
+// instructions, the intervals are clustered by the basic blocks they execute, and a few intervals of each cluster,
+// chosen at random, are simulated in detail. CPI of the program is estimated from those, with the clusters as
+// strata weighted by their size.
+namespace sampling {
+  constexpr unsigned int DIMENSIONS = 15; // basic block vectors are randomly projected to this many dimensions
+  constexpr unsigned int KMEANS_ITERATIONS = 100;
+  constexpr unsigned int SEED = 42;
+
+  using Vector = std::array<double, DIMENSIONS>;
+
+  struct Interval {
+    Vector projected{}; // basic block vector, projected and divided by instructions
+    unsigned long long instructions = 0;
+  };
+
+  // The d-th coordinate of the random direction a basic block is projected along, uniform in [-1, 1).
+  double projection(unsigned int block, unsigned int d) {
+    unsigned long long x = (static_cast<unsigned long long>(block) << 4 | d) * 0x9e3779b97f4a7c15ull;
+    x ^= x >> 31;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 29;
+    return static_cast<double>(x >> 11) / static_cast<double>(1ull << 52) - 1;
+  }
+
+  double distance(const Vector &a, const Vector &b) {
+    double sum = 0;
+    for (unsigned int d = 0; d < DIMENSIONS; d++) {
+      sum += (a[d] - b[d]) * (a[d] - b[d]);
+    }
+    return sum;
+  }
+
+  // Run the whole program functionally and return the basic block vectors of its intervals. A basic block is
+  // named by its first pc, and ends with a branch or jump.
+  std::vector<Interval> profile(ArchState &final_state) {
+    FunctionalCore core;
+    std::vector<Interval> intervals;
+    Interval current;
+    unsigned int block = core.state.pc;
+    unsigned int length = 0;
+    auto end_block = [&]() {
+      for (unsigned int d = 0; d < DIMENSIONS; d++) {
+        current.projected[d] += length * projection(block, d);
+      }
+      length = 0;
+    };
+    auto end_interval = [&]() {
+      end_block();
+      for (auto &x: current.projected) {
+        x /= static_cast<double>(current.instructions);
+      }
+      intervals.push_back(current);
+      current = {};
+    };
+    while (!core.state.halted) {
+      auto result = core.step();
+      if (core.state.halted) {
+        break;
+      }
+      length++;
+      current.instructions++;
+      if (is_branch(result.inst.op) || result.inst.op == JAL || result.inst.op == JALR) {
+        end_block();
+        block = result.next_pc;
+      }
+      if (current.instructions == config.sample_interval) {
+        end_interval();
+        block = result.next_pc;
+      }
+    }
+    if (current.instructions > 0) {
+      end_interval();
+    }
+    final_state = core.state;
+    return intervals;
+  }
+
+  // Cluster intervals into at most k clusters with k-means, seeded by k-means++, and return the cluster of each.
+  std::vector<unsigned int> cluster(const std::vector<Interval> &intervals, unsigned int k) {
+    std::mt19937 random(SEED);
+    std::vector<Vector> centroids{intervals[std::uniform_int_distribution<size_t>(0, intervals.size() - 1)(random)]
+                                      .projected};
+    std::vector<double> nearest(intervals.size());
+    while (centroids.size() < k) {
+      double total = 0;
+      for (size_t i = 0; i < intervals.size(); i++) {
+        nearest[i] = distance(intervals[i].projected, centroids[0]);
+        for (auto &centroid: centroids) {
+          nearest[i] = std::min(nearest[i], distance(intervals[i].projected, centroid));
+        }
+        total += nearest[i];
+      }
+      if (total == 0) { // fewer distinct intervals than k
+        break;
+      }
+      std::discrete_distribution<size_t> pick(nearest.begin(), nearest.end());
+      centroids.push_back(intervals[pick(random)].projected);
+    }
+    std::vector<unsigned int> assignment(intervals.size());
+    for (unsigned int iteration = 0; iteration < KMEANS_ITERATIONS; iteration++) {
+      bool changed = false;
+      for (size_t i = 0; i < intervals.size(); i++) {
+        unsigned int best = 0;
+        for (unsigned int c = 1; c < centroids.size(); c++) {
+          if (distance(intervals[i].projected, centroids[c]) < distance(intervals[i].projected, centroids[best])) {
+            best = c;
+          }
+        }
+        changed |= iteration == 0 || assignment[i] != best;
+        assignment[i] = best;
+      }
+      if (!changed) {
+        break;
+      }
+      std::vector<Vector> sums(centroids.size());
+      std::vector<unsigned int> counts(centroids.size());
+      for (size_t i = 0; i < intervals.size(); i++) {
+        for (unsigned int d = 0; d < DIMENSIONS; d++) {
+          sums[assignment[i]][d] += intervals[i].projected[d];
+        }
+        counts[assignment[i]]++;
+      }
+      for (unsigned int c = 0; c < centroids.size(); c++) {
+        if (counts[c] > 0) {
+          for (unsigned int d = 0; d < DIMENSIONS; d++) {
+            centroids[c][d] = sums[c][d] / counts[c];
+          }
+        }
+      }
+    }
+    return assignment;
+  }
+
+  // A cluster of intervals, the stratum its simulated intervals are a random sample of.
+  struct Cluster {
+    double weight = 0; // share of the instructions of the program in the cluster
+    unsigned int members = 0;
+  };
+
+  // An interval simulated in detail.
+  struct SimPoint {
+    unsigned int interval;
+    unsigned int cluster;
+    unsigned long long cycles = 0;
+    unsigned long long instructions = 0;
+  };
+
+  // Describe the clusters, and pick config.samples_per_cluster intervals of each at random, or all of a smaller one.
+  std::vector<SimPoint> choose(const std::vector<Interval> &intervals, const std::vector<unsigned int> &assignment,
+                               std::vector<Cluster> &clusters) {
+    unsigned long long total = 0;
+    for (auto &interval: intervals) {
+      total += interval.instructions;
+    }
+    clusters.assign(*std::max_element(assignment.begin(), assignment.end()) + 1, {});
+    std::vector<std::vector<unsigned int>> members(clusters.size());
+    for (size_t i = 0; i < intervals.size(); i++) {
+      clusters[assignment[i]].weight += static_cast<double>(intervals[i].instructions) / total;
+      clusters[assignment[i]].members++;
+      members[assignment[i]].push_back(static_cast<unsigned int>(i));
+    }
+    std::mt19937 random(SEED);
+    std::vector<SimPoint> points;
+    for (unsigned int c = 0; c < clusters.size(); c++) {
+      std::shuffle(members[c].begin(), members[c].end(), random);
+      for (size_t i = 0; i < std::min<size_t>(members[c].size(), config.samples_per_cluster); i++) {
+        points.push_back({members[c][i], c});
+      }
+    }
+    std::sort(points.begin(), points.end(), [](auto &a, auto &b) { return a.interval < b.interval; });
+    return points;
+  }
+
+  // In a child forked at state: simulate warmup instructions in detail, then measure the next length instructions.
+  void measure(const ArchState &state, unsigned long long warmup, unsigned long long length, SimPoint &point) {
+    System system;
+    system.cores[0]->start_at(state);
+    while (!system.halted() && system.committed() < warmup) {
+      system.run_cycle();
+    }
+    auto start_tick = total_tick;
+    auto start_committed = system.committed();
+    while (!system.halted() && system.committed() - start_committed < length) {
+      system.run_cycle();
+    }
+    point.cycles = total_tick - start_tick;
+    point.instructions = system.committed() - start_committed;
+  }
+
+  // Run the program functionally again, forking a child to measure each point when it reaches its warm-up.
+  void simulate(std::vector<SimPoint> &points) {
+    ForkPool<SimPoint> pool;
+    FunctionalCore core;
+    for (auto &point: points) {
+      auto start = static_cast<unsigned long long>(point.interval) * config.sample_interval;
+      auto fork_at = start > config.warmup ? start - config.warmup : 0;
+      while (core.state.retired < fork_at) {
+        core.step();
+      }
+      pool.spawn(point, "Simulation point " + std::to_string(point.interval), [&](SimPoint &result) {
+        if (pool.jobs() > 1 && config.threads == 0) { // the children already share the host
+          config.threads = 1;
+        }
+        measure(core.state, start - fork_at, config.sample_interval, result);
+      });
+    }
+    pool.wait();
+  }
+
+  // Estimate the cycles of the program from the simulation points. Prints the estimate to stderr, as main prints
+  // the measured cycles, and returns the value the program returns.
+  unsigned int run() {
+    ArchState final_state;
+    auto intervals = profile(final_state);
+    if (intervals.empty()) {
+      return final_state.return_value();
+    }
+    std::vector<Cluster> clusters;
+    auto points = choose(intervals, cluster(intervals, std::min<size_t>(config.simpoints, intervals.size())), clusters);
+    simulate(points);
+    // Stratified sampling: CPI of a cluster is the mean over its points, and the variance of that mean, from the
+    // spread within the cluster and less the share of the cluster simulated, gives the 95% confidence bound.
+    // A cluster with only one point measured adds no variance. The bound covers sampling alone, not the error of
+    // warming the machine up for only config.warmup instructions.
+    std::vector<std::vector<double>> cpis(clusters.size());
+    for (auto &point: points) {
+      if (point.instructions == 0) {
+        continue;
+      }
+      auto point_cpi = static_cast<double>(point.cycles) / point.instructions;
+      std::cerr << "simpoint " << point.interval << ": cluster " << point.cluster << ", CPI " << point_cpi
+                << " (" << point.instructions << "/" << point.cycles << ")" << std::endl;
+      cpis[point.cluster].push_back(point_cpi);
+    }
+    double cpi = 0, variance = 0, weights = 0;
+    for (unsigned int c = 0; c < clusters.size(); c++) {
+      auto n = static_cast<double>(cpis[c].size());
+      if (n == 0) {
+        continue;
+      }
+      double mean = 0, squares = 0;
+      for (auto x: cpis[c]) {
+        mean += x / n;
+      }
+      for (auto x: cpis[c]) {
+        squares += (x - mean) * (x - mean);
+      }
+      auto weight = clusters[c].weight;
+      cpi += weight * mean;
+      weights += weight;
+      if (n > 1) {
+        variance += weight * weight * (1 - n / clusters[c].members) * squares / (n - 1) / n;
+      }
+    }
+    cpi /= weights;
+    double bound = 1.96 * std::sqrt(variance) / weights;
+    std::cerr << "estimated CPI: " << cpi << " +- " << bound << " at 95% confidence (" << points.size() << " of "
+              << intervals.size() << " intervals in " << clusters.size() << " clusters)" << std::endl;
+    std::cerr << final_state.retired << "/" << static_cast<unsigned long long>(cpi * final_state.retired)
+              << " (estimated, " << static_cast<unsigned long long>(std::max(0.0, cpi - bound) * final_state.retired)
+              << " to " << static_cast<unsigned long long>((cpi + bound) * final_state.retired) << ")" << std::endl;
+    return final_state.return_value();
+  }
+}
+
+#endif //RISC_V_SAMPLING_HPP
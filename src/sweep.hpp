@@ -0,0 +1,33 @@
+#ifndef RISC_V_SWEEP_HPP
+#define RISC_V_SWEEP_HPP
+
+#include <vector>
+#include "fork_pool.hpp"
+#include "system.hpp"
+
+// A sweep over runtime parameters that shares its warm-up: the common prefix of config.fork_at cycles runs once,
+// then a child is forked for each of config.variants, applies its options and runs to the end.
+// The children continue from the same warm caches, predictors and pipelines, and share guest memory copy-on-write.
+namespace sweep {
+  // The results of the variants, in their order.
+  std::vector<RunResult> run(System &system) {
+    while (!system.halted() && static_cast<unsigned int>(total_tick) < config.fork_at) {
+      system.run_cycle();
+    }
+    std::vector<RunResult> results(config.variants.size());
+    ForkPool<RunResult> pool;
+    for (size_t i = 0; i < results.size(); i++) {
+      pool.spawn(results[i], "Variant " + config.variants[i], [&, i](RunResult &result) {
+        apply_variant(config.variants[i]);
+        while (!system.halted()) {
+          system.run_cycle();
+        }
+        result = system.result();
+      });
+    }
+    pool.wait();
+    return results;
+  }
+}
+
+#endif //RISC_V_SWEEP_HPP
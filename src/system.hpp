@@ -0,0 +1,140 @@
+#ifndef RISC_V_SYSTEM_HPP
+#define RISC_V_SYSTEM_HPP
+
+#include <memory>
+#include <vector>
+#include "processor.hpp"
+#include "in_order_pipeline.hpp"
+#include "memory.hpp"
+#include "arbiter.hpp"
+#include "template/cpu.h"
+
+// What a finished run reports.
+struct RunResult {
+  unsigned int return_value;
+  int cycles;
+  int arbiter_conflicts;
+  std::array<Statistics, MAX_CORES> statistics; // of each core
+};
+
+// The simulated machine: config.cores cores sharing memory through the arbiter, wired together and clocked by cpu.
+// Everything starts as at reset; Core::start_at puts the first hart elsewhere.
+struct System {
+  dark::CPU cpu;
+  std::vector<std::unique_ptr<Core>> cores;
+  MemoryArbiter arbiter;
+  Memory memory;
+  dark::ClockDomain *memory_clock; // of the arbiter and memory
+
+  System() {
+    csr::hart_counters = {}; // they follow the statistics of these cores, which start at 0
+    for (unsigned int core = 0; core < config.cores; core++) {
+      if (config.core_model == IN_ORDER_CORE) {
+        cores.push_back(std::make_unique<InOrderProcessor>(core));
+      } else {
+        cores.push_back(std::make_unique<Processor>(core));
+      }
+      cores.back()->add_to(cpu);
+      arbiter.statistics[core] = &cores.back()->statistics;
+    }
+    bool same_clock = config.memory_clock_numerator == config.memory_clock_denominator;
+    memory_clock = same_clock ? &cpu.base_clock()
+                              : &cpu.add_clock(config.memory_clock_numerator, config.memory_clock_denominator);
+    cpu.add_module(&arbiter, *memory_clock);
+    cpu.add_module(&memory, *memory_clock);
+    cpu.set_threads(config.threads);
+    for (unsigned int core = 0; core < config.cores; core++) {
+      Core &processor = *cores[core];
+      DataCache &data_cache = processor.data_cache;
+      CorePortsWire &ports = arbiter.cores[core];
+      for (unsigned int thread = 0; thread < config.smt; thread++) {
+        InstructionTlb &tlb = *processor.instruction_tlbs[thread];
+        tlb.memory_finished = [&, core, thread]() {
+          return memory_changed() && memory.phase == 1 && arbiter.fetch_served(core, thread);
+        };
+        for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+          tlb.memory_block[i].follow(memory.block_out[i]);
+        }
+        ports.fetch_request[thread] = [&tlb]() { return tlb.memory_request(); };
+        ports.fetch_addr[thread] = [&tlb]() { return tlb.memory_addr(); };
+        // Data cache accesses are not speculative: a flush only cancels an instruction fetch.
+        ports.flushing[thread] = [&, thread]() { return processor.flushing(thread); };
+      }
+      ports.load.follow(data_cache.memory_load);
+      ports.store.follow(data_cache.memory_store);
+      ports.fill.follow(data_cache.memory_fill);
+      ports.addr.follow(data_cache.memory_addr);
+      ports.mode.follow(data_cache.memory_mode);
+      ports.atomic.follow(data_cache.memory_atomic);
+      ports.store_data.follow(data_cache.memory_store_data);
+      ports.thread = [&]() { return processor.data_thread(); };
+      data_cache.memory_load_finished = [&, core]() {
+        return memory_changed() && memory.phase == 1 && arbiter.serving(core, DATA_PORT);
+      };
+      data_cache.memory_store_finished = [&, core]() {
+        return memory_changed() && memory.phase == -1 && arbiter.serving(core, DATA_PORT);
+      };
+      data_cache.memory_data.follow(memory.data_out);
+      for (unsigned int i = 0; i < FETCH_BLOCK_WORDS; i++) {
+        data_cache.memory_block[i].follow(memory.block_out[i]);
+      }
+      data_cache.snooped = [&, core]() {
+        return memory_changed() && arbiter.snoop == true && arbiter.snoop_core != core;
+      };
+      data_cache.snoop_addr.follow(arbiter.snoop_addr);
+    }
+    arbiter.memory_busy = [&]() { return memory.phase != 0; };
+    memory.load = [&]() { return arbiter.forward_load(); };
+    memory.store = [&]() { return arbiter.forward_store(); };
+    memory.fetch = [&]() { return arbiter.forward_fetch(); };
+    memory.addr = [&]() { return arbiter.forward_addr(); };
+    memory.mode = [&]() { return arbiter.forward_mode(); };
+    memory.atomic = [&]() { return arbiter.forward_atomic(); };
+    memory.reservation_lost.follow(arbiter.reservation_lost);
+    memory.store_data = [&]() { return arbiter.forward_store_data(); };
+    memory.flushing = [&]() { return arbiter.cancelled(); };
+  }
+
+  System(const System &) = delete; // wires refer to the members
+
+  // A register of a slower memory keeps its value for several core cycles; the cores take what it says
+  // only in the first of them.
+  bool memory_changed() {
+    return memory_clock->changed_for(cpu.base_clock());
+  }
+
+  // Run one core cycle, and let the counter csrs see it.
+  void run_cycle() {
+    cpu.run_once_shuffle();
+    total_tick++;
+    for (unsigned int core = 0; core < config.cores; core++) {
+      for (unsigned int thread = 0; thread < config.smt; thread++) {
+        csr::sample_counters(core * config.smt + thread, cores[core]->statistics, thread);
+      }
+    }
+  }
+
+  // The program ends when hart 0 halts; another hart that halts waits for it.
+  bool halted() {
+    return cores[0]->halted();
+  }
+
+  RunResult result() const {
+    RunResult result{cores[0]->return_value(), total_tick, arbiter_conflicts, {}};
+    for (unsigned int core = 0; core < config.cores; core++) {
+      result.statistics[core] = cores[core]->statistics;
+    }
+    return result;
+  }
+
+  // Instructions retired by all cores.
+  unsigned long long committed() const {
+    unsigned long long total = 0;
+    for (auto &core: cores) {
+      total += core->statistics.total_committed;
+    }
+    return total;
+  }
+};
+
+#endif //RISC_V_SYSTEM_HPP
@@ -1,57 +1,242 @@
 #pragma once
 #include "module.h"
+#include "thread_pool.h"
 #include <algorithm>
+#include <chrono>
 #include <memory>
-#include <random>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace dark {
 
+/**
+ * A clock that modules work on, numerator / denominator times as fast as the base clock,
+ * whose cycles CPU::run_once runs. The edges of all clocks fall on steps of the base cycle;
+ * at a step, the modules of the clocks with an edge work, and then only their registers change.
+ * So a module reads the registers of a module on another clock as they were after its last edge,
+ * while wires are computed again at every step.
+ */
+class ClockDomain {
+private:
+	friend class CPU;
+
+	unsigned numerator;
+	unsigned denominator;
+	unsigned long long period = 1; // in steps
+	bool active = true; // the clock has an edge at the current step
+	long long last_edge = -1; // the last step with an edge, before the current one
+
+public:
+	ClockDomain(unsigned numerator, unsigned denominator) {
+		if (numerator == 0 || denominator == 0) throw std::invalid_argument("ClockDomain: invalid ratio.");
+		auto divisor = std::gcd(numerator, denominator);
+		this->numerator = numerator / divisor;
+		this->denominator = denominator / divisor;
+	}
+
+	/// Whether the clock has an edge at the current step.
+	bool clocked() const { return active; }
+
+	/**
+	 * Whether registers on this clock may have changed since the last edge of reader.
+	 * A value that lasts one cycle of a slower clock is seen at several edges of a faster reader;
+	 * this is true at the first of them only.
+	 */
+	bool changed_for(const ClockDomain &reader) const { return last_edge >= reader.last_edge; }
+};
+
 class CPU {
 private:
+	struct Entry {
+		ModuleBase *module;
+		ClockDomain *clock;
+	};
+
 	std::vector<std::unique_ptr<ModuleBase>> mod_owned;
-	std::vector<ModuleBase *> modules;
+	std::vector<Entry> modules;
+	std::vector<std::unique_ptr<ClockDomain>> clocks; // the base clock first
+	unsigned long long steps_per_cycle = 1; // the numerators of all clocks divide it
+	std::vector<ModuleBase *> clocked_modules; // of the clocks with an edge at the current step
+	std::vector<Entry> shuffled; // kept between cycles, so that run_once_shuffle does not allocate
+
+	/**
+	 * Within a cycle, work() of a module only reads registers of last cycle and wires,
+	 * so modules can be evaluated in any order, or at the same time.
+	 * With automatic threading, chunks of cycles are timed with and without the pool in turn, so that both see
+	 * the same phases of the program, and the pool is kept only if it is clearly faster: a cycle does little work,
+	 * and waking the threads can cost more than it saves.
+	 */
+	std::unique_ptr<ThreadPool> pool;
+	bool parallel = false;
+	bool calibrating = false;
+	unsigned long long calibrate_start = 0;
+	std::chrono::steady_clock::time_point calibrate_clock;
+	std::chrono::steady_clock::duration serial_time{}, parallel_time{};
+
+	static constexpr std::size_t kParallelMinModules = 4;
+	static constexpr unsigned long long kCalibrateCycles = 1024; // of one chunk
+	static constexpr unsigned long long kCalibrateChunks = 8; // half of them parallel
+	static constexpr int kParallelMargin = 10; // in percent, of the serial time the pool must save
 
 public:
 	unsigned long long cycles = 0;
 
 private:
-	void sync_all() {
-		for (auto &module: modules)
-			module->sync();
+	/**
+	 * Only the modules of clocks with an edge work, so only their registers are assigned;
+	 * the wires of all modules are computed again. Both are what sync_logged goes through,
+	 * which costs as much as the registers that changed, not as all the registers there are.
+	 */
+	void run_step(const std::vector<Entry> &order) {
+		clocked_modules.clear();
+		for (auto &entry: order)
+			if (entry.clock->active) clocked_modules.push_back(entry.module);
+		if (parallel)
+			pool->run(clocked_modules.size(), [&](std::size_t i) { clocked_modules[i]->work(); });
+		else
+			for (auto &module: clocked_modules)
+				module->work();
+		sync_logged();
+	}
+
+	// With several clocks, go through the steps of the base cycle that have an edge.
+	void run_steps(const std::vector<Entry> &order) {
+		auto first = (cycles - 1) * steps_per_cycle;
+		for (auto step = first; step < first + steps_per_cycle; step++) {
+			bool any = false;
+			for (auto &clock: clocks) {
+				clock->active = step % clock->period == 0;
+				any = any || clock->active;
+			}
+			if (!any) continue;
+			run_step(order);
+			for (auto &clock: clocks)
+				if (clock->active) clock->last_edge = static_cast<long long>(step);
+		}
+	}
+
+	void run_cycle(const std::vector<Entry> &order) {
+		++cycles;
+		if (calibrating) calibrate();
+		if (clocks.size() > 1) {
+			run_steps(order);
+			return;
+		}
+		run_step(order);
+		clocks[0]->last_edge = static_cast<long long>(cycles - 1);
+	}
+
+	// Time serial and parallel chunks of kCalibrateCycles in turn, and keep the pool if it saves kParallelMargin.
+	void calibrate() {
+		auto elapsed = cycles - calibrate_start - 1;
+		if (elapsed % kCalibrateCycles != 0) return;
+		auto chunk = elapsed / kCalibrateCycles;
+		if (chunk > 0) (parallel ? parallel_time : serial_time) += std::chrono::steady_clock::now() - calibrate_clock;
+		if (chunk == kCalibrateChunks) {
+			calibrating = false;
+			parallel = parallel_time * (100 + kParallelMargin) < serial_time * 100;
+			if (!parallel) pool.reset();
+			return;
+		}
+		parallel = chunk % 2 == 1;
+		calibrate_clock = std::chrono::steady_clock::now();
 	}
 
 public:
+	/**
+	 * @param threads 1 to evaluate modules one by one, n to use n threads,
+	 * 0 to decide from the host and the measured cost of a cycle.
+	 */
+	void set_threads(unsigned threads) {
+		pool.reset();
+		parallel = calibrating = false;
+		if (threads == 0) {
+			auto host = std::thread::hardware_concurrency();
+			if (host <= 1 || modules.size() < kParallelMinModules) return;
+			pool = std::make_unique<ThreadPool>(std::min<unsigned>(host, modules.size()));
+			serial_time = parallel_time = {};
+			calibrating = true;
+			calibrate_start = cycles;
+			return;
+		}
+		parallel = threads > 1;
+		if (parallel) pool = std::make_unique<ThreadPool>(threads);
+	}
+
+	bool is_parallel() const { return parallel; }
+
+public:
+	CPU() { clocks.push_back(std::make_unique<ClockDomain>(1, 1)); }
+	CPU(const CPU &) = delete;
+	// The modules go with the CPU, and must not be left in the logs.
+	~CPU() {
+		pool.reset();
+		clear_logged();
+	}
+
+	/// The clock of modules added without one; run_once runs one of its cycles.
+	ClockDomain &base_clock() { return *clocks[0]; }
+
+	/// A clock numerator / denominator times as fast as the base clock.
+	ClockDomain &add_clock(unsigned numerator, unsigned denominator) {
+		clocks.push_back(std::make_unique<ClockDomain>(numerator, denominator));
+		steps_per_cycle = std::lcm(steps_per_cycle, static_cast<unsigned long long>(clocks.back()->numerator));
+		for (auto &clock: clocks)
+			clock->period = clock->denominator * steps_per_cycle / clock->numerator;
+		return *clocks.back();
+	}
+
 	/// @attention the pointer will be moved. you SHOULD NOT use it after calling this function.
 	template<typename _Tp>
 		requires std::derived_from<_Tp, ModuleBase>
 	void add_module(std::unique_ptr<_Tp> &module) {
-		modules.push_back(module.get());
+		modules.push_back({module.get(), clocks[0].get()});
 		mod_owned.emplace_back(std::move(module));
 	}
 	void add_module(std::unique_ptr<ModuleBase> module) {
-		modules.push_back(module.get());
+		modules.push_back({module.get(), clocks[0].get()});
 		mod_owned.emplace_back(std::move(module));
 	}
 	void add_module(ModuleBase *module) {
-		modules.push_back(module);
+		modules.push_back({module, clocks[0].get()});
+	}
+	/// The module works at the edges of clock, which must have been made by add_clock of this CPU.
+	void add_module(ModuleBase *module, ClockDomain &clock) {
+		modules.push_back({module, &clock});
+	}
+
+	/**
+	 * Save or load the state of all modules and clocks, between cycles.
+	 * Loading needs a CPU built the same way, with the same modules added in the same order.
+	 */
+	void transfer(Archive &archive) {
+		archive.transfer(cycles);
+		for (auto &clock: clocks) {
+			archive.transfer(clock->active);
+			archive.transfer(clock->last_edge);
+		}
+		for (auto &entry: modules)
+			entry.module->transfer(archive);
 	}
 
 	void run_once() {
-		++cycles;
-		for (auto &module: modules)
-			module->work();
-		sync_all();
+		run_cycle(modules);
 	}
+	/**
+	 * The order only has to differ between cycles, so a xorshift generator and a multiply in place of a division
+	 * pick it, which costs less than std::shuffle with a standard engine and distribution.
+	 */
 	void run_once_shuffle() {
-		static std::default_random_engine engine;
-		std::vector<ModuleBase *> shuffled = modules;
-		std::shuffle(shuffled.begin(), shuffled.end(), engine);
-
-		++cycles;
-		for (auto &module: shuffled)
-			module->work();
-		sync_all();
+		static unsigned long long state = 0x9e3779b97f4a7c15ull;
+		shuffled.assign(modules.begin(), modules.end());
+		for (auto i = shuffled.size(); i > 1; i--) {
+			state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+			auto j = static_cast<std::size_t>((state >> 32) * i >> 32);
+			std::swap(shuffled[i - 1], shuffled[j]);
+		}
+		run_cycle(shuffled);
 	}
 	void run(unsigned long long max_cycles = 0, bool shuffle = false) {
 		auto func = shuffle ? &CPU::run_once_shuffle : &CPU::run_once;
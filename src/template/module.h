@@ -1,5 +1,5 @@
 #pragma once
-#include "synchronize.h"
+#include "serialize.h"
 namespace dark {
 
 namespace details {
@@ -11,6 +11,8 @@ namespace details {
 struct ModuleBase {
 	virtual void work() = 0;
 	virtual void sync() = 0;
+	// Save or load the registers, between cycles.
+	virtual void transfer(Archive &archive) = 0;
 	virtual ~ModuleBase() = default;
 };
 
@@ -22,6 +24,11 @@ struct Module : public ModuleBase, public _Tinput, public _Toutput, protected _T
 		sync_member(static_cast<_Toutput &>(*this));
 		sync_member(static_cast<_Tprivate &>(*this));
 	}
+	void transfer(Archive &archive) override final {
+		transfer_member(static_cast<_Tinput &>(*this), archive);
+		transfer_member(static_cast<_Toutput &>(*this), archive);
+		transfer_member(static_cast<_Tprivate &>(*this), archive);
+	}
 };
 
 } // namespace dark
@@ -1,6 +1,7 @@
 #pragma once
 #include "concept.h"
 #include "debug.h"
+#include "sync_log.h"
 
 namespace dark {
 
@@ -11,39 +12,42 @@ private:
 				  "Register: _Len must be in range [1, kMaxLength].");
 
 	friend class Visitor;
+	template<std::size_t> friend struct Wire;
 
-	max_size_t _M_old : _Len;
-	max_size_t _M_new : _Len;
-
-	[[no_unique_address]]
-	debug::DebugValue<bool, false> _M_assigned;
+	// Not bit-fields: _M_new is written while other modules read _M_old,
+	// possibly from other threads, so they must not share a memory location.
+	details::RegisterWords _M_words;
 public:
-	void sync() {
-		this->_M_assigned = false;
-		this->_M_old = this->_M_new;
-	}
+	void sync() { this->_M_words.sync(); }
 
 public:
 	static constexpr std::size_t _Bit_Len = _Len;
 
-	Register() : _M_old(), _M_new(), _M_assigned() {}
+	Register() : _M_words() {}
 
 	Register(Register &&) = delete;
 	Register(const Register &) = delete;
 	Register &operator=(Register &&) = delete;
 	Register &operator=(const Register &rhs) = delete;
 
+	/**
+	 * The new value is taken at the next sync, see sync_logged.
+	 * Between cycles the new value is the old one, so assigning it again changes nothing and is not logged.
+	 */
 	template<concepts::bit_convertible<_Len> _Tp>
 	void assign(const _Tp &value) {
-		if(this->_M_assigned) {
+		if(static_cast<unsigned long long>(this->_M_words._M_assigned) == details::sync_epoch) {
       throw;
     }
-		this->_M_assigned = true;
-		this->_M_new = static_cast<max_size_t>(value);
+		this->_M_words._M_assigned = details::sync_epoch;
+		auto masked = static_cast<max_size_t>(value) & make_mask<_Len>();
+		if (masked == this->_M_words._M_new) return;
+		this->_M_words._M_new = masked;
+		details::sync_log()._M_registers.push_back(&this->_M_words);
 	}
 
-	explicit operator max_size_t() const { return this->_M_old; }
-	explicit operator bool() const { return this->_M_old; }
+	explicit operator max_size_t() const { return this->_M_words._M_old; }
+	explicit operator bool() const { return this->_M_words._M_old; }
 };
 
 } // namespace dark
@@ -0,0 +1,103 @@
+#pragma once
+#include "synchronize.h"
+#include "concept.h"
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace dark {
+
+/**
+ * The state of registers as a flat array of words, in the order transfer_member visits them.
+ * A saving archive appends to its own vector; a loading one reads words from memory it does not own,
+ * which may be a mapped checkpoint file.
+ */
+class Archive {
+private:
+	std::vector<max_size_t> saved;
+	const max_size_t *source = nullptr;
+	std::size_t size = 0;
+	std::size_t pos = 0;
+
+public:
+	/// An archive to save into.
+	Archive() = default;
+	/// An archive to load count words from words.
+	Archive(const max_size_t *words, std::size_t count) : source(words), size(count) {}
+
+	bool loading() const { return source != nullptr; }
+	const std::vector<max_size_t> &words() const { return saved; }
+	/// Whether a loading archive has been read to its end.
+	bool exhausted() const { return pos == size; }
+
+	void transfer(max_size_t &value) {
+		if (!loading()) {
+			saved.push_back(value);
+			return;
+		}
+		if (pos == size) throw std::runtime_error("Archive: more registers than saved.");
+		value = source[pos++];
+	}
+
+	/// A wider integer takes several words, low first.
+	template<std::integral _Tp>
+		requires (sizeof(_Tp) > sizeof(max_size_t))
+	void transfer(_Tp &value) {
+		constexpr std::size_t kWords = sizeof(_Tp) / sizeof(max_size_t);
+		constexpr std::size_t kBits = std::numeric_limits<max_size_t>::digits;
+		auto bits = static_cast<std::make_unsigned_t<_Tp>>(value);
+		std::make_unsigned_t<_Tp> result = 0;
+		for (std::size_t i = 0; i < kWords; i++) {
+			max_size_t word = static_cast<max_size_t>(bits >> (i * kBits));
+			transfer(word);
+			result |= static_cast<std::make_unsigned_t<_Tp>>(word) << (i * kBits);
+		}
+		value = static_cast<_Tp>(result);
+	}
+
+	void transfer(bool &value) {
+		max_size_t word = value;
+		transfer(word);
+		value = word != 0;
+	}
+};
+
+template<typename _Tp>
+inline void transfer_member(_Tp &value, Archive &archive);
+
+template<typename _Tp, typename... _Base>
+inline void transfer_by_tag(_Tp &value, Archive &archive, SyncTags<_Base...>) {
+	(transfer_member(Visitor::cast<_Tp, _Base>(value), archive), ...);
+}
+
+/* Save or load the registers in value, walking it as sync_member does. Wires hold no state and are skipped. */
+template<typename _Tp>
+inline void transfer_member(_Tp &value, Archive &archive) {
+	if constexpr (std::is_const_v<_Tp>) {
+		/* Do nothing! Constant members hold no state! */
+	}
+	else if constexpr (is_std_array_v<_Tp>) {
+		for (auto &member: value) transfer_member(member, archive);
+	}
+	else if constexpr (is_unique_ptr_v<_Tp>) {
+		if (value) transfer_member(*value, archive);
+	}
+	else if constexpr (Visitor::is_register_v<_Tp>) {
+		Visitor::transfer(value, archive);
+	}
+	else if constexpr (Visitor::is_syncable_v<_Tp>) {
+		/* Wires, and empty private data. */
+	}
+	else if constexpr (has_valid_tag<_Tp>) {
+		transfer_by_tag(value, archive, typename _Tp::Tags{});
+	}
+	else if constexpr (std::is_aggregate_v<_Tp>) {
+		auto &&tuple = reflect::tuplify(value);
+		std::apply([&archive](auto &...members) { (transfer_member(members, archive), ...); }, tuple);
+	}
+	else {
+		static_assert(sizeof(_Tp) == 0, "This type is not serializable.");
+	}
+}
+
+} // namespace dark
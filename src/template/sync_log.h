@@ -0,0 +1,101 @@
+#pragma once
+#include "concept.h"
+#include "debug.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace dark {
+
+namespace details {
+
+	/* The number of syncs so far, which tells the cycles apart for the check against assigning a register twice. */
+	inline unsigned long long sync_epoch = 0;
+
+	constexpr unsigned long long kNeverAssigned = ~0ull;
+
+	/* The two values of a register: the one read in this cycle and the one assigned for the next. */
+	struct RegisterWords {
+		max_size_t _M_old;
+		max_size_t _M_new;
+
+		[[no_unique_address]]
+		debug::DebugValue<unsigned long long, kNeverAssigned> _M_assigned; // the sync_epoch of the last assignment
+
+		void sync() {
+			this->_M_assigned = kNeverAssigned;
+			this->_M_old = this->_M_new;
+		}
+	};
+
+	/**
+	 * The registers assigned and the wires evaluated by one thread since the last sync.
+	 * Only those change at a sync, so CPU goes through them instead of every member of every module.
+	 */
+	struct SyncLog {
+		std::vector<RegisterWords *> _M_registers;
+		std::vector<std::atomic<bool> *> _M_wires;
+
+		SyncLog();
+		~SyncLog();
+
+		void sync() {
+			for (auto *words: _M_registers) words->sync();
+			for (auto *holds: _M_wires) holds->store(false, std::memory_order_relaxed);
+			_M_registers.clear();
+			_M_wires.clear();
+		}
+
+		void clear() {
+			_M_registers.clear();
+			_M_wires.clear();
+		}
+	};
+
+	/* The logs of all live threads. */
+	struct SyncLogs {
+		std::mutex _M_mutex;
+		std::vector<SyncLog *> _M_logs;
+	};
+
+	inline SyncLogs &sync_logs() {
+		static SyncLogs logs;
+		return logs;
+	}
+
+	inline SyncLog::SyncLog() {
+		std::lock_guard lock(sync_logs()._M_mutex);
+		sync_logs()._M_logs.push_back(this);
+	}
+
+	inline SyncLog::~SyncLog() {
+		std::lock_guard lock(sync_logs()._M_mutex);
+		auto &logs = sync_logs()._M_logs;
+		logs.erase(std::find(logs.begin(), logs.end(), this));
+	}
+
+	/* The log of the calling thread. */
+	inline SyncLog &sync_log() {
+		thread_local SyncLog log;
+		return log;
+	}
+
+} // namespace details
+
+/**
+ * Apply what the threads logged since the last call: assigned registers take their new values,
+ * and evaluated wires forget theirs. Must not run while a thread assigns or evaluates.
+ */
+inline void sync_logged() {
+	for (auto *log: details::sync_logs()._M_logs) log->sync();
+	details::sync_epoch++;
+}
+
+/* Forget what the threads logged, for registers and wires that are about to be destroyed. */
+inline void clear_logged() {
+	std::lock_guard lock(details::sync_logs()._M_mutex);
+	for (auto *log: details::sync_logs()._M_logs) log->clear();
+}
+
+} // namespace dark
@@ -1,6 +1,7 @@
 #pragma once
 #include "reflect.h"
 #include <array>
+#include <memory>
 
 namespace dark {
 
@@ -15,6 +16,18 @@ struct Visitor {
 
 	template<typename _Tp, typename _Base>
 	static _Base &cast(_Tp &value) { return static_cast<_Base &>(value); }
+
+	template<typename _Tp>
+	static constexpr bool is_register_v =
+			requires(_Tp &val) { val._M_words._M_old = val._M_words._M_new; };
+
+	/* Between cycles the old and new values of a register are the same, so one value is kept. */
+	template<typename _Tp, typename _Archive>
+		requires is_register_v<_Tp>
+	static void transfer(_Tp &val, _Archive &archive) {
+		archive.transfer(val._M_words._M_old);
+		val._M_words._M_new = val._M_words._M_old;
+	}
 };
 
 template<typename... _Base>
@@ -32,6 +45,11 @@ static constexpr bool is_std_array_v = std::is_array_v<_Tp>;
 template<typename _Tp, std::size_t _Nm>
 static constexpr bool is_std_array_v<std::array<_Tp, _Nm>> = true;
 
+template<typename _Tp>
+static constexpr bool is_unique_ptr_v = false;
+template<typename _Tp>
+static constexpr bool is_unique_ptr_v<std::unique_ptr<_Tp>> = true;
+
 template<typename _Tp>
 inline void sync_member(_Tp &value);
 
@@ -48,6 +66,10 @@ inline void sync_member(_Tp &value) {
 	else if constexpr (is_std_array_v<_Tp>) {
 		for (auto &member: value) sync_member(member);
 	}
+	else if constexpr (is_unique_ptr_v<_Tp>) {
+		/* Members built only in some configurations: synchronize them if they are. */
+		if (value) sync_member(*value);
+	}
 	else if constexpr (Visitor::is_syncable_v<_Tp>) {
 		Visitor::sync(value);
 	}
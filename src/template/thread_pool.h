@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+/**
+ * A fixed set of worker threads that stay alive between cycles.
+ * run() hands out indices [0, count) to the workers and the calling thread,
+ * and returns when all of them are done. Waiting threads spin, then yield.
+ */
+class ThreadPool {
+private:
+	using _Task_t = void (*)(void *, std::size_t);
+
+	std::vector<std::thread> _M_workers;
+	std::atomic<unsigned> _M_generation{0};
+	std::atomic<std::size_t> _M_next{0};
+	std::atomic<std::size_t> _M_running{0};
+	std::atomic<bool> _M_stopping{false};
+	std::size_t _M_count = 0;
+	_Task_t _M_task = nullptr;
+	void *_M_context = nullptr;
+	std::exception_ptr _M_error;
+	std::atomic_flag _M_error_lock = ATOMIC_FLAG_INIT;
+
+	template<typename _Pred>
+	static void _M_spin_until(_Pred &&pred) {
+		for (unsigned spins = 0; !pred(); spins++) {
+			if (spins >= 1024) std::this_thread::yield();
+		}
+	}
+
+	void _M_drain() {
+		try {
+			for (std::size_t i; (i = _M_next.fetch_add(1, std::memory_order_relaxed)) < _M_count;)
+				_M_task(_M_context, i);
+		} catch (...) {
+			if (!_M_error_lock.test_and_set()) _M_error = std::current_exception();
+			_M_next.store(_M_count, std::memory_order_relaxed);
+		}
+	}
+
+	void _M_loop() {
+		unsigned seen = 0;
+		while (true) {
+			_M_spin_until([&] { return _M_generation.load(std::memory_order_acquire) != seen; });
+			seen = _M_generation.load(std::memory_order_acquire);
+			if (_M_stopping.load(std::memory_order_relaxed)) return;
+			_M_drain();
+			_M_running.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+public:
+	/// @param threads total threads including the caller of run().
+	explicit ThreadPool(std::size_t threads) {
+		for (std::size_t i = 1; i < threads; i++)
+			_M_workers.emplace_back([this] { _M_loop(); });
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	~ThreadPool() {
+		_M_stopping.store(true, std::memory_order_relaxed);
+		_M_generation.fetch_add(1, std::memory_order_release);
+		for (auto &worker: _M_workers) worker.join();
+	}
+
+	std::size_t size() const { return _M_workers.size() + 1; }
+
+	/// Call fn(i) for every i in [0, count). Exceptions are rethrown in the caller.
+	template<typename _Fn>
+	void run(std::size_t count, _Fn &&fn) {
+		_M_task    = [](void *context, std::size_t i) { (*static_cast<std::remove_reference_t<_Fn> *>(context))(i); };
+		_M_context = const_cast<void *>(static_cast<const void *>(&fn));
+		_M_count   = count;
+		_M_next.store(0, std::memory_order_relaxed);
+		_M_running.store(_M_workers.size(), std::memory_order_relaxed);
+		_M_generation.fetch_add(1, std::memory_order_release);
+		_M_drain();
+		_M_spin_until([&] { return _M_running.load(std::memory_order_acquire) == 0; });
+		if (_M_error) {
+			auto error = std::exchange(_M_error, nullptr);
+			_M_error_lock.clear();
+			std::rethrow_exception(error);
+		}
+	}
+};
+
+} // namespace dark
@@ -1,6 +1,9 @@
 #pragma once
 #include "concept.h"
 #include "debug.h"
+#include "sync_log.h"
+#include "register.h"
+#include <atomic>
 #include <memory>
 
 namespace dark {
@@ -53,14 +56,21 @@ private:
 
 	_Manage_t _M_func;
 
-	mutable max_size_t _M_cache : _Len;
-	mutable bool _M_holds;
+	// The value of the register the wire follows, if it does: a register holds its value through the cycle,
+	// so reading it costs less than calling _M_func, and there is nothing to cache or log.
+	const max_size_t *_M_source = nullptr;
+
+	// A wire may be read by several modules evaluated in parallel.
+	// The value is published before _M_holds, so a reader never sees a stale cache.
+	// A wire that computes its value logs itself, so that sync_logged makes it compute again.
+	mutable std::atomic<max_size_t> _M_cache;
+	mutable std::atomic<bool> _M_holds;
 
 	[[no_unique_address]]
 	debug::DebugValue<bool, false> _M_assigned;
 
 private:
-	void sync() { this->_M_holds = false; }
+	void sync() { this->_M_holds.store(false, std::memory_order_relaxed); }
 
 	template<details::WireFunction<_Len> _Fn>
 	static auto _M_new_func(_Fn &&fn) {
@@ -73,18 +83,27 @@ private:
 		this->_M_assigned = true;
 	}
 
+	[[gnu::noinline]] max_size_t _M_compute() const {
+		auto value = this->_M_func->call() & make_mask<_Len>();
+		this->_M_cache.store(value, std::memory_order_relaxed);
+		this->_M_holds.store(true, std::memory_order_release);
+		details::sync_log()._M_wires.push_back(&this->_M_holds);
+		return value;
+	}
+
 public:
 	static constexpr std::size_t _Bit_Len = _Len;
 
 	Wire() : _M_func(new details::EmptyWire),
 			 _M_cache(), _M_holds(), _M_assigned() {}
 
-	explicit operator max_size_t() const {
-		if (this->_M_holds == false) {
-			this->_M_holds = true;
-			this->_M_cache = this->_M_func->call();
+	/* Reading a followed register or the cache is inlined; computing the value is not. */
+	[[gnu::always_inline]] explicit operator max_size_t() const {
+		if (this->_M_source) return *this->_M_source & make_mask<_Len>();
+		if (this->_M_holds.load(std::memory_order_acquire)) {
+			return this->_M_cache.load(std::memory_order_relaxed);
 		}
-		return this->_M_cache;
+		return this->_M_compute();
 	}
 
 	Wire(Wire &&) = delete;
@@ -108,6 +127,13 @@ public:
 		this->sync();
 	}
 
+	/// Read reg itself, as a function returning a reference to it would, but without calling one.
+	template<std::size_t _Reg_Len>
+	void follow(const Register<_Reg_Len> &reg) {
+		this->_M_checked_assign();
+		this->_M_source = &reg._M_words._M_old;
+	}
+
 	explicit operator bool() const {
 		return static_cast<max_size_t>(*this);
 	}
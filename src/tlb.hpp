@@ -0,0 +1,414 @@
+#ifndef RISC_V_TLB_HPP
+#define RISC_V_TLB_HPP
+
+#include "config.hpp"
+#include "memory.hpp"
+
+// Sv32 address translation. A virtual address is two 10-bit page numbers and a 12-bit offset,
+// translated by a two-level page table whose root is given by satp.
+namespace sv32 {
+  constexpr unsigned int PAGE_SHIFT = 12;
+  constexpr unsigned int LEVEL_BITS = 10;
+  constexpr unsigned int PTE_SIZE = 4;
+
+  // The permission bits of a page table entry, as kept by TlbEntry. A, D and U are not looked at.
+  enum PteFlag {
+    VALID = 1 << 0,
+    READABLE = 1 << 1,
+    WRITABLE = 1 << 2,
+    EXECUTABLE = 1 << 3
+  };
+
+  // satp holds MODE in bit 31, then ASID, then the page number of the root table.
+  bool enabled(unsigned int satp) {
+    return satp >> 31;
+  }
+
+  // Physical addresses are 34 bits in Sv32; memory has 32, so the high bits of a page number are dropped.
+  unsigned int root(unsigned int satp) {
+    return satp << PAGE_SHIFT;
+  }
+
+  unsigned int vpn(unsigned int addr, unsigned int level) {
+    return addr >> (PAGE_SHIFT + level * LEVEL_BITS) & ((1 << LEVEL_BITS) - 1);
+  }
+
+  unsigned int pte_addr(unsigned int table, unsigned int addr, unsigned int level) {
+    return table + vpn(addr, level) * PTE_SIZE;
+  }
+
+  unsigned int ppn(unsigned int pte) {
+    return pte >> 10;
+  }
+
+  bool is_leaf(unsigned int pte) {
+    return pte & (READABLE | EXECUTABLE);
+  }
+
+  bool is_invalid(unsigned int pte) {
+    return !(pte & VALID) || (pte & (READABLE | WRITABLE)) == WRITABLE;
+  }
+
+  // Whether a leaf of the root table maps a megapage that does not start at a multiple of its size.
+  bool is_misaligned(unsigned int pte) {
+    return ppn(pte) & ((1 << LEVEL_BITS) - 1);
+  }
+
+  // The physical address of addr in the page ppn, a megapage or a page.
+  unsigned int physical(unsigned int ppn, bool megapage, unsigned int addr) {
+    auto offset_bits = megapage ? PAGE_SHIFT + LEVEL_BITS : PAGE_SHIFT;
+    auto base = megapage ? ppn >> LEVEL_BITS << offset_bits : ppn << offset_bits;
+    return base | (addr & ((1u << offset_bits) - 1));
+  }
+
+  // Translate addr for an access that needs the flags in need, reading the page table in image at once,
+  // as FunctionalCore does. Return false on a page fault.
+  bool walk(unsigned int satp, unsigned int addr, unsigned int need, unsigned int &physical_addr,
+            memory::Image &image = memory::memory) {
+    if (!enabled(satp)) {
+      physical_addr = addr;
+      return true;
+    }
+    auto table = root(satp);
+    for (unsigned int level = 2; level-- > 0;) {
+      auto pte = to_unsigned(memory::load_data(pte_addr(table, addr, level), memory::WORD, image));
+      if (is_invalid(pte)) {
+        return false;
+      }
+      if (is_leaf(pte)) {
+        if ((pte & need) != need || (level == 1 && is_misaligned(pte))) {
+          return false;
+        }
+        physical_addr = physical(ppn(pte), level == 1, addr);
+        return true;
+      }
+      table = ppn(pte) << PAGE_SHIFT;
+    }
+    return false;
+  }
+}
+
+struct TlbEntry {
+  Flag valid;
+  Flag megapage; // a 4 MiB page, mapped by the root table
+  Data satp; // the entry was made under, which tags it as an address space id would
+  VirtualPageNumber vpn;
+  PhysicalPageNumber ppn;
+  PageFlags flags;
+};
+
+enum Translation {
+  TRANSLATED,
+  TLB_MISS,
+  PAGE_FAULT
+};
+
+// A fully associative TLB, refilled round robin, and the state of its page table walk.
+// No entry is ever dropped: sfence.vma decodes as a nop, so a program should not change an entry of a page table
+// while it is in use. Writing another satp starts a new address space instead.
+struct TranslationBuffer {
+  std::array<TlbEntry, MAX_TLB_ENTRIES> entries;
+  TlbPos next; // the entry the next fill replaces
+  Flag walking;
+  Flag first_level; // the walk reads the root table
+  Data walk_satp;
+  Data walk_addr; // the virtual address the walk is for
+  Data pte_addr; // the entry the walk reads next
+  Flag faulted; // the access at fault_addr has no mapping with the permissions it needs
+  Data fault_addr;
+
+  // Translate addr for an access that needs the flags in need. With translation off, addresses are physical.
+  Translation translate(unsigned int satp, unsigned int addr, unsigned int need, unsigned int size,
+                        unsigned int &physical) const {
+    if (!sv32::enabled(satp)) {
+      physical = addr;
+      return TRANSLATED;
+    }
+    for (unsigned int i = 0; i < size; i++) {
+      const TlbEntry &entry = entries[i];
+      if (entry.valid == false || entry.satp != satp) {
+        continue;
+      }
+      bool megapage = entry.megapage == true;
+      auto page = megapage ? addr >> (sv32::PAGE_SHIFT + sv32::LEVEL_BITS) : addr >> sv32::PAGE_SHIFT;
+      auto vpn = to_unsigned(entry.vpn);
+      if ((megapage ? vpn >> sv32::LEVEL_BITS : vpn) != page) {
+        continue;
+      }
+      if ((to_unsigned(entry.flags) & need) != need) {
+        return PAGE_FAULT;
+      }
+      physical = sv32::physical(to_unsigned(entry.ppn), megapage, addr);
+      return TRANSLATED;
+    }
+    return TLB_MISS;
+  }
+
+  void start_walk(unsigned int satp, unsigned int addr) {
+    walking.assign(true);
+    first_level.assign(true);
+    walk_satp.assign(satp);
+    walk_addr.assign(addr);
+    pte_addr.assign(sv32::pte_addr(sv32::root(satp), addr, 1));
+  }
+
+  void fault(unsigned int addr) {
+    faulted.assign(true);
+    fault_addr.assign(addr);
+  }
+
+  // Take the page table entry the walk read: go down a level, or fill an entry of the first size ones.
+  // Return false if the walk ends in a page fault.
+  bool walk_step(unsigned int pte, unsigned int size) {
+    bool root = first_level == true;
+    auto addr = to_unsigned(walk_addr);
+    bool misaligned = root && sv32::is_leaf(pte) && sv32::is_misaligned(pte);
+    if (sv32::is_invalid(pte) || misaligned || (!root && !sv32::is_leaf(pte))) {
+      walking.assign(false);
+      fault(addr);
+      return false;
+    }
+    if (!sv32::is_leaf(pte)) {
+      first_level.assign(false);
+      pte_addr.assign(sv32::pte_addr(sv32::ppn(pte) << sv32::PAGE_SHIFT, addr, 0));
+      return true;
+    }
+    auto pos = to_unsigned(next) % size;
+    TlbEntry &entry = entries[pos];
+    entry.valid.assign(true);
+    entry.megapage.assign(root);
+    entry.satp.assign(walk_satp);
+    entry.vpn.assign(addr >> sv32::PAGE_SHIFT);
+    entry.ppn.assign(sv32::ppn(pte));
+    entry.flags.assign(pte & (sv32::VALID | sv32::READABLE | sv32::WRITABLE | sv32::EXECUTABLE));
+    next.assign((pos + 1) % size);
+    walking.assign(false);
+    return true;
+  }
+};
+
+struct InstructionTlbInput {
+  FlagWire request; // from the fetch unit, with a virtual address
+  DataWire addr;
+  FlagWire flushing; // of the thread, which cancels the fetch and the walk for it
+  DataWire satp;
+  FlagWire memory_finished; // memory is done with the block asked for by memory_request
+  std::array<DataWire, FETCH_BLOCK_WORDS> memory_block;
+};
+
+struct InstructionTlbOutput {
+  TranslationBuffer buffer; // the values forwarded each way are computed from it
+};
+
+// Translates the instruction fetches of one thread. A hit costs nothing: the translated request goes to the arbiter
+// in the same cycle. On a miss, the walker reads the page table entries as fetch blocks through the same port.
+// A fetch that faults is answered with a block of zeros, which decode as nops: there are no traps to raise.
+struct InstructionTlb : dark::Module<InstructionTlbInput, InstructionTlbOutput> {
+  FrontEndStatistics &statistics; // of the thread
+
+  explicit InstructionTlb(FrontEndStatistics &statistics) : statistics(statistics) {}
+
+  Translation translate(unsigned int &physical) const {
+    return buffer.translate(to_unsigned(satp), to_unsigned(addr), sv32::EXECUTABLE, config.itlb_entries, physical);
+  }
+
+  // Whether the fetch unit is answered with zeros for the page fault of its request.
+  bool fault_answered() const {
+    return buffer.faulted == true && request == true && addr == buffer.fault_addr;
+  }
+
+  // Values forwarded to the arbiter.
+  bool memory_request() const {
+    unsigned int physical;
+    return buffer.walking == true || (request == true && buffer.faulted == false && translate(physical) == TRANSLATED);
+  }
+
+  max_size_t memory_addr() const {
+    if (buffer.walking == true) {
+      return to_unsigned(buffer.pte_addr) & ~(FETCH_BLOCK_SIZE - 1);
+    }
+    unsigned int physical = 0;
+    translate(physical);
+    return physical;
+  }
+
+  // Values forwarded to the fetch unit.
+  bool fetch_finished() const {
+    return buffer.faulted == true ? fault_answered() : buffer.walking == false && memory_finished == true;
+  }
+
+  max_size_t fetch_word(unsigned int i) const {
+    return buffer.faulted == true ? 0 : to_unsigned(memory_block[i]);
+  }
+
+  void work() override {
+    if (flushing == true) {
+      buffer.walking.assign(false);
+      buffer.faulted.assign(false);
+      return;
+    }
+    if (buffer.faulted == true) {
+      buffer.faulted.assign(false);
+      return;
+    }
+    if (buffer.walking == true) {
+      statistics.tlb_walk_cycles++;
+      if (memory_finished == true) {
+        auto pte_addr = to_unsigned(buffer.pte_addr);
+        auto pte = to_unsigned(memory_block[pte_addr % FETCH_BLOCK_SIZE / sv32::PTE_SIZE]);
+        if (!buffer.walk_step(pte, config.itlb_entries)) {
+          statistics.page_faults++;
+        }
+      }
+      return;
+    }
+    unsigned int physical;
+    auto result = request == true ? translate(physical) : TRANSLATED;
+    if (result == TLB_MISS) {
+      buffer.start_walk(to_unsigned(satp), to_unsigned(addr));
+      statistics.tlb_misses++;
+    } else if (result == PAGE_FAULT) {
+      buffer.fault(to_unsigned(addr));
+      statistics.page_faults++;
+    }
+  }
+};
+
+struct DataTlbInput {
+  FlagWire load; // from the load/store unit, held until answered, with a virtual address
+  FlagWire store;
+  DataWire addr;
+  MemoryAccessModeWire mode;
+  AtomicCodeWire atomic;
+  DataWire store_data;
+  FlagWire flushing; // the thread of the request is flushing
+  FlagWire runahead;
+  DataWire satp; // of the thread of the request
+  FlagWire cache_load_finished; // from data cache
+  FlagWire cache_store_finished;
+  DataWire cache_data;
+  FlagWire cache_poisoned;
+};
+
+struct DataTlbOutput {
+  TranslationBuffer buffer; // the values forwarded each way are computed from it
+};
+
+// Translates the loads and stores of one core in front of data cache, which sees physical addresses only.
+// A hit costs nothing: the translated request goes to data cache in the same cycle. On a miss, the walker
+// reads the page table entries as word loads through data cache, where they may hit; a walk is not speculative,
+// so it goes on when the request that started it is flushed. A load that faults reads 0, and a store that faults
+// is dropped. An access is translated by the page of its first byte.
+struct DataTlb : dark::Module<DataTlbInput, DataTlbOutput> {
+  Statistics &statistics; // of the core
+
+  explicit DataTlb(Statistics &statistics) : statistics(statistics) {}
+
+  // The permissions the request needs.
+  unsigned int needed() const {
+    auto op = static_cast<memory::AtomicOperation>(to_unsigned(atomic));
+    if (store == true) {
+      return sv32::WRITABLE;
+    }
+    return op == memory::NOT_ATOMIC || op == memory::LOAD_RESERVED ? sv32::READABLE : sv32::READABLE | sv32::WRITABLE;
+  }
+
+  Translation translate(unsigned int &physical) const {
+    return buffer.translate(to_unsigned(satp), to_unsigned(addr), needed(), config.dtlb_entries, physical);
+  }
+
+  bool translated() const {
+    unsigned int physical;
+    return buffer.faulted == false && translate(physical) == TRANSLATED;
+  }
+
+  // Whether the request is answered for its page fault, without going to data cache.
+  bool fault_answered() const {
+    return buffer.faulted == true && flushing == false && addr == buffer.fault_addr;
+  }
+
+  // Values forwarded to data cache: the request, or the page table entry the walk reads.
+  bool forward_load() const {
+    return buffer.walking == true || (load == true && translated());
+  }
+
+  bool forward_store() const {
+    return buffer.walking == false && store == true && translated();
+  }
+
+  max_size_t forward_addr() const {
+    if (buffer.walking == true) {
+      return to_unsigned(buffer.pte_addr);
+    }
+    unsigned int physical = 0;
+    translate(physical);
+    return physical;
+  }
+
+  max_size_t forward_mode() const {
+    return buffer.walking == true ? static_cast<max_size_t>(memory::WORD) : to_unsigned(mode);
+  }
+
+  max_size_t forward_atomic() const {
+    return buffer.walking == true ? static_cast<max_size_t>(memory::NOT_ATOMIC) : to_unsigned(atomic);
+  }
+
+  max_size_t forward_store_data() const {
+    return to_unsigned(store_data);
+  }
+
+  bool forward_flushing() const {
+    return buffer.walking == false && flushing == true;
+  }
+
+  bool forward_runahead() const {
+    return buffer.walking == false && runahead == true;
+  }
+
+  // Values forwarded to the load/store unit.
+  bool load_finished() const {
+    return fault_answered() ? load == true : buffer.walking == false && cache_load_finished == true;
+  }
+
+  bool store_finished() const {
+    return fault_answered() ? store == true : buffer.walking == false && cache_store_finished == true;
+  }
+
+  max_size_t data() const {
+    return fault_answered() ? 0 : to_unsigned(cache_data);
+  }
+
+  bool poisoned() const {
+    return !fault_answered() && cache_poisoned == true;
+  }
+
+  void work() override {
+    if (buffer.faulted == true) {
+      buffer.faulted.assign(false);
+      return;
+    }
+    if (buffer.walking == true) {
+      statistics.dtlb_walk_cycles++;
+      if (cache_load_finished == true && !buffer.walk_step(to_unsigned(cache_data), config.dtlb_entries)) {
+        statistics.data_page_faults++;
+      }
+      return;
+    }
+    // a request being answered is not looked up again
+    if ((load == false && store == false) || flushing == true || cache_load_finished == true ||
+        cache_store_finished == true) {
+      return;
+    }
+    unsigned int physical;
+    auto result = translate(physical);
+    if (result == TLB_MISS) {
+      buffer.start_walk(to_unsigned(satp), to_unsigned(addr));
+      statistics.dtlb_misses++;
+    } else if (result == PAGE_FAULT) {
+      buffer.fault(to_unsigned(addr));
+      statistics.data_page_faults++;
+    }
+  }
+};
+
+#endif //RISC_V_TLB_HPP
@@ -0,0 +1,583 @@
+#ifndef RISC_V_TRACE_HPP
+#define RISC_V_TRACE_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "instructions.hpp"
+#include "config.hpp"
+
+using namespace instructions;
+
+// Traces of a run: every instruction the front end of each hart delivers, in order, with its pc and its instruction
+// word (which gives the op and registers); whether it was committed or thrown away by a flush; the value a load or
+// atomic got from data cache; and, once committed, the address of a load, store or atomic and the outcome of
+// a branch. The instructions of a fused pair are two records. See replay::Feed for running a trace again.
+// A file is a header followed by blocks, each a byte count, a record count and the encoded records. A record is
+// a byte of RecordFlag, then the fields its flags call for:
+//   HART      varint of the hart, when it is not that of the previous record
+//   JUMPED    zigzag varint of pc minus the pc after the previous instruction of the hart
+//   NEW_CODE  the instruction word, 2 or 4 bytes, when the code cache does not hold it for pc
+//   MEMORY    zigzag varint of the address minus the last address of the same pc, from the address cache
+//   VALUE     zigzag varint of the value minus the last value of the same pc, from the value cache
+//   END       varint of the value the program returns; the last record, with no instruction
+// The caches are direct-mapped by pc and kept alike by the writer and the reader, so straight-line code costs one
+// byte per instruction and a strided access or a counting load a byte or two more.
+namespace trace {
+  constexpr char MAGIC[8] = {'R', 'V', 'T', 'R', 'A', 'C', 'E', 0};
+  constexpr unsigned int VERSION = 2;
+  constexpr unsigned int CODE_CACHE_SIZE = 1 << 12;
+  constexpr unsigned int ADDRESS_CACHE_SIZE = 1 << 10;
+  constexpr unsigned int BATCH_SIZE = 1 << 14; // records handed to the writer thread at once
+  constexpr unsigned int MAX_HARTS = MAX_CORES * MAX_THREADS;
+  constexpr unsigned long long NO_SERIAL = ~0ull;
+
+  enum RecordFlag : unsigned char {
+    JUMPED = 1,
+    NEW_CODE = 2,
+    MEMORY = 4, // a committed load, store or atomic
+    TAKEN = 8, // a committed conditional branch that was taken
+    VALUE = 16,
+    SQUASHED = 32, // delivered, but thrown away by a flush
+    HART = 64,
+    END = 128
+  };
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t harts; // config.cores * config.smt of the run
+  };
+
+  // One instruction of a trace.
+  struct Record {
+    unsigned int hart;
+    unsigned int pc;
+    unsigned int code;
+    bool squashed;
+    unsigned int addr; // for a committed load, store or atomic
+    bool taken; // for a committed conditional branch
+    bool valued; // a load or atomic that got a value from data cache
+    unsigned int value;
+    bool end; // the end of the trace, with return_value instead of an instruction
+    unsigned int return_value;
+  };
+
+  // The state the writer and the reader share to encode records against.
+  struct Predictor {
+    struct CodeEntry {
+      unsigned int pc = ~0u;
+      unsigned int code = 0;
+    };
+
+    unsigned int hart = 0; // of the previous record
+    std::array<unsigned int, MAX_HARTS> next_pc{}; // after the previous instruction of each hart
+    std::vector<CodeEntry> code_cache = std::vector<CodeEntry>(CODE_CACHE_SIZE);
+    std::vector<unsigned int> address_cache = std::vector<unsigned int>(ADDRESS_CACHE_SIZE);
+    std::vector<unsigned int> value_cache = std::vector<unsigned int>(ADDRESS_CACHE_SIZE);
+
+    static unsigned int length_of(unsigned int code) {
+      return is_compressed(code & 0xffff) ? 2 : 4;
+    }
+
+    CodeEntry &code_entry(unsigned int pc) {
+      return code_cache[(pc >> 1) & (CODE_CACHE_SIZE - 1)];
+    }
+
+    unsigned int &last_address(unsigned int pc) {
+      return address_cache[(pc >> 1) & (ADDRESS_CACHE_SIZE - 1)];
+    }
+
+    unsigned int &last_value(unsigned int pc) {
+      return value_cache[(pc >> 1) & (ADDRESS_CACHE_SIZE - 1)];
+    }
+  };
+
+  void put_varint(std::vector<unsigned char> &out, unsigned int value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<unsigned char>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+  }
+
+  unsigned int zigzag(unsigned int delta) {
+    return delta << 1 ^ static_cast<unsigned int>(static_cast<int>(delta) >> 31);
+  }
+
+  unsigned int unzigzag(unsigned int value) {
+    return value >> 1 ^ (0u - (value & 1));
+  }
+
+  class Encoder : Predictor {
+  public:
+    std::vector<unsigned char> bytes;
+    unsigned int records = 0;
+
+    void encode(const Record &record) {
+      records++;
+      if (record.end) {
+        bytes.push_back(END);
+        put_varint(bytes, record.return_value);
+        return;
+      }
+      auto length = length_of(record.code);
+      auto op = decode_instruction(record.code).op;
+      auto &entry = code_entry(record.pc);
+      unsigned char flags = 0;
+      flags |= record.hart != hart ? HART : 0;
+      flags |= record.pc != next_pc[record.hart] ? JUMPED : 0;
+      flags |= entry.pc != record.pc || entry.code != record.code ? NEW_CODE : 0;
+      flags |= !record.squashed && is_memory_access(op) ? MEMORY : 0;
+      flags |= record.taken ? TAKEN : 0;
+      flags |= record.valued ? VALUE : 0;
+      flags |= record.squashed ? SQUASHED : 0;
+      bytes.push_back(flags);
+      if (flags & HART) {
+        put_varint(bytes, record.hart);
+        hart = record.hart;
+      }
+      if (flags & JUMPED) {
+        put_varint(bytes, zigzag(record.pc - next_pc[hart]));
+      }
+      if (flags & NEW_CODE) {
+        for (unsigned int i = 0; i < length; i++) {
+          bytes.push_back(static_cast<unsigned char>(record.code >> (i * 8)));
+        }
+        entry = {record.pc, record.code};
+      }
+      if (flags & MEMORY) {
+        auto &last = last_address(record.pc);
+        put_varint(bytes, zigzag(record.addr - last));
+        last = record.addr;
+      }
+      if (flags & VALUE) {
+        auto &last = last_value(record.pc);
+        put_varint(bytes, zigzag(record.value - last));
+        last = record.value;
+      }
+      next_pc[hart] = record.pc + length;
+    }
+  };
+
+  // Reads the records of a trace file in order.
+  class Reader : Predictor {
+    std::ifstream in;
+    std::vector<unsigned char> block;
+    size_t pos = 0;
+
+    unsigned char get_byte() {
+      if (pos == block.size()) {
+        std::uint32_t sizes[2];
+        if (!in.read(reinterpret_cast<char *>(sizes), sizeof(sizes))) {
+          throw std::runtime_error("Trace ends without its end record");
+        }
+        block.resize(sizes[0]);
+        in.read(reinterpret_cast<char *>(block.data()), sizes[0]);
+        pos = 0;
+        if (!in || block.empty()) {
+          throw std::runtime_error("Trace is truncated");
+        }
+      }
+      return block[pos++];
+    }
+
+    unsigned int get_varint() {
+      unsigned int value = 0;
+      for (unsigned int shift = 0;; shift += 7) {
+        auto byte = get_byte();
+        value |= (byte & 0x7fu) << shift;
+        if (!(byte & 0x80)) {
+          return value;
+        }
+      }
+    }
+
+  public:
+    unsigned int harts = 0;
+
+    explicit Reader(const std::string &path) : in(path, std::ios::binary) {
+      Header header{};
+      if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+          std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a trace: " + path);
+      }
+      if (header.version != VERSION) {
+        throw std::runtime_error("Trace " + path + " has version " + std::to_string(header.version) +
+                                 ", expected " + std::to_string(VERSION));
+      }
+      if (header.harts == 0 || header.harts > MAX_HARTS) {
+        throw std::runtime_error("Trace " + path + " has " + std::to_string(header.harts) + " harts");
+      }
+      harts = header.harts;
+    }
+
+    Record next() {
+      Record record{};
+      auto flags = get_byte();
+      if (flags & END) {
+        record.end = true;
+        record.return_value = get_varint();
+        return record;
+      }
+      if (flags & HART) {
+        hart = get_varint();
+        if (hart >= harts) {
+          throw std::runtime_error("Trace names hart " + std::to_string(hart));
+        }
+      }
+      record.hart = hart;
+      record.pc = next_pc[hart] + (flags & JUMPED ? unzigzag(get_varint()) : 0);
+      auto &entry = code_entry(record.pc);
+      if (flags & NEW_CODE) {
+        record.code = get_byte();
+        record.code |= get_byte() << 8;
+        if (length_of(record.code) == 4) {
+          record.code |= get_byte() << 16;
+          record.code |= static_cast<unsigned int>(get_byte()) << 24;
+        }
+        entry = {record.pc, record.code};
+      } else {
+        record.code = entry.code;
+      }
+      if (flags & MEMORY) {
+        auto &last = last_address(record.pc);
+        record.addr = last + unzigzag(get_varint());
+        last = record.addr;
+      }
+      if (flags & VALUE) {
+        auto &last = last_value(record.pc);
+        record.value = last + unzigzag(get_varint());
+        last = record.value;
+      }
+      record.taken = flags & TAKEN;
+      record.valued = flags & VALUE;
+      record.squashed = flags & SQUASHED;
+      next_pc[hart] = record.pc + length_of(record.code);
+      return record;
+    }
+  };
+
+  // What a trace follows of a run. Each instruction slot the front end of a hart delivers, a fused pair being one,
+  // gets the next serial number of the hart, kept by fetch buffer position and then by reorder buffer entry,
+  // so that the load/store buffer and commit can name it. The modules report what happens in a cycle here,
+  // possibly from several threads, each writing only what belongs to its own hart or core,
+  // and end_cycle takes it all between cycles.
+  // Writer makes records of a run; replay::Feed gives a run the code and the values of the records instead.
+  class Tracker {
+  protected:
+    struct Delivery {
+      unsigned long long serial;
+      unsigned int pc;
+      Op op;
+      unsigned int count; // instructions in the slot: 2 for a fused pair
+      bool predict; // the front end followed the taken path of this branch
+    };
+
+    struct Commit {
+      unsigned long long serial; // NO_SERIAL from the in-order core, which names the instruction by pc
+      unsigned int pc;
+      unsigned int addr; // of a load, store or atomic
+      bool taken; // for a conditional branch
+      unsigned int count;
+      bool valued; // a load or atomic written back by the in-order core, with value
+      unsigned int value;
+    };
+
+    struct HartLog {
+      unsigned long long delivered = 0;
+      std::array<unsigned long long, FETCH_BUFFER_SIZE> slots{}; // serial at each fetch buffer position
+      std::vector<Delivery> deliveries; // in this cycle
+      std::vector<Commit> commits;
+      bool flushed = false;
+    };
+
+    std::vector<HartLog> harts = std::vector<HartLog>(config.cores * config.smt);
+    // serial and address of the last access of each reorder buffer entry, by core
+    std::vector<std::array<unsigned long long, MAX_ROB_ENTRIES>> entries =
+        std::vector<std::array<unsigned long long, MAX_ROB_ENTRIES>>(config.cores);
+    std::vector<std::array<unsigned int, MAX_ROB_ENTRIES>> addresses =
+        std::vector<std::array<unsigned int, MAX_ROB_ENTRIES>>(config.cores);
+
+  public:
+    virtual ~Tracker() = default;
+
+    // The 16 bits at pc the fetch stage of hart decodes, given half, what its fetch line holds there.
+    virtual unsigned int fetched_half(unsigned int hart, unsigned int pc, unsigned int half) = 0;
+
+    // The value the load or atomic in reorder buffer entry tag broadcasts, given what data cache answered.
+    virtual unsigned int loaded(unsigned int core, unsigned int thread, unsigned int tag, unsigned int value) = 0;
+
+    // The value the in-order core of hart writes back for a load or atomic, given what data cache answered.
+    virtual unsigned int written_back(unsigned int hart, unsigned int value) = 0;
+
+    // Take what happened in the cycle. Called between cycles.
+    virtual void end_cycle() = 0;
+
+    // Called once the run has halted, with what the program returns.
+    virtual void finish(unsigned int return_value) = 0;
+
+    // Called by the fetch stage of hart for each slot it delivers, at fetch buffer position pos.
+    void deliver(unsigned int hart, unsigned int pos, unsigned int pc, Op op, bool predict) {
+      HartLog &log = harts[hart];
+      log.slots[pos % FETCH_BUFFER_SIZE] = log.delivered;
+      log.deliveries.push_back({log.delivered++, pc, op, is_fused(op) ? 2u : 1u, predict});
+    }
+
+    // Called by the reorder buffer of core as it renames the slot at fetch buffer position pos of hart into tag.
+    void issue(unsigned int core, unsigned int hart, unsigned int pos, unsigned int tag) {
+      entries[core][tag] = harts[hart].slots[pos % FETCH_BUFFER_SIZE];
+    }
+
+    // Called by the load/store buffer of core for each access it sends to data cache.
+    void access(unsigned int core, unsigned int tag, unsigned int addr) {
+      addresses[core][tag] = addr;
+    }
+
+    // The address of the last access of the instruction at tag in the reorder buffer of core.
+    unsigned int address_of(unsigned int core, unsigned int tag) const {
+      return addresses[core][tag];
+    }
+
+    // Called by the reorder buffer of core for each instruction of hart it commits, outside runahead.
+    void commit(unsigned int core, unsigned int hart, unsigned int tag, unsigned int pc, unsigned int addr, bool taken,
+                Op op) {
+      harts[hart].commits.push_back({entries[core][tag], pc, addr, taken, is_fused(op) ? 2u : 1u, false, 0});
+    }
+
+    // Called by the in-order core of hart for each instruction it retires; valued for a load or atomic.
+    void retire(unsigned int hart, unsigned int pc, unsigned int addr, bool taken, bool valued, unsigned int value) {
+      harts[hart].commits.push_back({NO_SERIAL, pc, addr, taken, 1, valued, value});
+    }
+
+    // Called by the reorder buffer as it drops the instructions of hart.
+    void flush(unsigned int hart) {
+      harts[hart].flushed = true;
+    }
+  };
+
+  // Writes the trace of a run. The instructions of each hart wait in delivery order until they are committed,
+  // or until one delivered after them is, which means a flush threw them away; the code of each is what the fetch
+  // stage read at its pc. Between cycles the records of those known are given to a thread in the background,
+  // which encodes and writes them.
+  class Writer : public Tracker {
+    struct Instance {
+      unsigned int pc;
+      unsigned int count;
+      bool committed;
+      unsigned int addr;
+      bool taken;
+      bool valued;
+      unsigned int value;
+    };
+
+    struct Load {
+      unsigned int hart;
+      unsigned long long serial;
+      unsigned int value;
+    };
+
+    struct HartTrace {
+      std::unordered_map<unsigned int, unsigned int> halves; // the code the fetch stage read, by pc
+      std::deque<Instance> pending; // delivered and not known to be committed or thrown away
+      unsigned long long base = 0; // serial of the first pending
+      unsigned long long known = 0; // serials below it are committed or thrown away
+    };
+
+    std::ofstream out;
+    std::vector<HartTrace> traces = std::vector<HartTrace>(config.cores * config.smt);
+    std::vector<std::vector<Load>> loads = std::vector<std::vector<Load>>(config.cores); // in this cycle, by core
+    std::vector<Record> filling, handed;
+    bool closing = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    static unsigned int half_of(const HartTrace &trace, unsigned int pc) {
+      auto it = trace.halves.find(pc);
+      return it == trace.halves.end() ? 0 : it->second;
+    }
+
+    // Give the slots of hart known to be committed or thrown away to the records.
+    void emit(unsigned int hart) {
+      HartTrace &trace = traces[hart];
+      while (!trace.pending.empty() && (trace.pending.front().committed || trace.base < trace.known)) {
+        const Instance &inst = trace.pending.front();
+        auto pc = inst.pc;
+        for (unsigned int i = 0; i < inst.count; i++) {
+          auto code = half_of(trace, pc);
+          if (!is_compressed(code)) {
+            code |= half_of(trace, pc + 2) << 16;
+          }
+          bool first = i == 0;
+          filling.push_back({hart, pc, code, !inst.committed, first ? inst.addr : 0, first && inst.taken,
+                             first && inst.valued, first ? inst.value : 0, false, 0});
+          pc += Predictor::length_of(code);
+        }
+        trace.pending.pop_front();
+        trace.base++;
+      }
+    }
+
+    Instance *pending_at(unsigned int hart, unsigned long long serial) {
+      HartTrace &trace = traces[hart];
+      if (serial < trace.base || serial - trace.base >= trace.pending.size()) {
+        return nullptr;
+      }
+      return &trace.pending[serial - trace.base];
+    }
+
+    // The serial of the instruction at pc the in-order core of hart retires: the first that may be retired.
+    unsigned long long serial_at(unsigned int hart, unsigned int pc) {
+      HartTrace &trace = traces[hart];
+      for (auto serial = std::max(trace.base, trace.known); serial - trace.base < trace.pending.size(); serial++) {
+        if (trace.pending[serial - trace.base].pc == pc) {
+          return serial;
+        }
+      }
+      return NO_SERIAL;
+    }
+
+    void write_block(Encoder &encoder) {
+      if (encoder.records == 0) {
+        return;
+      }
+      std::uint32_t sizes[2] = {static_cast<std::uint32_t>(encoder.bytes.size()), encoder.records};
+      out.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+      out.write(reinterpret_cast<const char *>(encoder.bytes.data()),
+                static_cast<std::streamsize>(encoder.bytes.size()));
+      encoder.bytes.clear();
+      encoder.records = 0;
+    }
+
+    void run() {
+      Encoder encoder;
+      std::vector<Record> records;
+      while (true) {
+        {
+          std::unique_lock lock(mutex);
+          changed.wait(lock, [this]() { return !handed.empty() || closing; });
+          records.swap(handed);
+          changed.notify_all();
+        }
+        if (records.empty()) {
+          break;
+        }
+        for (auto &record: records) {
+          encoder.encode(record);
+        }
+        write_block(encoder);
+        records.clear();
+      }
+    }
+
+    // Give the records gathered so far to the thread, once it has taken the previous ones.
+    void hand_over() {
+      std::unique_lock lock(mutex);
+      changed.wait(lock, [this]() { return handed.empty(); });
+      handed.swap(filling);
+      changed.notify_all();
+    }
+
+  public:
+    // Start a trace of the run at path.
+    explicit Writer(const std::string &path) : out(path, std::ios::binary | std::ios::trunc) {
+      Header header{};
+      std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+      header.version = VERSION;
+      header.harts = config.cores * config.smt;
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      if (!out) {
+        throw std::runtime_error("Cannot write trace " + path);
+      }
+      filling.reserve(BATCH_SIZE);
+      thread = std::thread([this]() { run(); });
+    }
+    Writer(const Writer &) = delete;
+
+    unsigned int fetched_half(unsigned int hart, unsigned int pc, unsigned int half) override {
+      traces[hart].halves[pc] = half;
+      return half;
+    }
+
+    unsigned int loaded(unsigned int core, unsigned int thread, unsigned int tag, unsigned int value) override {
+      loads[core].push_back({core * config.smt + thread, entries[core][tag], value});
+      return value;
+    }
+
+    unsigned int written_back(unsigned int, unsigned int value) override {
+      return value;
+    }
+
+    void end_cycle() override {
+      for (unsigned int hart = 0; hart < harts.size(); hart++) {
+        for (auto &delivery: harts[hart].deliveries) {
+          traces[hart].pending.push_back({delivery.pc, delivery.count, false, 0, false, false, 0});
+        }
+        harts[hart].deliveries.clear();
+      }
+      for (auto &core_loads: loads) {
+        for (auto &load: core_loads) {
+          if (auto inst = pending_at(load.hart, load.serial)) {
+            inst->valued = true;
+            inst->value = load.value;
+          }
+        }
+        core_loads.clear();
+      }
+      for (unsigned int hart = 0; hart < harts.size(); hart++) {
+        for (auto &commit: harts[hart].commits) {
+          auto serial = commit.serial == NO_SERIAL ? serial_at(hart, commit.pc) : commit.serial;
+          auto inst = pending_at(hart, serial);
+          if (!inst) {
+            continue;
+          }
+          inst->committed = true;
+          inst->addr = commit.addr;
+          inst->taken = commit.taken;
+          if (commit.valued) {
+            inst->valued = true;
+            inst->value = commit.value;
+          }
+          traces[hart].known = serial + 1;
+        }
+        harts[hart].commits.clear();
+        harts[hart].flushed = false;
+        emit(hart);
+      }
+      if (filling.size() >= BATCH_SIZE) {
+        hand_over();
+      }
+    }
+
+    // Write what is left, as thrown away, and the end record with what the program returns.
+    void finish(unsigned int return_value) override {
+      end_cycle();
+      for (unsigned int hart = 0; hart < traces.size(); hart++) {
+        traces[hart].known = NO_SERIAL;
+        emit(hart);
+      }
+      filling.push_back({0, 0, 0, false, 0, false, false, 0, true, return_value});
+      hand_over();
+      {
+        std::lock_guard lock(mutex);
+        closing = true;
+        changed.notify_all();
+      }
+      thread.join();
+      out.close();
+    }
+  };
+
+  Tracker *tracker = nullptr; // the trace being written or replayed, if any
+}
+
+#endif //RISC_V_TRACE_HPP
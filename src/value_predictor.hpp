@@ -0,0 +1,55 @@
+#ifndef RISC_V_VALUE_PREDICTOR_HPP
+#define RISC_V_VALUE_PREDICTOR_HPP
+
+#include <algorithm>
+#include <array>
+#include "fetch.hpp"
+
+struct ValuePredictorEntry {
+  Data tag; // the full pc of the load
+  Data last; // value of its last committed instance
+  Data stride; // difference between its last two values
+  Confidence confidence; // how many times in a row last + stride was right
+};
+
+// Last-value and stride predictor for loads, trained with the values of committed loads.
+// A constant reload has stride 0; a walk over nodes laid out one after another has the node size.
+struct ValuePredictor {
+  std::array<ValuePredictorEntry, VALUE_PREDICTOR_SIZE> entries;
+
+  static constexpr unsigned int CONFIDENT = 7;
+
+  static unsigned int index_of(unsigned int pc) {
+    return hash_pc(pc) & (VALUE_PREDICTOR_SIZE - 1);
+  }
+
+  // Predict the value of the load at pc, with in_flight older instances of it not yet committed.
+  // Return false if the predictor is not sure enough.
+  bool predict(unsigned int pc, unsigned int in_flight, unsigned int &value) {
+    ValuePredictorEntry &entry = entries[index_of(pc)];
+    if (entry.tag != pc || entry.confidence != CONFIDENT) {
+      return false;
+    }
+    value = to_unsigned(entry.last) + to_unsigned(entry.stride) * (in_flight + 1);
+    return true;
+  }
+
+  // Learn the value of a committed load. Call it at most once a cycle for each entry.
+  void train(unsigned int pc, unsigned int value) {
+    ValuePredictorEntry &entry = entries[index_of(pc)];
+    if (entry.tag != pc) {
+      entry.tag.assign(pc);
+      entry.last.assign(value);
+      entry.stride.assign(0);
+      entry.confidence.assign(0);
+      return;
+    }
+    auto last = to_unsigned(entry.last), stride = to_unsigned(entry.stride);
+    auto confidence = to_unsigned(entry.confidence);
+    entry.last.assign(value);
+    entry.stride.assign(value - last);
+    entry.confidence.assign(value == last + stride ? std::min(confidence + 1, CONFIDENT) : 0);
+  }
+};
+
+#endif //RISC_V_VALUE_PREDICTOR_HPP
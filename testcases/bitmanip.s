@@ -0,0 +1,129 @@
+# Zba and Zbb, without a C runtime: each check that gives the value the specification asks for adds 1 to a0,
+# and the program returns the number of checks, 45.
+# Besides each instruction on ordinary values it covers the edges: clz, ctz and cpop of 0 and of single bits,
+# rotations by 0, by 31 and by amounts above 31 (only the low 5 bits count), signed against unsigned min and max,
+# and orc.b and rev8 on words with zero and non-zero bytes.
+  .option norvc
+  .macro expect reg, value
+  li t6, \value
+  bne \reg, t6, 1f
+  addi a0, a0, 1
+1:
+  .endm
+  li a0, 0
+  li s0, 0x80f00103
+  li s1, 0x12345678
+# Zba
+  sh1add t0, s0, s1
+  expect t0, 0x1414587e
+  sh2add t0, s0, s1
+  expect t0, 0x15f45a84
+  sh3add t0, s0, s1
+  expect t0, 0x19b45e90
+  li t1, 5
+  sh3add t0, t1, zero
+  expect t0, 40
+# logic with a negated operand
+  andn t0, s0, s1
+  expect t0, 0x80c00103
+  orn t0, s0, s1
+  expect t0, 0xedfba987
+  xnor t0, s0, s1
+  expect t0, 0x6d3ba884
+  xnor t0, s1, s1
+  expect t0, -1
+# min and max, signed and unsigned
+  li t1, -5
+  li t2, 3
+  min t0, t1, t2
+  expect t0, -5
+  max t0, t1, t2
+  expect t0, 3
+  minu t0, t1, t2
+  expect t0, 3
+  maxu t0, t1, t2
+  expect t0, -5
+  min t0, s0, s0
+  expect t0, 0x80f00103
+# rotations
+  li t1, 36
+  rol t0, s0, t1
+  expect t0, 0x0f001038
+  ror t0, s0, t1
+  expect t0, 0x380f0010
+  rol t0, s0, zero
+  expect t0, 0x80f00103
+  li t1, 32
+  ror t0, s0, t1
+  expect t0, 0x80f00103
+  rori t0, s0, 31
+  expect t0, 0x01e00207
+  rori t0, s1, 8
+  expect t0, 0x78123456
+  rori t0, s1, 0
+  expect t0, 0x12345678
+# counting
+  clz t0, zero
+  expect t0, 32
+  ctz t0, zero
+  expect t0, 32
+  cpop t0, zero
+  expect t0, 0
+  li t1, 1
+  clz t0, t1
+  expect t0, 31
+  ctz t0, t1
+  expect t0, 0
+  li t1, 0x80000000
+  clz t0, t1
+  expect t0, 0
+  ctz t0, t1
+  expect t0, 31
+  cpop t0, t1
+  expect t0, 1
+  clz t0, s1
+  expect t0, 3
+  ctz t0, s1
+  expect t0, 3
+  cpop t0, s0
+  expect t0, 8
+  cpop t0, s1
+  expect t0, 13
+  li t1, -1
+  cpop t0, t1
+  expect t0, 32
+  clz t0, t1
+  expect t0, 0
+# extensions
+  li t1, 0x1234ab80
+  sext.b t0, t1
+  expect t0, 0xffffff80
+  li t1, 0x1234ab7f
+  sext.b t0, t1
+  expect t0, 0x7f
+  li t1, 0x12348001
+  sext.h t0, t1
+  expect t0, 0xffff8001
+  zext.h t0, t1
+  expect t0, 0x8001
+  zext.h t0, s0
+  expect t0, 0x0103
+# orc.b and rev8
+  orc.b t0, s0
+  expect t0, 0xffffffff
+  li t1, 0x00010300
+  orc.b t0, t1
+  expect t0, 0x00ffff00
+  orc.b t0, zero
+  expect t0, 0
+  rev8 t0, s0
+  expect t0, 0x0301f080
+  rev8 t0, t1
+  expect t0, 0x00030100
+# results feeding each other: the index of the highest set bit of s1, 28, times 8 plus the bytes of s0 reversed
+  clz t0, s1
+  xori t0, t0, 31
+  rev8 t1, s0
+  sh3add t0, t0, t1
+  expect t0, 0x0301f080 + 28 * 8
+  .word 0x0ff00513 # li a0, 255, which halts
@@ -0,0 +1,151 @@
+# RV32C mixed with 32-bit code, without a C runtime: each check that gives the value the specification asks for
+# adds 1 to a0, and the program returns the number of checks, 30.
+# The 16-bit forms of the integer and single-precision instructions all appear, and 32-bit instructions start at pcs
+# that are 2 mod 4: a jump and branch target, an auipc, a jal and a branch there, and an addi split across two
+# fetch blocks, inside a loop so that it is also fetched again from the trace cache.
+  .option rvc
+  .macro expect reg, value
+  li t6, \value
+  bne \reg, t6, 1f
+  addi a0, a0, 1
+1:
+  .endm
+  .equ DATA, 0x8000
+  c.li a0, 0
+  li sp, 0x10000
+  .equ CALLEE, 0x402
+# arithmetic
+  c.li s0, -7
+  expect s0, -7
+  c.lui s1, 0xfffff # the top of c.lui's range
+  expect s1, 0xfffff000
+  c.addi s0, 12
+  expect s0, 5
+  c.mv a1, s0
+  c.slli a1, 4
+  expect a1, 80
+  c.srli a1, 3
+  expect a1, 10
+  c.li a2, -32
+  c.srai a2, 2
+  expect a2, -8
+  c.andi a2, 0x1c
+  expect a2, 24
+  c.li a3, 13
+  c.li a4, 6
+  c.add a3, a4
+  expect a3, 19
+  c.sub a3, a4
+  expect a3, 13
+  c.xor a3, a4
+  expect a3, 11
+  c.or a3, a4
+  expect a3, 15
+  c.and a3, a4
+  expect a3, 6
+  c.addi16sp sp, -64
+  c.addi4spn a5, sp, 36
+  expect a5, 0xffe4
+  c.addi16sp sp, 64
+  expect sp, 0x10000
+# loads and stores, integer and single precision
+  li a4, DATA
+  li a3, 0x1234
+  c.sw a3, 124(a4)
+  c.lw a5, 124(a4)
+  expect a5, 0x1234
+  c.addi16sp sp, -16
+  c.swsp a3, 8(sp)
+  c.lwsp s0, 8(sp)
+  expect s0, 0x1234
+  li t0, 0x40490fdb # pi
+  sw t0, 0(a4)
+  c.flw fa0, 0(a4)
+  c.fsw fa0, 4(a4)
+  c.fswsp fa0, 12(sp)
+  c.flwsp fa1, 12(sp)
+  fmv.x.w t1, fa1
+  expect t1, 0x40490fdb
+  c.lw a5, 4(a4)
+  expect a5, 0x40490fdb
+  c.addi16sp sp, 16
+# 32-bit instructions at pcs 2 mod 4
+  .balign 4
+  c.nop
+auipc_here:
+  auipc t0, 0 # at 2 mod 4
+  jal t1, 2f
+2:
+  sub t2, t1, t0
+  expect t2, 8
+  andi t2, t0, 3
+  expect t2, 2
+# c.j and c.jal forward to a target 2 mod 4, and the link of c.jal is the pc after it, 2 bytes on
+  li s0, 0
+  c.j 3f
+  c.li s0, 1 # skipped
+  .balign 4
+  c.nop
+3:
+  expect s0, 0
+  auipc s1, 0
+  c.jal callee
+  sub t2, t2, s1
+  expect t2, 6
+  expect s2, 4
+# c.jalr through a register, and c.jr back
+  li s2, 0
+  li s3, CALLEE
+  auipc s1, 0
+  c.jalr s3
+  sub t2, t2, s1
+  expect t2, 6
+  expect s2, 4
+# c.beqz and c.bnez, taken and not, in a loop whose 32-bit addi straddles two fetch blocks: sum 1 to 20
+  li s1, 20
+  li s5, 0
+  li s6, 0
+  .balign 16
+  c.nop
+loop:
+  c.add s5, s1
+  c.nop
+  c.nop
+  c.nop
+  c.nop
+  c.nop
+  addi s6, s6, 100 # bytes 12 to 15 from loop, 14 to 17 of its block
+  c.addi s1, -1
+  c.beqz s1, 4f
+  c.bnez s1, loop
+  c.li s5, 0 # not reached
+4:
+  expect s5, 210
+  expect s6, 2000
+# a 32-bit branch at 2 mod 4, taken backwards to a target 2 mod 4, three times
+  li s7, 3
+  li s8, 0
+  .balign 4
+  c.nop
+back:
+  addi s8, s8, 7
+  c.addi s7, -1
+  c.nop
+  bne s7, zero, back # at 2 mod 4
+  expect s8, 21
+# c.jalr with ra as the target register reads it before writing the link
+  li s2, 0
+  li ra, CALLEE
+  auipc s1, 0
+  c.jalr ra
+  sub t2, t2, s1
+  expect t2, 6
+  expect s2, 4
+  .word 0x0ff00513 # li a0, 255, which halts
+
+# callee: s2 = 4 and t2 = the link
+  .org CALLEE
+callee:
+  c.li s2, 4 # at 2 mod 4
+  c.mv t2, ra
+  c.jr ra
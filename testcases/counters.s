@@ -0,0 +1,131 @@
+# Zicsr and the counter csrs, without a C runtime: each check that gives the value the specification asks for
+# adds 1 to a0, and hart 0 returns the number of checks, 35. Other harts park at once.
+# A counter reads the count at the end of the cycle before the csr instruction, which waits for every older
+# instruction to retire, so minstret counts exactly the instructions before it, and two reads of cycle, time or
+# mcycle differ. The counters ignore writes; fflags, frm and fcsr take them, as views of one register.
+  .option norvc
+  .macro expect reg, value
+  li t6, \value
+  bne \reg, t6, 1f
+  addi a0, a0, 1
+1:
+  .endm
+  csrr s0, minstret # the first instruction: nothing has retired
+  csrr t0, mhartid
+  bnez t0, park
+  li a0, 0
+  expect s0, 0
+  expect t0, 0
+# minstret counts the instructions between two reads, the first read included; instret is the same counter
+  csrr s0, minstret
+  nop
+  nop
+  nop
+  nop
+  nop
+  csrr s1, minstret
+  sub t0, s1, s0
+  expect t0, 6
+  csrr s0, instret
+  csrr s1, minstret
+  sub t0, s1, s0
+  expect t0, 1
+# cycle, time and mcycle: later reads are larger, and all are past the instructions retired so far
+  csrr s0, mcycle
+  csrr s1, cycle
+  csrr s2, time
+  csrr s3, mcycle
+  sltu t0, s0, s1
+  expect t0, 1
+  sltu t0, s1, s2
+  expect t0, 1
+  sltu t0, s2, s3
+  expect t0, 1
+  csrr s4, minstret
+  sltu t0, s4, s3
+  expect t0, 1
+# the upper halves of a short run are 0
+  csrr t0, cycleh
+  expect t0, 0
+  csrr t0, mcycleh
+  expect t0, 0
+  csrr t0, instreth
+  expect t0, 0
+  csrr t0, minstreth
+  expect t0, 0
+# hpmcounter3 counts conditional branches retired, and hpmcounter4 those mispredicted: the loop's exit at least
+  li t1, 10
+  csrr s0, hpmcounter3
+  csrr s2, hpmcounter4
+loop:
+  addi t1, t1, -1
+  bnez t1, loop
+  csrr s1, mhpmcounter3
+  csrr s3, hpmcounter4
+  sub t0, s1, s0
+  expect t0, 10
+  sub t0, s3, s2
+  sltiu t2, t0, 1
+  expect t2, 0
+  sltiu t2, t0, 11
+  expect t2, 1
+# counters past the last one kept, and unknown csrs, read 0
+  csrr t0, hpmcounter31
+  expect t0, 0
+  csrr t0, 0x7c0
+  expect t0, 0
+# writes to counters and to unknown csrs are ignored; the old value is still returned
+  li t1, 1000000
+  csrrw s0, minstret, t1
+  csrr s1, minstret
+  sub t0, s1, s0
+  expect t0, 1
+  csrrw s0, mcycle, zero
+  csrr s1, mcycle
+  sltu t0, s0, s1
+  expect t0, 1
+  csrrw t0, 0x7c0, t1
+  csrr t0, 0x7c0
+  expect t0, 0
+# fflags, frm and fcsr with every form of csr instruction
+  csrrwi t0, fcsr, 0
+  csrrsi t0, fflags, 0b10101
+  expect t0, 0
+  csrr t0, fflags
+  expect t0, 0b10101
+  csrrci t0, fflags, 0b00001
+  expect t0, 0b10101
+  csrr t0, fcsr
+  expect t0, 0b10100
+  csrrwi t0, frm, 3
+  expect t0, 0
+  csrr t0, fcsr
+  expect t0, 3 << 5 | 0b10100
+  li t1, 0x1ff
+  csrrw t0, fcsr, t1
+  expect t0, 3 << 5 | 0b10100
+  csrr t0, fcsr
+  expect t0, 0xff
+  csrr t0, frm
+  expect t0, 7
+  li t1, 0xe0
+  csrrc t0, fcsr, t1
+  csrr t0, fcsr
+  expect t0, 0x1f
+  li t1, 0x1d
+  csrrw zero, frm, t1
+  csrr t0, frm
+  expect t0, 5
+  csrrs t0, fflags, zero # reads only
+  expect t0, 0x1f
+  li t1, 0b01010
+  csrrs t0, fflags, t1
+  csrrc t0, fflags, t1
+  expect t0, 0x1f
+  csrr t0, fflags
+  expect t0, 0b10101
+  csrr t0, mhartid
+  expect t0, 0
+  .word 0x0ff00513 # li a0, 255, which halts
+park:
+  j park
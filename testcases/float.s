@@ -0,0 +1,309 @@
+# RV32F, without a C runtime: each check that gives the value the specification asks for adds 1 to a0,
+# and the program returns the number of checks, 118.
+# Results are compared bit for bit, and fflags is read and cleared after the operations that set it.
+# It covers the five rounding modes, given in the instruction and through frm, on a tie in an add and in
+# conversions to and from integers; canonical NaNs from arithmetic, against the payloads kept by sign injection and
+# moves; the invalid, divide-by-zero, overflow, underflow and inexact flags; comparisons and fclass on every kind
+# of value; and multiply-add rounding once.
+  .option norvc
+  .macro expect reg, value
+  li t6, \value
+  bne \reg, t6, 1f
+  addi a0, a0, 1
+1:
+  .endm
+  .macro expect_f freg, value
+  fmv.x.w t5, \freg
+  expect t5, \value
+  .endm
+  .macro expect_flags value
+  csrrci t5, fflags, 0x1f
+  expect t5, \value
+  .endm
+  .macro setf freg, value
+  li t5, \value
+  fmv.w.x \freg, t5
+  .endm
+  .equ NV, 0x10
+  .equ DZ, 0x08
+  .equ OF, 0x04
+  .equ UF, 0x02
+  .equ NX, 0x01
+  .equ ONE, 0x3f800000
+  .equ QNAN, 0x7fc00000 # the canonical NaN
+  li a0, 0
+  csrwi fcsr, 0
+# 1 + 2^-24 is halfway between 1 and the float after it
+  setf fs0, ONE
+  setf fs1, 0x33800000 # 2^-24
+  fneg.s fs2, fs0
+  fneg.s fs3, fs1
+  fadd.s ft0, fs0, fs1, rne
+  expect_f ft0, ONE
+  fadd.s ft0, fs0, fs1, rtz
+  expect_f ft0, ONE
+  fadd.s ft0, fs0, fs1, rdn
+  expect_f ft0, ONE
+  fadd.s ft0, fs0, fs1, rup
+  expect_f ft0, 0x3f800001
+  fadd.s ft0, fs0, fs1, rmm
+  expect_f ft0, 0x3f800001
+  expect_flags NX
+  fadd.s ft0, fs2, fs3, rne
+  expect_f ft0, 0xbf800000
+  fadd.s ft0, fs2, fs3, rtz
+  expect_f ft0, 0xbf800000
+  fadd.s ft0, fs2, fs3, rdn
+  expect_f ft0, 0xbf800001
+  fadd.s ft0, fs2, fs3, rup
+  expect_f ft0, 0xbf800000
+  fadd.s ft0, fs2, fs3, rmm
+  expect_f ft0, 0xbf800001
+  expect_flags NX
+# the same through frm
+  csrwi frm, 3 # rup
+  fadd.s ft0, fs0, fs1
+  expect_f ft0, 0x3f800001
+  csrwi frm, 2 # rdn
+  fadd.s ft0, fs2, fs3
+  expect_f ft0, 0xbf800001
+  csrwi frm, 0
+  fadd.s ft0, fs0, fs1
+  expect_f ft0, ONE
+  expect_flags NX
+# exact results raise nothing
+  fadd.s ft0, fs0, fs0
+  expect_f ft0, 0x40000000
+  expect_flags 0
+# conversions to integers of 2.5 and -2.5 in every mode
+  setf fs4, 0x40200000 # 2.5
+  fneg.s fs5, fs4
+  fcvt.w.s t0, fs4, rne
+  expect t0, 2
+  fcvt.w.s t0, fs4, rtz
+  expect t0, 2
+  fcvt.w.s t0, fs4, rdn
+  expect t0, 2
+  fcvt.w.s t0, fs4, rup
+  expect t0, 3
+  fcvt.w.s t0, fs4, rmm
+  expect t0, 3
+  fcvt.w.s t0, fs5, rne
+  expect t0, -2
+  fcvt.w.s t0, fs5, rtz
+  expect t0, -2
+  fcvt.w.s t0, fs5, rdn
+  expect t0, -3
+  fcvt.w.s t0, fs5, rup
+  expect t0, -2
+  fcvt.w.s t0, fs5, rmm
+  expect t0, -3
+  expect_flags NX
+# out of range and NaN: invalid, and the nearest end of the range, the largest for NaN
+  setf ft1, QNAN
+  fcvt.w.s t0, ft1, rtz
+  expect t0, 0x7fffffff
+  setf ft1, 0xff800000 # -inf
+  fcvt.w.s t0, ft1, rtz
+  expect t0, 0x80000000
+  setf ft1, 0x4f000000 # 2^31
+  fcvt.w.s t0, ft1, rtz
+  expect t0, 0x7fffffff
+  fcvt.wu.s t0, fs2, rtz
+  expect t0, 0
+  expect_flags NV
+# -0.5 truncates to 0, which unsigned holds: only inexact
+  setf ft1, 0xbf000000 # -0.5
+  fcvt.wu.s t0, ft1, rtz
+  expect t0, 0
+  expect_flags NX
+  fcvt.wu.s t0, fs4, rup
+  expect t0, 3
+  setf ft1, 0x4f7fffff # the largest float under 2^32
+  fcvt.wu.s t0, ft1, rtz
+  expect t0, 0xffffff00
+  expect_flags NX
+# conversions from integers
+  li t1, 16777217 # 2^24 + 1
+  fcvt.s.w ft0, t1, rne
+  expect_f ft0, 0x4b800000
+  fcvt.s.w ft0, t1, rup
+  expect_f ft0, 0x4b800001
+  li t1, -1
+  fcvt.s.wu ft0, t1, rne
+  expect_f ft0, 0x4f800000
+  fcvt.s.wu ft0, t1, rtz
+  expect_f ft0, 0x4f7fffff
+  fcvt.s.w ft0, t1
+  expect_f ft0, 0xbf800000
+  expect_flags NX
+# canonical NaNs: from a signaling NaN, from a quiet one with a payload, and from invalid operations
+  setf fs6, 0x7f800001 # signaling
+  setf fs7, 0xffc12345 # quiet, negative, with a payload
+  fadd.s ft0, fs6, fs0
+  expect_f ft0, QNAN
+  expect_flags NV
+  fmul.s ft0, fs7, fs0
+  expect_f ft0, QNAN
+  expect_flags 0
+  setf ft1, 0x7f800000 # inf
+  fmv.w.x ft2, zero
+  fmul.s ft0, ft1, ft2
+  expect_f ft0, QNAN
+  expect_flags NV
+  fsub.s ft0, ft1, ft1
+  expect_f ft0, QNAN
+  expect_flags NV
+  fdiv.s ft0, ft2, ft2
+  expect_f ft0, QNAN
+  expect_flags NV
+  fsqrt.s ft0, fs2
+  expect_f ft0, QNAN
+  expect_flags NV
+  fmadd.s ft0, ft1, ft2, fs0
+  expect_f ft0, QNAN
+  expect_flags NV
+# sign injection and moves keep payloads and raise nothing
+  fsgnjn.s ft0, fs7, fs7
+  expect_f ft0, 0x7fc12345
+  fsgnj.s ft0, fs6, fs2
+  expect_f ft0, 0xff800001
+  fsgnjx.s ft0, fs7, fs2
+  expect_f ft0, 0x7fc12345
+  fabs.s ft0, fs7
+  expect_f ft0, 0x7fc12345
+  fmv.s ft0, fs6
+  expect_f ft0, 0x7f800001
+  expect_flags 0
+# min and max: a NaN loses to a number, and only a signaling one is invalid; -0 is below +0
+  fmin.s ft0, fs7, fs0
+  expect_f ft0, ONE
+  expect_flags 0
+  fmax.s ft0, fs6, fs2
+  expect_f ft0, 0xbf800000
+  expect_flags NV
+  fmin.s ft0, fs6, fs7
+  expect_f ft0, QNAN
+  expect_flags NV
+  setf ft3, 0x80000000 # -0
+  fmin.s ft0, ft2, ft3
+  expect_f ft0, 0x80000000
+  fmax.s ft0, ft3, ft2
+  expect_f ft0, 0
+# flags of each kind
+  fdiv.s ft0, fs0, ft2
+  expect_f ft0, 0x7f800000
+  expect_flags DZ
+  fdiv.s ft0, fs2, ft3
+  expect_f ft0, 0x7f800000
+  expect_flags DZ
+  setf ft1, 0x7f7fffff # the largest float
+  fadd.s ft0, ft1, ft1
+  expect_f ft0, 0x7f800000
+  expect_flags OF | NX
+  fadd.s ft0, ft1, ft1, rtz
+  expect_f ft0, 0x7f7fffff
+  expect_flags OF | NX
+  setf ft1, 0x3f000000 # 0.5
+  setf ft4, 0x00800000 # the smallest normal, halved exactly
+  fmul.s ft0, ft4, ft1
+  expect_f ft0, 0x00400000
+  expect_flags 0
+  setf ft4, 0x00800001 # halved inexactly: a tie, to even
+  fmul.s ft0, ft4, ft1
+  expect_f ft0, 0x00400000
+  expect_flags UF | NX
+  setf ft1, 0x40400000 # 3
+  fdiv.s ft0, fs0, ft1
+  expect_f ft0, 0x3eaaaaab
+  fdiv.s ft0, fs0, ft1, rtz
+  expect_f ft0, 0x3eaaaaaa
+  setf ft1, 0x40000000 # 2
+  fsqrt.s ft0, ft1
+  expect_f ft0, 0x3fb504f3
+  expect_flags NX
+  fsqrt.s ft0, ft3
+  expect_f ft0, 0x80000000
+  expect_flags 0
+# flags accrue until cleared
+  fdiv.s ft0, fs0, ft2
+  fadd.s ft0, fs6, fs0
+  fdiv.s ft0, fs0, ft1
+  csrr t0, fflags
+  expect t0, DZ | NV
+  csrrs t0, fcsr, zero
+  expect t0, DZ | NV
+  expect_flags DZ | NV
+# comparisons: only lt and le are invalid on a quiet NaN, and all on a signaling one
+  feq.s t0, fs7, fs0
+  expect t0, 0
+  expect_flags 0
+  flt.s t0, fs7, fs0
+  expect t0, 0
+  expect_flags NV
+  fle.s t0, fs0, fs7
+  expect t0, 0
+  expect_flags NV
+  feq.s t0, fs6, fs6
+  expect t0, 0
+  expect_flags NV
+  feq.s t0, ft2, ft3
+  expect t0, 1
+  fle.s t0, ft3, ft2
+  expect t0, 1
+  flt.s t0, ft3, ft2
+  expect t0, 0
+  flt.s t0, fs2, fs0
+  expect t0, 1
+  expect_flags 0
+# fclass of every kind of value
+  li s0, 0
+  setf ft0, 0xff800000 # -inf
+  fclass.s t0, ft0
+  or s0, s0, t0
+  fclass.s t0, fs2 # -normal
+  or s0, s0, t0
+  setf ft0, 0x80000001 # -subnormal
+  fclass.s t0, ft0
+  or s0, s0, t0
+  fclass.s t0, ft3 # -0
+  or s0, s0, t0
+  fclass.s t0, ft2 # +0
+  or s0, s0, t0
+  setf ft0, 0x00000001 # +subnormal
+  fclass.s t0, ft0
+  or s0, s0, t0
+  fclass.s t0, fs0 # +normal
+  or s0, s0, t0
+  setf ft0, 0x7f800000 # +inf
+  fclass.s t0, ft0
+  or s0, s0, t0
+  fclass.s t0, fs6 # signaling NaN
+  or s0, s0, t0
+  fclass.s t0, fs7 # quiet NaN
+  expect t0, 1 << 9
+  or s0, s0, t0
+  expect s0, 0x3ff
+# multiply-add rounds once: (1 + 2^-12)^2 - 1 is 2^-11 + 2^-24, which a rounded product would lose
+  setf ft1, 0x3f800800 # 1 + 2^-12
+  fmadd.s ft0, ft1, ft1, fs2
+  expect_f ft0, 0x3a000400
+  fmul.s ft4, ft1, ft1
+  fadd.s ft0, ft4, fs2
+  expect_f ft0, 0x3a000000
+  fmsub.s ft0, ft1, ft1, fs0
+  expect_f ft0, 0x3a000400
+  fnmsub.s ft0, ft1, ft1, fs0
+  expect_f ft0, 0xba000400
+  fnmadd.s ft0, ft1, ft1, fs2
+  expect_f ft0, 0xba000400
+  expect_flags NX
+# loads and stores move bits unchanged, signaling NaNs too
+  li t1, 0x8000
+  fsw fs6, 0(t1)
+  flw ft0, 0(t1)
+  expect_f ft0, 0x7f800001
+  lw t0, 0(t1)
+  expect t0, 0x7f800001
+  expect_flags 0
+  .word 0x0ff00513 # li a0, 255, which halts
@@ -0,0 +1,104 @@
+# Several harts contending for the same words, for --cores and --smt; one hart gives the same answer, 121.
+# Every hart runs from address 0 with its own stack, 4 KiB below that of the hart before it, chosen by mhartid.
+# It calls work ROUNDS times, which bumps three shared counters:
+#   amo    with amoadd.w
+#   lrsc   with an lr.w / sc.w loop, retried when another hart took the reservation
+#   plain  with lw / sw, under a spinlock taken with amoswap.w
+# and checks that a value it left on its stack is still there. Hart 0 waits for the others, then returns 40
+# for each counter that reached ROUNDS times the number of harts, plus 1 if no stack was overwritten.
+  .option norvc
+  .equ ROUNDS, 40
+  .equ REGISTERED, 0x4000 # each on its own cache line
+  .equ DONE, 0x4040
+  .equ LOCK, 0x4080
+  .equ PLAIN, 0x40c0
+  .equ AMO, 0x4100
+  .equ LRSC, 0x4140
+  .equ CLOBBERED, 0x4180
+  csrr s0, mhartid
+  li sp, 0x20000
+  slli t0, s0, 12
+  sub sp, sp, t0
+  li t1, 1
+  li t2, REGISTERED
+  amoadd.w x0, t1, (t2)
+  li s1, ROUNDS
+rounds:
+  mv a0, s0
+  call work
+  addi s1, s1, -1
+  bnez s1, rounds
+  li t1, 1
+  li t2, DONE
+  amoadd.w x0, t1, (t2)
+  bnez s0, park
+  li t2, REGISTERED
+  li t3, DONE
+wait:
+  lw t4, 0(t2)
+  lw t5, 0(t3)
+  bne t4, t5, wait
+  li t0, ROUNDS
+  mul t0, t0, t4
+  li a0, 0
+  li t1, PLAIN
+  lw t2, 0(t1)
+  bne t2, t0, 1f
+  addi a0, a0, 40
+1:
+  li t1, AMO
+  lw t2, 0(t1)
+  bne t2, t0, 2f
+  addi a0, a0, 40
+2:
+  li t1, LRSC
+  lw t2, 0(t1)
+  bne t2, t0, 3f
+  addi a0, a0, 40
+3:
+  li t1, CLOBBERED
+  lw t2, 0(t1)
+  bnez t2, 4f
+  addi a0, a0, 1
+4:
+  .word 0x0ff00513 # li a0, 255, which halts
+park:
+  j park
+
+# work(a0 = mhartid)
+work:
+  addi sp, sp, -16
+  sw ra, 12(sp)
+  sw s0, 8(sp)
+  addi t0, a0, 0x55
+  sw t0, 0(sp)
+  li t1, 1
+  li t2, AMO
+  amoadd.w x0, t1, (t2)
+  li t2, LRSC
+retry:
+  lr.w t3, (t2)
+  addi t3, t3, 1
+  sc.w t4, t3, (t2)
+  bnez t4, retry
+  li t2, LOCK
+acquire:
+  li t1, 1
+  amoswap.w.aq t3, t1, (t2)
+  bnez t3, acquire
+  li t5, PLAIN
+  lw t6, 0(t5)
+  addi t6, t6, 1
+  sw t6, 0(t5)
+  amoswap.w.rl x0, x0, (t2)
+  lw t0, 0(sp)
+  addi t1, a0, 0x55
+  beq t0, t1, kept
+  li t1, 1
+  li t2, CLOBBERED
+  amoadd.w x0, t1, (t2)
+kept:
+  lw s0, 8(sp)
+  lw ra, 12(sp)
+  addi sp, sp, 16
+  ret
@@ -0,0 +1,133 @@
+# RV32M, without a C runtime: each check that gives the value the specification asks for adds 1 to a0,
+# and the program returns the number of checks, 40.
+# Beyond plain products and quotients it covers the high halves of all sign combinations, division by zero
+# (quotient all ones, remainder the dividend), the one overflow (-2^31 / -1: quotient -2^31, remainder 0),
+# quotients and remainders rounding toward zero, and results feeding each other while the divider is busy.
+  .option norvc
+  .macro expect reg, value
+  li t6, \value
+  bne \reg, t6, 1f
+  addi a0, a0, 1
+1:
+  .endm
+  li a0, 0
+# products
+  li s0, 7
+  li s1, -3
+  mul t0, s0, s1
+  expect t0, -21
+  li s2, 0x12345678
+  li s3, 0x9abcdef0
+  mul t0, s2, s3
+  expect t0, 0x242d2080
+  mulh t0, s2, s3
+  expect t0, 0xf8cc93d6
+  mulhu t0, s2, s3
+  expect t0, 0x0b00ea4e
+  mulhsu t0, s2, s3
+  expect t0, 0x0b00ea4e
+  mulhsu t0, s3, s2
+  expect t0, 0xf8cc93d6
+  li s4, 0x80000000
+  mulh t0, s4, s4
+  expect t0, 0x40000000
+  mulhu t0, s4, s4
+  expect t0, 0x40000000
+  li s5, -1
+  mulhu t0, s5, s5
+  expect t0, 0xfffffffe
+  mulhsu t0, s5, s5
+  expect t0, -1
+  mulh t0, s5, s5
+  expect t0, 0
+  mul t0, s4, s5
+  expect t0, 0x80000000
+# quotients and remainders round toward zero
+  li s0, 20
+  li s1, -3
+  div t0, s0, s1
+  expect t0, -6
+  rem t0, s0, s1
+  expect t0, 2
+  li s0, -20
+  li s1, 3
+  div t0, s0, s1
+  expect t0, -6
+  rem t0, s0, s1
+  expect t0, -2
+  li s1, -3
+  div t0, s0, s1
+  expect t0, 6
+  rem t0, s0, s1
+  expect t0, -2
+  divu t0, s5, s1
+  expect t0, 1
+  li s1, 3
+  divu t0, s5, s1
+  expect t0, 0x55555555
+  li s0, 0xfffffffe
+  remu t0, s0, s1
+  expect t0, 2
+  divu t0, s1, s0
+  expect t0, 0
+  remu t0, s1, s0
+  expect t0, 3
+# division by zero
+  li s0, -20
+  div t0, s0, zero
+  expect t0, -1
+  divu t0, s0, zero
+  expect t0, 0xffffffff
+  rem t0, s0, zero
+  expect t0, -20
+  remu t0, s0, zero
+  expect t0, -20
+  div t0, zero, zero
+  expect t0, -1
+  rem t0, zero, zero
+  expect t0, 0
+# the overflow
+  div t0, s4, s5
+  expect t0, 0x80000000
+  rem t0, s4, s5
+  expect t0, 0
+  divu t0, s4, s5
+  expect t0, 0
+  remu t0, s4, s5
+  expect t0, 0x80000000
+# a destination that is also a source, and x0 as destination
+  li t1, 9
+  mul t1, t1, t1
+  expect t1, 81
+  div t1, t1, s1
+  expect t1, 27
+  mul zero, t1, t1
+  expect zero, 0
+# back to back on the divider, each quotient feeding the next: 1000000 / 7 / 7 = 20408, which is 2915 * 7 + 3; times 49
+  li t1, 1000000
+  li t2, 7
+  divu t1, t1, t2
+  divu t1, t1, t2
+  divu t3, t1, t2
+  remu t4, t1, t2
+  expect t3, 2915
+  expect t4, 3
+  mul t3, t3, t2
+  add t3, t3, t4
+  mul t3, t3, t2
+  mul t3, t3, t2
+  expect t3, 999992
+# independent divisions and products in flight together: 100 / 12 + 100 % 12 + 12 * 12 + 300 / 10
+  li t1, 100
+  li t2, 12
+  li t3, 300
+  li t4, 10
+  divu s6, t1, t2
+  remu s7, t1, t2
+  mul s8, t2, t2
+  div s9, t3, t4
+  add s6, s6, s7
+  add s6, s6, s8
+  add s6, s6, s9
+  expect s6, 186
+  .word 0x0ff00513 # li a0, 255, which halts
@@ -0,0 +1,17 @@
+# Runs CODE on the testcase DATA with OPTIONS, writing the trace TRACE, then replays TRACE with the same OPTIONS,
+# and fails unless both give the same result and the same committed instructions and cycles.
+# cmake -DCODE=... -DDATA=... -DTRACE=... "-DOPTIONS=..." -P replay.cmake
+separate_arguments(options UNIX_COMMAND "${OPTIONS}")
+execute_process(COMMAND ${CODE} ${options} --trace=${TRACE} INPUT_FILE ${DATA}
+                OUTPUT_VARIABLE run_output ERROR_VARIABLE run_error RESULT_VARIABLE run_status)
+execute_process(COMMAND ${CODE} ${options} --replay=${TRACE} INPUT_FILE /dev/null
+                OUTPUT_VARIABLE replay_output ERROR_VARIABLE replay_error RESULT_VARIABLE replay_status)
+if (NOT run_status EQUAL 0 OR NOT replay_status EQUAL 0)
+  message(FATAL_ERROR "run: ${run_status} ${run_error}\nreplay: ${replay_status} ${replay_error}")
+endif ()
+string(REGEX MATCH "^[^\n]*" run_cycles "${run_error}")
+string(REGEX MATCH "^[^\n]*" replay_cycles "${replay_error}")
+if (NOT run_output STREQUAL replay_output OR NOT run_cycles STREQUAL replay_cycles)
+  message(FATAL_ERROR "run: ${run_output} ${run_cycles}\nreplay: ${replay_output} ${replay_cycles}")
+endif ()
+message(STATUS "${run_output} ${run_cycles}")
@@ -0,0 +1,109 @@
+# Sv32 translation, without a C runtime: the program builds a page table, turns it on with satp, and returns
+# the sum of what it reads through it, 61. Faulting loads read 0 and faulting stores are dropped.
+#   root table at 0x10000
+#     vpn1 0  -> the table at 0x11000
+#     vpn1 2  -> megapage at physical 0, read-write: 0x800000 aliases 0x0
+#   table at 0x11000
+#     pages 0x0-0x7   -> themselves, read-write-execute: this code
+#     page 0x8        -> 0x20000, read-write
+#     page 0x9        -> 0x21000, read-only
+#     pages 0x10-0x3f -> 0x40000-0x6f000, read-write: more pages than the TLBs hold
+  .option norvc
+  li s0, 0x10000
+  li s1, 0x11000
+  srli t0, s1, 12
+  slli t0, t0, 10
+  ori t0, t0, 1
+  sw t0, 0(s0)
+  li t0, 0x7
+  sw t0, 8(s0)
+  li t1, 0
+  li t2, 8
+identity:
+  slli t0, t1, 10
+  ori t0, t0, 0xf
+  slli t3, t1, 2
+  add t3, t3, s1
+  sw t0, 0(t3)
+  addi t1, t1, 1
+  bne t1, t2, identity
+  li t0, (0x20 << 10) | 7
+  sw t0, 32(s1)
+  li t0, (0x21 << 10) | 3
+  sw t0, 36(s1)
+  li t1, 16
+  li t2, 64
+pages:
+  addi t0, t1, 0x30
+  slli t0, t0, 10
+  ori t0, t0, 7
+  slli t3, t1, 2
+  add t3, t3, s1
+  sw t0, 0(t3)
+  addi t1, t1, 1
+  bne t1, t2, pages
+  li t0, 0x80000010
+  csrw satp, t0
+  csrr s2, satp
+  li a0, 0
+# a page and the megapage alias the same word, either way: 5 + 7
+  li t0, 5
+  li t1, 0x8000
+  sw t0, 0(t1)
+  li t2, 0x820000
+  lw t3, 0(t2)
+  add a0, a0, t3
+  li t0, 7
+  sw t0, 4(t2)
+  lw t3, 4(t1)
+  add a0, a0, t3
+# a store to a read-only page is dropped: 0
+  li t1, 0x9000
+  li t0, 100
+  sw t0, 0(t1)
+  lw t3, 0(t1)
+  add a0, a0, t3
+# physical 0xc000 is reached through the megapage only, and unmapped pages read 0: 0 + 0
+  li t0, 9
+  li t1, 0x80c000
+  sw t0, 0(t1)
+  li t1, 0xc000
+  lw t3, 0(t1)
+  add a0, a0, t3
+  li t1, 0x400000
+  lw t3, 0(t1)
+  add a0, a0, t3
+# three rounds over 48 pages, with a call to another code page each time, to keep both TLBs missing
+  li s3, 3
+round:
+  li t1, 0x10000
+  li t2, 48
+touch:
+  sw t2, 0(t1)
+  jal ra, far
+  li t5, 4096
+  add t1, t1, t5
+  addi t2, t2, -1
+  bnez t2, touch
+  addi s3, s3, -1
+  bnez s3, round
+# read the 48 pages back through the megapage: 48
+  li t1, 0x840000
+  li t2, 48
+check:
+  lw t3, 0(t1)
+  bne t3, t2, skip
+  addi a0, a0, 1
+skip:
+  li t5, 4096
+  add t1, t1, t5
+  addi t2, t2, -1
+  bnez t2, check
+# satp reads back with MODE set: 1
+  srli s2, s2, 31
+  add a0, a0, s2
+  .word 0x0ff00513 # li a0, 255, which halts
+  .org 0x3000
+far:
+  lw t3, 0(t1)
+  ret